@@ -5,12 +5,16 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <numeric>
 #include <random>
+#include <span>
 #include <stdlib.h>
+#include <thread>
 #include <vector>
 extern "C" {
 #include "random_bounded.h"
 }
+#include "random_bounded_inline.h"
 #include "generators.h"
 #include "template_shuffle.h"
 
@@ -46,6 +50,44 @@ void pretty_print(size_t volume, size_t bytes, std::string name,
   printf("\n");
 }
 
+// A Lehmer generator defined outside of the library: shuffle_batch_23456 can
+// only call it through a function pointer, the header-only shuffles inline it.
+struct bench_lehmer_context {
+  __uint128_t state;
+};
+static bench_lehmer_context bench_lehmer_global{1234};
+static inline uint64_t bench_lehmer_next(bench_lehmer_context *ctx) {
+  ctx->state *= UINT64_C(0xda942042e4dd58b5);
+  return (uint64_t)(ctx->state >> 64);
+}
+static uint64_t bench_lehmer() { return bench_lehmer_next(&bench_lehmer_global); }
+BR_DEFINE_INLINE(bench_lehmer, bench_lehmer_context, bench_lehmer_next)
+
+// Shuffles consecutive blocks of N elements with the fixed-size
+// batched_random::shuffle.
+template <size_t N>
+void shuffle_fixed_blocks(std::vector<uint64_t> &input, lehmer64 &g) {
+  for (size_t t = 0; t < input.size(); t += N) {
+    batched_random::shuffle(std::span<uint64_t, N>(input.data() + t, N), g);
+  }
+}
+
+// Calls shuffle_fixed_blocks<N> with N == size, for the powers of two from
+// 2^3 to 2^14. Returns false for other sizes.
+template <size_t N = 8>
+bool shuffle_fixed_blocks(std::vector<uint64_t> &input, size_t size,
+                          lehmer64 &g) {
+  if constexpr (N > 1 << 14) {
+    return false;
+  } else {
+    if (size == N) {
+      shuffle_fixed_blocks<N>(input, g);
+      return true;
+    }
+    return shuffle_fixed_blocks<2 * N>(input, size, g);
+  }
+}
+
 void bench(size_t size, bool include_cpp) {
   constexpr size_t min_volume = 4096;
   if (size == 0) {
@@ -135,6 +177,68 @@ void bench(size_t size, bool include_cpp) {
               }
             },
             min_repeat, min_time_ns, max_repeat));
+    batched_random::shuffle_plan plan(size);
+    pretty_print(
+        volume, volume * sizeof(uint64_t), "C++ shuffle 2-6 with plan (lehmer)",
+        bench(
+            [&input, &lehmerGenerator, &plan, size]() {
+              for (auto t = input.begin(); t < input.end(); t += size) {
+                plan.shuffle(t, t + size, lehmerGenerator);
+              }
+            },
+            min_repeat, min_time_ns, max_repeat));
+    for (uint64_t block : {256, 1024, 4096}) {
+      pretty_print(volume, volume * sizeof(uint64_t),
+                   "C++ shuffle 2-6 blocked " + std::to_string(block) +
+                       " (lehmer)",
+                   bench(
+                       [&input, &lehmerGenerator, size, block]() {
+                         for (auto t = input.begin(); t < input.end();
+                              t += size) {
+                           batched_random::shuffle_23456_blocked(
+                               t, t + size, lehmerGenerator, block);
+                         }
+                       },
+                       min_repeat, min_time_ns, max_repeat));
+    }
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "C++ shuffle 2-6 prefetch (lehmer)",
+                 bench(
+                     [&input, &lehmerGenerator, size]() {
+                       for (auto t = input.begin(); t < input.end(); t += size) {
+                         batched_random::shuffle_23456_prefetch(
+                             t, t + size, lehmerGenerator);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+    if (shuffle_fixed_blocks(input, size, lehmerGenerator)) {
+      pretty_print(volume, volume * sizeof(uint64_t),
+                   "C++ fixed-size shuffle (lehmer)",
+                   bench(
+                       [&input, &lehmerGenerator, size]() {
+                         shuffle_fixed_blocks(input, size, lehmerGenerator);
+                       },
+                       min_repeat, min_time_ns, max_repeat));
+    }
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "precomputed shuffle (lower bound)",
+                 bench(
+                     [&input, &precomputed, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         precomp_shuffle(input.data() + t, size,
+                                         precomputed.data() + t);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+    pretty_print(
+        volume, volume * sizeof(uint64_t), "C++ shuffle small (lehmer)",
+        bench(
+            [&input, &lehmerGenerator, size]() {
+              for (auto t = input.begin(); t < input.end(); t += size) {
+                batched_random::shuffle_small(t, t + size, lehmerGenerator);
+              }
+            },
+            min_repeat, min_time_ns, max_repeat));
     pretty_print(
         volume, volume * sizeof(uint64_t), "C++ shuffle 2-6p (lehmer)",
         bench(
@@ -205,6 +309,38 @@ void bench(size_t size, bool include_cpp) {
             },
             min_repeat, min_time_ns, max_repeat));
 
+    // Other fast generators
+    auto bench_cpp_engine = [&](auto generator, std::string name) {
+      std::cout << "=== C++ " << name << std::endl;
+      pretty_print(
+          volume, volume * sizeof(uint64_t), "C++ std::shuffle (" + name + ")",
+          bench(
+              [&input, &generator, size]() {
+                for (auto t = input.begin(); t < input.end(); t += size) {
+                  std::shuffle(t, t + size, generator);
+                }
+              },
+              min_repeat, min_time_ns, max_repeat));
+      pretty_print(
+          volume, volume * sizeof(uint64_t), "C++ shuffle 2-6 (" + name + ")",
+          bench(
+              [&input, &generator, size]() {
+                for (auto t = input.begin(); t < input.end(); t += size) {
+                  batched_random::shuffle_23456(t, t + size, generator);
+                }
+              },
+              min_repeat, min_time_ns, max_repeat));
+    };
+    bench_cpp_engine(xoshiro256pp{rd()}, "xoshiro256++");
+    bench_cpp_engine(wyrand{rd()}, "wyrand");
+    bench_cpp_engine(sfc64{rd()}, "sfc64");
+    bench_cpp_engine(romu_duo_jr{rd()}, "romu");
+    // generators that do not produce 64-bit words: 32-bit paths for
+    // std::mt19937 and pcg32, word64_adapter for std::minstd_rand (31 bits)
+    bench_cpp_engine(std::mt19937{rd()}, "std::mt19937");
+    bench_cpp_engine(pcg32{rd()}, "pcg32");
+    bench_cpp_engine(std::minstd_rand{rd()}, "std::minstd_rand");
+
   } else {
 
     // Lehmer
@@ -237,6 +373,138 @@ void bench(size_t size, bool include_cpp) {
                      },
                      min_repeat, min_time_ns, max_repeat));
 
+    // random permutations of 0, ..., size-1, from scratch
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "iota + batch shuffle 2-6 (lehmer)",
+                 bench(
+                     [&input, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         std::iota(input.begin() + t, input.begin() + t + size,
+                                   0);
+                         shuffle_lehmer_23456(input.data() + t, size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "random_permutation_u64 (lehmer)",
+                 bench(
+                     [&input, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         random_permutation_u64_lehmer(input.data() + t, size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+    std::vector<uint32_t> permutation32(volume);
+    pretty_print(volume, volume * sizeof(uint32_t),
+                 "random_permutation_u32 (lehmer)",
+                 bench(
+                     [&permutation32, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         random_permutation_u32_lehmer(permutation32.data() + t,
+                                                       size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    br_lehmer_t lehmer_context;
+    br_lehmer_seed(&lehmer_context, 1234);
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "batch shuffle 2-6 with context (lehmer)",
+                 bench(
+                     [&input, &lehmer_context, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         shuffle_lehmer_23456_r(&lehmer_context,
+                                                input.data() + t, size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "batch shuffle 2-6 function pointer (lehmer)",
+                 bench(
+                     [&input, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         shuffle_batch_23456(input.data() + t, size,
+                                             bench_lehmer);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "batch shuffle 2-6 inline header (lehmer)",
+                 bench(
+                     [&input, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         bench_lehmer_shuffle_23456(&bench_lehmer_global,
+                                                    input.data() + t, size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "batch shuffle 2-6 blocked (lehmer)",
+                 bench(
+                     [&input, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         shuffle_lehmer_23456_blocked(input.data() + t, size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "batch shuffle 2-6 prefetch (lehmer)",
+                 bench(
+                     [&input, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         shuffle_lehmer_prefetch(input.data() + t, size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    shuffle_plan plan;
+    if (shuffle_plan_init(&plan, size) == 0) {
+      pretty_print(volume, volume * sizeof(uint64_t),
+                   "batch shuffle 2-6 with plan (lehmer)",
+                   bench(
+                       [&input, &plan, size, volume]() {
+                         for (size_t t = 0; t < volume; t += size) {
+                           shuffle_lehmer_plan(input.data() + t, &plan);
+                         }
+                       },
+                       min_repeat, min_time_ns, max_repeat));
+      shuffle_plan_free(&plan);
+    }
+
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "batch shuffle 2-6 4x (lehmer)",
+                 bench(
+                     [&input, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         shuffle_lehmer_23456_4x(input.data() + t, size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "batch shuffle 2-6 8x (lehmer)",
+                 bench(
+                     [&input, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         shuffle_lehmer_23456_8x(input.data() + t, size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "batch shuffle 2-6 lanes (lehmer)",
+                 bench(
+                     [&input, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         shuffle_lehmer_23456_lanes(input.data() + t, size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
     pretty_print(volume, volume * sizeof(uint64_t),
                  "naive batch shuffle 2 (lehmer)",
                  bench(
@@ -276,6 +544,16 @@ void bench(size_t size, bool include_cpp) {
                      },
                      min_repeat, min_time_ns, max_repeat));
 
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "batch shuffle 2-6 lanes (PCG)",
+                 bench(
+                     [&input, size, volume]() {
+                       for (size_t t = 0; t < volume; t += size) {
+                         shuffle_pcg_23456_lanes(input.data() + t, size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
     pretty_print(volume, volume * sizeof(uint64_t),
                  "naive batch shuffle 2 (PCG)",
                  bench(
@@ -315,6 +593,38 @@ void bench(size_t size, bool include_cpp) {
                      },
                      min_repeat, min_time_ns, max_repeat));
 
+    for (size_t rounds : {12, 20}) {
+      br_chacha_t chacha_context;
+      br_chacha_seed_rounds(&chacha_context, 1234, rounds);
+      pretty_print(volume, volume * sizeof(uint64_t),
+                   "batch shuffle 2-6 (chacha" + std::to_string(rounds) +
+                       ", context)",
+                   bench(
+                       [&input, &chacha_context, size, volume]() {
+                         for (size_t t = 0; t < volume; t += size) {
+                           shuffle_chacha_23456_r(&chacha_context,
+                                                  input.data() + t, size);
+                         }
+                       },
+                       min_repeat, min_time_ns, max_repeat));
+    }
+
+    // counter-based engines, to compare with chacha
+    const std::pair<std::string, void (*)(uint64_t *, uint64_t)>
+        counter_engines[] = {{"philox", shuffle_philox_23456},
+                             {"aes", shuffle_aes_23456}};
+    for (const auto &[name, function] : counter_engines) {
+      pretty_print(volume, volume * sizeof(uint64_t),
+                   "batch shuffle 2-6 (" + name + ")",
+                   bench(
+                       [&input, function, size, volume]() {
+                         for (size_t t = 0; t < volume; t += size) {
+                           function(input.data() + t, size);
+                         }
+                       },
+                       min_repeat, min_time_ns, max_repeat));
+    }
+
     pretty_print(volume, volume * sizeof(uint64_t),
                  "naive batch shuffle 2 (chacha)",
                  bench(
@@ -324,10 +634,406 @@ void bench(size_t size, bool include_cpp) {
                        }
                      },
                      min_repeat, min_time_ns, max_repeat));
+
+    // other fast generators
+    const struct {
+      std::string name;
+      void (*standard)(uint64_t *, uint64_t);
+      void (*batch_2)(uint64_t *, uint64_t);
+      void (*batch_23456)(uint64_t *, uint64_t);
+    } engines[] = {
+        {"xoshiro256++", shuffle_xoshiro256pp, shuffle_xoshiro256pp_2,
+         shuffle_xoshiro256pp_23456},
+        {"wyrand", shuffle_wyrand, shuffle_wyrand_2, shuffle_wyrand_23456},
+        {"sfc64", shuffle_sfc64, shuffle_sfc64_2, shuffle_sfc64_23456},
+        {"romu", shuffle_romu, shuffle_romu_2, shuffle_romu_23456}};
+    for (const auto &engine : engines) {
+      const std::pair<std::string, void (*)(uint64_t *, uint64_t)> rows[] = {
+          {"standard shuffle", engine.standard},
+          {"batch shuffle 2", engine.batch_2},
+          {"batch shuffle 2-6", engine.batch_23456}};
+      for (const auto &[label, function] : rows) {
+        pretty_print(volume, volume * sizeof(uint64_t),
+                     label + " (" + engine.name + ")",
+                     bench(
+                         [&input, function, size, volume]() {
+                           for (size_t t = 0; t < volume; t += size) {
+                             function(input.data() + t, size);
+                           }
+                         },
+                         min_repeat, min_time_ns, max_repeat));
+      }
+    }
+
+    // bounded random integers in [0, size)
+
+    std::vector<uint64_t> bounded(volume);
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "random_bounded loop (lehmer)",
+                 bench(
+                     [&bounded, size]() {
+                       for (uint64_t &b : bounded) {
+                         b = random_bounded_lehmer(size);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "random_bounded_fill (lehmer)",
+                 bench(
+                     [&bounded, size]() {
+                       random_bounded_fill_lehmer(size, bounded.data(),
+                                                  bounded.size());
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    // bounded random integers in [0, (i % size) + 1), as in precomputed
+
+    std::vector<uint64_t> ranges(volume);
+    for (size_t i = 0; i < volume; i++) {
+      ranges[i] = (i % size) + 1;
+    }
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "random_bounded loop, mixed ranges (lehmer)",
+                 bench(
+                     [&bounded, &ranges]() {
+                       for (size_t i = 0; i < bounded.size(); i++) {
+                         bounded[i] = random_bounded_lehmer(ranges[i]);
+                       }
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+
+    pretty_print(volume, volume * sizeof(uint64_t),
+                 "random_bounded_ranges (lehmer)",
+                 bench(
+                     [&bounded, &ranges]() {
+                       random_bounded_ranges_lehmer(
+                           ranges.data(), bounded.data(), bounded.size());
+                     },
+                     min_repeat, min_time_ns, max_repeat));
   }
 
 }
 
+// Shuffles of arrays that do not fit in cache, one array at a time.
+void bench_large(size_t size) {
+  std::vector<uint64_t> input(size);
+  std::iota(input.begin(), input.end(), 0);
+  std::cout << "Size of shuffle      : " << size << " words" << std::endl;
+  std::cout << "Size of shuffle      : "
+            << size * sizeof(uint64_t) / 1024 / 1024. << " MB" << std::endl;
+
+  size_t min_repeat = 2;
+  size_t min_time_ns = 1000000000;
+  size_t max_repeat = 10;
+
+  pretty_print(size, size * sizeof(uint64_t), "batch shuffle 2-6 (lehmer)",
+               bench([&input, size]() { shuffle_lehmer_23456(input.data(), size); },
+                     min_repeat, min_time_ns, max_repeat));
+  pretty_print(size, size * sizeof(uint64_t),
+               "batch shuffle 2-6 prefetch (lehmer)",
+               bench([&input, size]() { shuffle_lehmer_prefetch(input.data(), size); },
+                     min_repeat, min_time_ns, max_repeat));
+  pretty_print(size, size * sizeof(uint64_t),
+               "iota + batch shuffle 2-6 (lehmer)",
+               bench(
+                   [&input, size]() {
+                     std::iota(input.begin(), input.end(), 0);
+                     shuffle_lehmer_23456(input.data(), size);
+                   },
+                   min_repeat, min_time_ns, max_repeat));
+  pretty_print(size, size * sizeof(uint64_t), "random_permutation_u64 (lehmer)",
+               bench([&input, size]() { random_permutation_u64_lehmer(input.data(), size); },
+                     min_repeat, min_time_ns, max_repeat));
+  pretty_print(size, size * sizeof(uint64_t), "batch shuffle bucketed (lehmer)",
+               bench([&input, size]() { shuffle_lehmer_bucketed(input.data(), size); },
+                     min_repeat, min_time_ns, max_repeat));
+  lehmer64 lehmerGenerator(1234);
+  pretty_print(size, size * sizeof(uint64_t), "C++ bucketed shuffle (lehmer)",
+               bench(
+                   [&input, &lehmerGenerator]() {
+                     batched_random::shuffle_bucketed(input.begin(), input.end(),
+                                                      lehmerGenerator);
+                   },
+                   min_repeat, min_time_ns, max_repeat));
+}
+
+// Shuffles of count records of 4 to 256 bytes, in place with shuffle_bytes
+// and by shuffling indexes and then gathering the records, and of the
+// columns of a table with one permutation.
+void bench_records(size_t count) {
+  std::cout << "Number of records    : " << count << std::endl;
+  size_t min_repeat = 2;
+  size_t min_time_ns = 400000000;
+  size_t max_repeat = 100;
+  std::vector<uint64_t> indexes(count);
+  for (size_t elem_size : {4, 8, 16, 32, 64, 100, 256}) {
+    std::vector<unsigned char> records(count * elem_size, 1);
+    std::vector<unsigned char> gathered(count * elem_size);
+    std::string suffix = " (" + std::to_string(elem_size) + " bytes, lehmer)";
+    pretty_print(count, count * elem_size, "shuffle_bytes" + suffix,
+                 bench(
+                     [&records, count, elem_size]() {
+                       shuffle_bytes_lehmer(records.data(), count, elem_size);
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+    pretty_print(count, count * elem_size, "index shuffle + gather" + suffix,
+                 bench(
+                     [&records, &gathered, &indexes, count, elem_size]() {
+                       std::iota(indexes.begin(), indexes.end(), 0);
+                       shuffle_lehmer_23456(indexes.data(), count);
+                       for (size_t i = 0; i < count; i++) {
+                         memcpy(gathered.data() + i * elem_size,
+                                records.data() + indexes[i] * elem_size,
+                                elem_size);
+                       }
+                       records.swap(gathered);
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+  }
+
+  // columns of a table (64-byte features, 4-byte labels, 8-byte weights):
+  // one shuffle per column from a reseeded generator, or all at once
+  std::vector<unsigned char> features(count * 64);
+  std::vector<uint32_t> labels(count);
+  std::vector<uint64_t> weights(count);
+  void *const columns[] = {features.data(), labels.data(), weights.data()};
+  const size_t column_sizes[] = {64, sizeof(uint32_t), sizeof(uint64_t)};
+  const size_t row_size = 64 + sizeof(uint32_t) + sizeof(uint64_t);
+  br_lehmer_t context;
+  pretty_print(count, count * row_size,
+               "shuffle_bytes per column, reseeded (lehmer)",
+               bench(
+                   [&context, &columns, &column_sizes, count]() {
+                     for (size_t c = 0; c < 3; c++) {
+                       br_lehmer_seed(&context, 1234);
+                       shuffle_bytes_lehmer_r(&context, columns[c], count,
+                                              column_sizes[c]);
+                     }
+                   },
+                   min_repeat, min_time_ns, max_repeat));
+  pretty_print(count, count * row_size, "shuffle_soa, 3 columns (lehmer)",
+               bench(
+                   [&context, &columns, &column_sizes, count]() {
+                     br_lehmer_seed(&context, 1234);
+                     shuffle_soa_lehmer_r(&context, columns, column_sizes, 3,
+                                          count);
+                   },
+                   min_repeat, min_time_ns, max_repeat));
+}
+
+// Draws k of n values without replacement, for k from 16 to n/4: by a full
+// shuffle, by std::sample, by the first k steps of the shuffle, and with the
+// hash table of sample_without_replacement.
+void bench_sample(size_t size) {
+  std::vector<uint64_t> input(size);
+  std::iota(input.begin(), input.end(), 0);
+  std::cout << "Population           : " << size << " words" << std::endl;
+  size_t min_repeat = 2;
+  size_t min_time_ns = 400000000;
+  size_t max_repeat = 100000;
+  lehmer64 lehmerGenerator(1234);
+  for (size_t k = 16; k <= size / 4; k *= 16) {
+    std::vector<uint64_t> sample(k);
+    std::string suffix = ", k = " + std::to_string(k) + " (lehmer)";
+    pretty_print(k, k * sizeof(uint64_t), "batch shuffle 2-6" + suffix,
+                 bench([&input, size]() { shuffle_lehmer_23456(input.data(), size); },
+                       min_repeat, min_time_ns, max_repeat));
+    pretty_print(k, k * sizeof(uint64_t), "std::sample" + suffix,
+                 bench(
+                     [&input, &sample, &lehmerGenerator, k]() {
+                       std::sample(input.begin(), input.end(), sample.begin(),
+                                   k, lehmerGenerator);
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+    pretty_print(k, k * sizeof(uint64_t), "partial_shuffle" + suffix,
+                 bench([&input, size, k]() { partial_shuffle_lehmer(input.data(), size, k); },
+                       min_repeat, min_time_ns, max_repeat));
+    pretty_print(k, k * sizeof(uint64_t), "sample_without_replacement" + suffix,
+                 bench(
+                     [&sample, size, k]() {
+                       sample_without_replacement_lehmer(size, k, sample.data());
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+  }
+}
+
+// Bootstrap resampling of n values (n draws with replacement): one
+// random_bounded call per draw against the batched draws, and, for rows of
+// 256 bytes, the gathered copy against the counts.
+void bench_resample(size_t size) {
+  std::cout << "Population           : " << size << " words" << std::endl;
+  size_t min_repeat = 2;
+  size_t min_time_ns = 400000000;
+  size_t max_repeat = 100000;
+  std::vector<uint64_t> src(size), dst(size), counts(size);
+  std::iota(src.begin(), src.end(), 0);
+  pretty_print(size, size * sizeof(uint64_t), "random_bounded loop (lehmer)",
+               bench(
+                   [&src, &dst, size]() {
+                     for (size_t j = 0; j < size; j++) {
+                       dst[j] = src[random_bounded_lehmer(size)];
+                     }
+                   },
+                   min_repeat, min_time_ns, max_repeat));
+  pretty_print(size, size * sizeof(uint64_t),
+               "resample_with_replacement (lehmer)",
+               bench(
+                   [&src, &dst, size]() {
+                     resample_with_replacement_lehmer(src.data(), size,
+                                                      dst.data(), size);
+                   },
+                   min_repeat, min_time_ns, max_repeat));
+  std::vector<unsigned char> rows(size * 256, 1), gathered(size * 256);
+  pretty_print(size, size * 256, "resample_bytes (256 bytes, lehmer)",
+               bench(
+                   [&rows, &gathered, size]() {
+                     resample_bytes_lehmer(rows.data(), size, 256,
+                                           gathered.data(), size);
+                   },
+                   min_repeat, min_time_ns, max_repeat));
+  pretty_print(size, size * 256, "resample_counts (lehmer)",
+               bench(
+                   [&counts, size]() {
+                     resample_counts_lehmer(size, size, counts.data());
+                   },
+                   min_repeat, min_time_ns, max_repeat));
+}
+
+// Parallel shuffles, deterministic or not, with 1, 2, 4, ... threads, up to
+// the number of hardware threads, against the fastest sequential shuffle.
+void bench_parallel(size_t size) {
+  std::vector<uint64_t> input(size);
+  std::iota(input.begin(), input.end(), 0);
+  std::cout << "Size of shuffle      : " << size << " words" << std::endl;
+  std::cout << "Size of shuffle      : "
+            << size * sizeof(uint64_t) / 1024 / 1024. << " MB" << std::endl;
+
+  size_t min_repeat = 2;
+  size_t min_time_ns = 1000000000;
+  size_t max_repeat = 10;
+
+  pretty_print(size, size * sizeof(uint64_t),
+               "batch shuffle 2-6 prefetch (lehmer)",
+               bench([&input, size]() { shuffle_lehmer_prefetch(input.data(), size); },
+                     min_repeat, min_time_ns, max_repeat));
+  lehmer64 lehmerGenerator(1234);
+  uint64_t seed = 1234;
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned nthreads = 1;; nthreads = std::min(2 * nthreads, max_threads)) {
+    pretty_print(size, size * sizeof(uint64_t),
+                 "shuffle_parallel " + std::to_string(nthreads) + " threads",
+                 bench(
+                     [&input, size, nthreads, &seed]() {
+                       shuffle_parallel(input.data(), size, nthreads, seed++);
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+    pretty_print(size, size * sizeof(uint64_t),
+                 "shuffle_parallel_deterministic " +
+                     std::to_string(nthreads) + " threads",
+                 bench(
+                     [&input, size, nthreads, &seed]() {
+                       shuffle_parallel_deterministic(input.data(), size,
+                                                      nthreads, seed++);
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+    pretty_print(size, size * sizeof(uint64_t),
+                 "C++ shuffle_parallel " + std::to_string(nthreads) +
+                     " threads",
+                 bench(
+                     [&input, nthreads, &lehmerGenerator]() {
+                       batched_random::shuffle_parallel(
+                           input.begin(), input.end(), lehmerGenerator,
+                           nthreads);
+                     },
+                     min_repeat, min_time_ns, max_repeat));
+    if (nthreads == max_threads) {
+      break;
+    }
+  }
+}
+
+// Cost of setting up a substream delta outputs ahead: advance (constant or
+// logarithmic time) against calling the generator delta times.
+void bench_advance() {
+  size_t min_repeat = 10;
+  size_t min_time_ns = 100000000;
+  size_t max_repeat = 1000;
+  constexpr size_t jumps = 1000;
+  auto print = [](std::string name, event_aggregate agg) {
+    printf("%-45s : %10.1f ns\n", name.c_str(),
+           agg.fastest_elapsed_ns() / jumps);
+  };
+  br_lehmer_t lehmer_context;
+  br_pcg_t pcg_context;
+  br_chacha_t chacha_context;
+  br_lehmer_seed(&lehmer_context, 1234);
+  br_pcg_seed(&pcg_context, 1234);
+  br_chacha_seed(&chacha_context, 1234);
+  for (int log = 4; log <= 60; log += 8) {
+    uint64_t delta = uint64_t(1) << log;
+    std::string suffix = " 2^" + std::to_string(log);
+    print("br_lehmer_advance" + suffix,
+          bench(
+              [&lehmer_context, delta]() {
+                for (size_t j = 0; j < jumps; j++) {
+                  br_lehmer_advance(&lehmer_context, delta);
+                }
+              },
+              min_repeat, min_time_ns, max_repeat));
+    print("br_pcg_advance" + suffix,
+          bench(
+              [&pcg_context, delta]() {
+                for (size_t j = 0; j < jumps; j++) {
+                  br_pcg_advance(&pcg_context, delta);
+                }
+              },
+              min_repeat, min_time_ns, max_repeat));
+    // The block counter of ChaCha (2^67 outputs) must not overflow.
+    if (log < 60) {
+      print("br_chacha_advance" + suffix,
+            bench(
+                [&chacha_context, delta]() {
+                  br_chacha_seed(&chacha_context, 1234);
+                  for (size_t j = 0; j < jumps; j++) {
+                    br_chacha_advance(&chacha_context, delta);
+                  }
+                },
+                min_repeat, min_time_ns, max_repeat));
+    }
+    if (log <= 12) {
+      print("br_lehmer_next loop" + suffix,
+            bench(
+                [&lehmer_context, delta]() {
+                  for (size_t j = 0; j < jumps; j++) {
+                    for (uint64_t i = 0; i < delta; i++) {
+                      br_lehmer_next(&lehmer_context);
+                    }
+                  }
+                },
+                min_repeat, min_time_ns, max_repeat));
+    }
+  }
+  br_lehmer_t lehmer_child;
+  print("br_lehmer_split",
+        bench(
+            [&lehmer_context, &lehmer_child]() {
+              for (size_t j = 0; j < jumps; j++) {
+                br_lehmer_split(&lehmer_context, &lehmer_child);
+              }
+            },
+            min_repeat, min_time_ns, max_repeat));
+  br_pcg_t pcg_child;
+  print("br_pcg_split",
+        bench(
+            [&pcg_context, &pcg_child]() {
+              for (size_t j = 0; j < jumps; j++) {
+                br_pcg_split(&pcg_context, &pcg_child);
+              }
+            },
+            min_repeat, min_time_ns, max_repeat));
+}
+
 int main(int argc, char **argv) {
   seed(1234);
   bool include_cpp = false;
@@ -335,15 +1041,61 @@ int main(int argc, char **argv) {
     if (std::string(argv[1]) == "--cpp") {
       include_cpp = true;
     }
+    // --parallel [k]: scaling of the parallel shuffles, 2^k (default 2^27)
+    // elements
+    if (std::string(argv[1]) == "--parallel") {
+      int log = argc > 2 ? std::atoi(argv[2]) : 27;
+      bench_parallel(size_t(1) << log);
+      return EXIT_SUCCESS;
+    }
+    // --advance: cost of jumping ahead and splitting the generators
+    if (std::string(argv[1]) == "--advance") {
+      bench_advance();
+      return EXIT_SUCCESS;
+    }
+    // --records [k]: records of 4 to 256 bytes, arrays of 2^10 to 2^k
+    // (default 2^22) records
+    if (std::string(argv[1]) == "--records") {
+      int max_log = argc > 2 ? std::atoi(argv[2]) : 22;
+      for (int i = 10; i <= max_log; i += 4) {
+        bench_records(size_t(1) << i);
+        std::cout << std::endl;
+      }
+      return EXIT_SUCCESS;
+    }
+    // --sample [k]: k out of 2^k (default 2^24) values without replacement
+    if (std::string(argv[1]) == "--sample") {
+      int log = argc > 2 ? std::atoi(argv[2]) : 24;
+      bench_sample(size_t(1) << log);
+      return EXIT_SUCCESS;
+    }
+    // --resample [k]: bootstraps of 2^4 to 2^k (default 2^20) values
+    if (std::string(argv[1]) == "--resample") {
+      int max_log = argc > 2 ? std::atoi(argv[2]) : 20;
+      for (int i = 4; i <= max_log; i += 4) {
+        bench_resample(size_t(1) << i);
+        std::cout << std::endl;
+      }
+      return EXIT_SUCCESS;
+    }
+    // --large [k]: arrays of 2^20 to 2^k (default 2^32) elements
+    if (std::string(argv[1]) == "--large") {
+      int max_log = argc > 2 ? std::atoi(argv[2]) : 32;
+      for (int i = 20; i <= max_log; i++) {
+        bench_large(size_t(1) << i);
+        std::cout << std::endl;
+      }
+      return EXIT_SUCCESS;
+    }
   }
   if (!include_cpp) {
     std::cout << "Running C benchmarks. Use --cpp for C++ benchmarks."
               << std::endl;
   }
 
-  // We want to make sure we extend the range far enough to see regressions
-  // for large arrays, if any.
-  for (size_t i = 1 << 6; i <= 1 << 20; i <<= 1) {
+  // We start with tiny arrays (see shuffle_small) and we want to make sure we
+  // extend the range far enough to see regressions for large arrays, if any.
+  for (size_t i = 1 << 3; i <= 1 << 20; i <<= 1) {
     bench(i, include_cpp);
     std::cout << std::endl;
   }
@@ -1,7 +1,18 @@
 #ifndef BENCHMARKS_GENERATORS_H
 #define BENCHMARKS_GENERATORS_H
+#include <cstdint>
 #include <random>
 
+// Output `index` of splitmix64 started at `seed`, as splitmix64_stateless_offset
+// in src/splitmix64.h: the generators below are seeded as their C versions in
+// src/, and give the same streams.
+inline uint64_t splitmix64_at(uint64_t seed, uint64_t index) {
+  uint64_t z = seed + (index + 1) * UINT64_C(0x9E3779B97F4A7C15);
+  z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+  return z ^ (z >> 31);
+}
+
 class lehmer64 {
 public:
   using result_type = uint64_t;
@@ -21,13 +32,166 @@ public:
     return (uint64_t)(m_state >> 64);
   }
 
+  // Same as calling operator() n times, in O(log n) time: the multiplier is
+  // raised to the power n by squaring.
   void discard(unsigned long long n) {
-    for (unsigned long long i = 0; i < n; ++i)
-      operator()();
+    __uint128_t acc_mult = 1;
+    __uint128_t cur_mult = UINT64_C(0xda942042e4dd58b5);
+    for (; n > 0; n >>= 1) {
+      if (n & 1) {
+        acc_mult *= cur_mult;
+      }
+      cur_mult *= cur_mult;
+    }
+    m_state *= acc_mult;
+  }
+
+  // Returns a generator producing the next split_stride (about 1.2 * 2^63)
+  // outputs of this one, and skips them: the streams of a generator and of
+  // its children never overlap. The stride is odd, states 2^k steps apart
+  // would share their low k bits.
+  static constexpr unsigned long long split_stride = 0x9E3779B97F4A7C15ULL;
+  lehmer64 split() {
+    lehmer64 child(*this);
+    discard(split_stride);
+    return child;
   }
 
 private:
   __uint128_t m_state;
 };
 
-#endif
\ No newline at end of file
+// xoshiro256++, see src/xoshiro256pp.h
+class xoshiro256pp {
+public:
+  using result_type = uint64_t;
+  static constexpr result_type(min)() { return 0; }
+  static constexpr result_type(max)() { return UINT64_MAX; }
+
+  xoshiro256pp(uint64_t seed = 1234) {
+    for (uint64_t i = 0; i < 4; i++) {
+      m_s[i] = splitmix64_at(seed, i);
+    }
+  }
+
+  // Starts from the given state, which must not be all zero.
+  explicit xoshiro256pp(const uint64_t (&state)[4]) {
+    for (uint64_t i = 0; i < 4; i++) {
+      m_s[i] = state[i];
+    }
+  }
+
+  result_type operator()() {
+    const uint64_t result = rotl(m_s[0] + m_s[3], 23) + m_s[0];
+    const uint64_t t = m_s[1] << 17;
+    m_s[2] ^= m_s[0];
+    m_s[3] ^= m_s[1];
+    m_s[1] ^= m_s[2];
+    m_s[0] ^= m_s[3];
+    m_s[2] ^= t;
+    m_s[3] = rotl(m_s[3], 45);
+    return result;
+  }
+
+private:
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+  uint64_t m_s[4];
+};
+
+// wyrand, see src/wyrand.h
+class wyrand {
+public:
+  using result_type = uint64_t;
+  static constexpr result_type(min)() { return 0; }
+  static constexpr result_type(max)() { return UINT64_MAX; }
+
+  wyrand(uint64_t seed = 1234) : m_state(splitmix64_at(seed, 0)) {}
+
+  result_type operator()() {
+    m_state += UINT64_C(0xa0761d6478bd642f);
+    __uint128_t t =
+        (__uint128_t)m_state * (m_state ^ UINT64_C(0xe7037ed1a0b428db));
+    return (uint64_t)(t >> 64) ^ (uint64_t)t;
+  }
+
+private:
+  uint64_t m_state;
+};
+
+// SFC64, see src/sfc64.h
+class sfc64 {
+public:
+  using result_type = uint64_t;
+  static constexpr result_type(min)() { return 0; }
+  static constexpr result_type(max)() { return UINT64_MAX; }
+
+  sfc64(uint64_t seed = 1234)
+      : m_a(splitmix64_at(seed, 0)), m_b(splitmix64_at(seed, 1)),
+        m_c(splitmix64_at(seed, 2)), m_counter(1) {
+    for (int i = 0; i < 12; i++) {
+      (*this)();
+    }
+  }
+
+  result_type operator()() {
+    uint64_t tmp = m_a + m_b + m_counter++;
+    m_a = m_b ^ (m_b >> 11);
+    m_b = m_c + (m_c << 3);
+    m_c = ((m_c << 24) | (m_c >> 40)) + tmp;
+    return tmp;
+  }
+
+private:
+  uint64_t m_a, m_b, m_c, m_counter;
+};
+
+// RomuDuoJr, see src/romu.h
+class romu_duo_jr {
+public:
+  using result_type = uint64_t;
+  static constexpr result_type(min)() { return 0; }
+  static constexpr result_type(max)() { return UINT64_MAX; }
+
+  romu_duo_jr(uint64_t seed = 1234)
+      : m_x(splitmix64_at(seed, 0)), m_y(splitmix64_at(seed, 1)) {}
+
+  result_type operator()() {
+    uint64_t xp = m_x;
+    m_x = UINT64_C(15241094284759029579) * m_y;
+    m_y = m_y - xp;
+    m_y = (m_y << 27) | (m_y >> 37);
+    return xp;
+  }
+
+private:
+  uint64_t m_x, m_y;
+};
+
+// PCG32 (XSH RR 64/32), from pcg-cpp by Melissa O'Neill: a generator of
+// 32-bit words, for the 32-bit paths of the templates.
+class pcg32 {
+public:
+  using result_type = uint32_t;
+  static constexpr result_type(min)() { return 0; }
+  static constexpr result_type(max)() { return UINT32_MAX; }
+
+  pcg32(uint64_t seed = 1234) : m_state(0) {
+    (*this)();
+    m_state += splitmix64_at(seed, 0);
+    (*this)();
+  }
+
+  result_type operator()() {
+    uint64_t old = m_state;
+    m_state = old * UINT64_C(6364136223846793005) + m_inc;
+    uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+    uint32_t rot = uint32_t(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+  }
+
+private:
+  static constexpr uint64_t m_inc = UINT64_C(1442695040888963407);
+  uint64_t m_state;
+};
+
+#endif
@@ -53,7 +53,23 @@ named_function func[] = {
     {"shuffle_chacha", shuffle_chacha},
     {"naive_shuffle_chacha_2", naive_shuffle_chacha_2},
     {"shuffle_chacha_2", shuffle_chacha_2},
-    {"shuffle_chacha_23456", shuffle_chacha_23456}};
+    {"shuffle_chacha_23456", shuffle_chacha_23456},
+    {"shuffle_xoshiro256pp", shuffle_xoshiro256pp},
+    {"shuffle_xoshiro256pp_2", shuffle_xoshiro256pp_2},
+    {"shuffle_xoshiro256pp_23456", shuffle_xoshiro256pp_23456},
+    {"shuffle_wyrand", shuffle_wyrand},
+    {"shuffle_wyrand_2", shuffle_wyrand_2},
+    {"shuffle_wyrand_23456", shuffle_wyrand_23456},
+    {"shuffle_sfc64", shuffle_sfc64},
+    {"shuffle_sfc64_2", shuffle_sfc64_2},
+    {"shuffle_sfc64_23456", shuffle_sfc64_23456},
+    {"shuffle_romu", shuffle_romu},
+    {"shuffle_romu_2", shuffle_romu_2},
+    {"shuffle_romu_23456", shuffle_romu_23456},
+    {"shuffle_philox_23456", shuffle_philox_23456},
+    {"shuffle_aes_23456", shuffle_aes_23456},
+    {"shuffle_lehmer_23456_4x", shuffle_lehmer_23456_4x},
+    {"shuffle_lehmer_23456_8x", shuffle_lehmer_23456_8x}};
 
 using cpp_shuffle_function = void (*)(std::vector<uint64_t>::iterator,
                                       std::vector<uint64_t>::iterator,
@@ -6,25 +6,121 @@
 #define PARTIAL_SHUFFLE_INL_H
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "small_dice_schedule.h"
 
 namespace batched_random {
 
+// True when g() returns uniformly random 64-bit (resp. 32-bit) words. Note
+// that the result_type of std::mt19937 is 64 bits wide on most 64-bit
+// systems, while its values only have 32 bits.
+template <class URBG>
+inline constexpr bool is_word64_generator =
+    URBG::min() == 0 && URBG::max() == UINT64_MAX;
+template <class URBG>
+inline constexpr bool is_word32_generator =
+    URBG::min() == 0 && URBG::max() == UINT32_MAX;
+
+// A generator of uniformly random 64-bit words built from a generator g of
+// uniformly random integers in [g.min(), g.max()], such as std::mt19937 or
+// std::minstd_rand. Every call to g gives `bits` random bits: when the range
+// of g is not a power of two, its values at or above the largest multiple of
+// 2^bits are rejected, bits being picked to need the fewest calls to g per
+// word on average (three calls for std::minstd_rand, two for std::mt19937).
+template <class URBG> class word64_adapter {
+public:
+  using result_type = uint64_t;
+  static constexpr result_type(min)() { return 0; }
+  static constexpr result_type(max)() { return UINT64_MAX; }
+
+  explicit word64_adapter(URBG &g) : g_(g) {}
+
+  result_type operator()() {
+    uint64_t word = draw();
+    if constexpr (calls > 1) {
+      for (int i = 1; i < calls; i++) {
+        word = (word << bits) | draw();
+      }
+    }
+    return word;
+  }
+
+private:
+  static constexpr uint64_t span = uint64_t(URBG::max() - URBG::min());
+  static_assert(span > 0, "the generator must have at least two values");
+
+  // The number of bits per call minimizing ceil(64 / bits) calls per word,
+  // divided by the probability of accepting a value.
+  static constexpr int pick_bits() {
+    if (span == UINT64_MAX) {
+      return 64;
+    }
+    int best = 1;
+    double best_calls = 1e300;
+    for (int b = 1; b < 64 && (uint64_t(1) << b) <= span + 1; b++) {
+      uint64_t kept = ((span + 1) >> b) << b;
+      double cost = double((64 + b - 1) / b) * double(span + 1) / double(kept);
+      if (cost < best_calls) {
+        best_calls = cost;
+        best = b;
+      }
+    }
+    return best;
+  }
+  static constexpr int bits = pick_bits();
+  static constexpr int calls = (64 + bits - 1) / bits;
+  // values at or above `accepted` are rejected, none if it is 0
+  static constexpr uint64_t accepted =
+      bits == 64 || ((span + 1) >> bits) << bits == span + 1
+          ? 0
+          : ((span + 1) >> bits) << bits;
+
+  uint64_t draw() {
+    uint64_t v = uint64_t(g_() - URBG::min());
+    if constexpr (accepted != 0) {
+      while (v >= accepted) {
+        v = uint64_t(g_() - URBG::min());
+      }
+    }
+    if constexpr (bits == 64) {
+      return v;
+    } else {
+      return v & ((uint64_t(1) << bits) - 1);
+    }
+  }
+
+  URBG &g_;
+};
+
+// Returns a uniformly random 64-bit word from g: the templates accept any
+// uniform random bit generator, those that do not produce 64-bit words being
+// wrapped in a word64_adapter.
+template <class URBG> inline uint64_t next_word64(URBG &g) {
+  if constexpr (is_word64_generator<URBG>) {
+    return uint64_t(g());
+  } else {
+    return word64_adapter<URBG>(g)();
+  }
+}
+
 // Performs k steps of a Fisher-Yates shuffle on n elements, in the array
 // `storage`.
 //
 // Preconditions:
 //   n >= k >= 1
 //   bound >= n*(n-1)*...*(n-(k-1)), which must not overflow
-//   rng() produces uniformly random 64-bit values
+//   g is a uniform random bit generator (see next_word64)
 //
 // The return value is usable as `bound` for smaller batches of size k.
 template <class RandomIt, class URBG>
 inline uint64_t partial_shuffle_64b(RandomIt storage, uint64_t n, uint64_t k,
                                     uint64_t bound, URBG &g) {
-  static_assert(std::is_same<typename URBG::result_type, uint64_t>::value, "result_type must be uint64_t");
   __uint128_t x;
-  uint64_t r = g();
+  uint64_t r = next_word64(g);
   uint64_t indexes[7]; // We know that k <= 7
 
   for (uint64_t i = 0; i < k; i++) {
@@ -41,7 +137,7 @@ inline uint64_t partial_shuffle_64b(RandomIt storage, uint64_t n, uint64_t k,
     uint64_t t = -bound % bound;
 
     while (r < t) {
-      r = g();
+      r = next_word64(g);
       for (uint64_t i = 0; i < k; i++) {
         x = (__uint128_t)(n - i) * (__uint128_t)r;
         r = (uint64_t)x;
@@ -56,6 +152,394 @@ inline uint64_t partial_shuffle_64b(RandomIt storage, uint64_t n, uint64_t k,
   return bound;
 }
 
+// Same as partial_shuffle_64b, with the dice rolled from one 32-bit word: a
+// generator of 32-bit words pays one call per batch.
+//
+// Preconditions:
+//   n >= k >= 1, k <= 7
+//   bound >= n*(n-1)*...*(n-(k-1)), which must fit in 32 bits
+//   g() produces uniformly random 32-bit values (is_word32_generator)
+template <class RandomIt, class URBG>
+inline uint32_t partial_shuffle_32b(RandomIt storage, uint32_t n, uint32_t k,
+                                    uint32_t bound, URBG &g) {
+  uint64_t x;
+  uint32_t r = uint32_t(g());
+  uint32_t indexes[7]; // We know that k <= 7
+
+  for (uint32_t i = 0; i < k; i++) {
+    x = uint64_t(n - i) * r;
+    r = uint32_t(x);
+    indexes[i] = uint32_t(x >> 32);
+  }
+
+  if (r < bound) {
+    bound = n;
+    for (uint32_t i = 1; i < k; i++) {
+      bound *= n - i;
+    }
+    uint32_t t = -bound % bound;
+
+    while (r < t) {
+      r = uint32_t(g());
+      for (uint32_t i = 0; i < k; i++) {
+        x = uint64_t(n - i) * r;
+        r = uint32_t(x);
+        indexes[i] = uint32_t(x >> 32);
+      }
+    }
+  }
+  for (uint32_t i = 0; i < k; i++) {
+    std::iter_swap(storage + (n - i - 1), storage + indexes[i]);
+  }
+
+  return bound;
+}
+
+// Same as partial_shuffle_64b, but with the exact rejection threshold t
+// precomputed by the caller: there is no division.
+//
+// Preconditions:
+//   n >= k >= 1, k <= 7
+//   t == -(n*(n-1)*...*(n-(k-1))) % (n*(n-1)*...*(n-(k-1))), the product
+//   must not overflow
+//   g is a uniform random bit generator (see next_word64)
+template <class RandomIt, class URBG>
+inline void partial_shuffle_64b_exact(RandomIt storage, uint64_t n, uint64_t k,
+                                      uint64_t t, URBG &g) {
+  __uint128_t x;
+  uint64_t r = next_word64(g);
+  uint64_t indexes[7]; // We know that k <= 7
+
+  for (uint64_t i = 0; i < k; i++) {
+    x = (__uint128_t)(n - i) * (__uint128_t)r;
+    r = (uint64_t)x;
+    indexes[i] = (uint64_t)(x >> 64);
+  }
+  while (r < t) {
+    r = next_word64(g);
+    for (uint64_t i = 0; i < k; i++) {
+      x = (__uint128_t)(n - i) * (__uint128_t)r;
+      r = (uint64_t)x;
+      indexes[i] = (uint64_t)(x >> 64);
+    }
+  }
+  for (uint64_t i = 0; i < k; i++) {
+    std::iter_swap(storage + n - i - 1, storage + indexes[i]);
+  }
+}
+
+// Compile-time schedule of shuffle_23456 for a fixed size N <= 2^14: the
+// j-th batch rolls dice of sizes n, n-1, ..., n-(k-1) from one 64-bit word,
+// with the exact rejection threshold `threshold`.
+struct fixed_shuffle_batch {
+  uint64_t n;
+  uint64_t k;
+  uint64_t threshold;
+};
+
+// Number of dice in the batch that starts at size n (see shuffle_23456).
+constexpr uint64_t fixed_shuffle_batch_size(uint64_t n) {
+  return n > 1 << 19 ? 2 : n > 1 << 14 ? 3 : n > 1 << 11 ? 4
+       : n > 1 << 9  ? 5 : n > 6       ? 6 : n - 1;
+}
+
+constexpr uint64_t fixed_shuffle_batch_count(uint64_t n) {
+  uint64_t count = 0;
+  for (; n > 1; n -= fixed_shuffle_batch_size(n)) {
+    count++;
+  }
+  return count;
+}
+
+template <uint64_t N>
+constexpr std::array<fixed_shuffle_batch, fixed_shuffle_batch_count(N)>
+make_fixed_shuffle_schedule() {
+  std::array<fixed_shuffle_batch, fixed_shuffle_batch_count(N)> batches{};
+  uint64_t n = N;
+  for (auto &batch : batches) {
+    uint64_t k = fixed_shuffle_batch_size(n);
+    uint64_t product = n;
+    for (uint64_t i = 1; i < k; i++) {
+      product *= n - i;
+    }
+    batch = {n, k, -product % product};
+    n -= k;
+  }
+  return batches;
+}
+
+template <uint64_t N>
+inline constexpr auto fixed_shuffle_schedule = make_fixed_shuffle_schedule<N>();
+
+// Rolls and applies the j-th batch of the schedule for N: n, k and the
+// threshold are compile-time constants.
+template <uint64_t N, size_t j, class RandomIt, class URBG>
+inline void fixed_shuffle_step(RandomIt storage, URBG &g) {
+  constexpr fixed_shuffle_batch batch = fixed_shuffle_schedule<N>[j];
+  partial_shuffle_64b_exact(storage, batch.n, batch.k, batch.threshold, g);
+}
+
+template <uint64_t N, class RandomIt, class URBG, size_t... j>
+inline void fixed_shuffle_unrolled(RandomIt storage, URBG &g,
+                                   std::index_sequence<j...>) {
+  (void)storage; // unused when N < 2
+  (void)g;
+  (fixed_shuffle_step<N, j>(storage, g), ...);
+}
+
+// Multiplies the 128-bit value r by m: the upper 64 bits of the 192-bit
+// product are returned and the lower 128 bits are written back to r.
+inline uint64_t mul_128b(__uint128_t &r, uint64_t m) {
+  __uint128_t lo = (__uint128_t)(uint64_t)r * m;
+  __uint128_t hi = (__uint128_t)(uint64_t)(r >> 64) * m + (lo >> 64);
+  r = (hi << 64) | (uint64_t)lo;
+  return (uint64_t)(hi >> 64);
+}
+
+// Draws 128 random bits from two 64-bit words of g.
+template <class URBG> inline __uint128_t random_128b(URBG &g) {
+  __uint128_t hi = next_word64(g);
+  return (hi << 64) | next_word64(g);
+}
+
+// Performs k steps of a Fisher-Yates shuffle on n elements, in the array
+// `storage`, rolling the dice from 128 random bits (two 64-bit words of g).
+//
+// Preconditions:
+//   n >= k >= 1, k <= 4
+//   bound >= n*(n-1)*...*(n-(k-1)), which must fit in 128 bits
+//   g is a uniform random bit generator (see next_word64)
+//
+// The return value is usable as `bound` for smaller batches of size k.
+template <class RandomIt, class URBG>
+inline __uint128_t partial_shuffle_128b(RandomIt storage, uint64_t n,
+                                        uint64_t k, __uint128_t bound,
+                                        URBG &g) {
+  __uint128_t r = random_128b(g);
+  uint64_t indexes[4]; // We know that k <= 4
+
+  for (uint64_t i = 0; i < k; i++) {
+    indexes[i] = mul_128b(r, n - i);
+  }
+
+  if (r < bound) {
+    bound = n;
+    for (uint64_t i = 1; i < k; i++) {
+      bound *= n - i;
+    }
+    __uint128_t t = -bound % bound;
+
+    while (r < t) {
+      r = random_128b(g);
+      for (uint64_t i = 0; i < k; i++) {
+        indexes[i] = mul_128b(r, n - i);
+      }
+    }
+  }
+  for (uint64_t i = 0; i < k; i++) {
+    std::iter_swap(storage + n - i - 1, storage + indexes[i]);
+  }
+
+  return bound;
+}
+
+// Same as partial_shuffle_64b, but the dice are written to `result` instead
+// of being applied to an array: result[i] is an (n-i) sided die roll.
+//
+// Preconditions:
+//   n - 1 fits in Index and the preconditions of partial_shuffle_64b
+template <class Index, class URBG>
+inline uint64_t partial_shuffle_dice(uint64_t n, uint64_t k, uint64_t bound,
+                                     URBG &g, Index *result) {
+  __uint128_t x;
+  uint64_t r = next_word64(g);
+
+  for (uint64_t i = 0; i < k; i++) {
+    x = (__uint128_t)(n - i) * (__uint128_t)r;
+    r = (uint64_t)x;
+    result[i] = (Index)(x >> 64);
+  }
+
+  if (r < bound) {
+    bound = n;
+    for (uint64_t i = 1; i < k; i++) {
+      bound *= n - i;
+    }
+    uint64_t t = -bound % bound;
+
+    while (r < t) {
+      r = next_word64(g);
+      for (uint64_t i = 0; i < k; i++) {
+        x = (__uint128_t)(n - i) * (__uint128_t)r;
+        r = (uint64_t)x;
+        result[i] = (Index)(x >> 64);
+      }
+    }
+  }
+
+  return bound;
+}
+
+// Rolls a batch of fair dice with increasing sizes m, m+1, ..., m+(k-1), as
+// in the inside-out Fisher-Yates shuffle: result[i] is an (m+i) sided die
+// roll. The product of a batch does not bound the next, larger one, so that
+// bound is a fixed bound for a whole range of sizes.
+//
+// Preconditions:
+//   m >= 1, and m+(k-1) - 1, the largest roll, fits in Index
+//   bound >= m*(m+1)*...*(m+(k-1)), which must not overflow
+template <class Index, class URBG>
+inline void increasing_dice(uint64_t m, uint64_t k, uint64_t bound, URBG &g,
+                            Index *result) {
+  __uint128_t x;
+  uint64_t r = next_word64(g);
+
+  for (uint64_t i = 0; i < k; i++) {
+    x = (__uint128_t)(m + i) * (__uint128_t)r;
+    r = (uint64_t)x;
+    result[i] = (Index)(x >> 64);
+  }
+
+  if (r < bound) {
+    uint64_t product = m;
+    for (uint64_t i = 1; i < k; i++) {
+      product *= m + i;
+    }
+    uint64_t t = -product % product;
+    while (r < t) {
+      r = next_word64(g);
+      for (uint64_t i = 0; i < k; i++) {
+        x = (__uint128_t)(m + i) * (__uint128_t)r;
+        r = (uint64_t)x;
+        result[i] = (Index)(x >> 64);
+      }
+    }
+  }
+}
+
+// Rolls the dice of random_permutation for the sizes m, m+1, ..., n, one
+// whole batch at a time, until at least `count` dice are rolled or the size
+// n is reached: dice[j] is an (m+j) sided die roll. A batch has as many dice
+// as shuffle_23456 rolls for its largest size. Returns the number of dice,
+// which is at most count + 5.
+//
+// Preconditions:
+//   1 <= m <= n <= 2^30, count >= 1
+template <class URBG>
+inline uint64_t roll_increasing_dice_32b(uint64_t m, uint64_t n,
+                                         uint64_t count, URBG &g,
+                                         uint32_t *dice) {
+  constexpr uint64_t bound[7] = {
+      0, 720, (uint64_t)1 << 60, (uint64_t)1 << 57, (uint64_t)1 << 56,
+      (uint64_t)1 << 55, (uint64_t)1 << 54};
+  uint64_t rolled = 0;
+  while (rolled < count && m <= n) {
+    uint64_t k = m + 5 <= 1 << 9  ? 6
+               : m + 4 <= 1 << 11 ? 5
+               : m + 3 <= 1 << 14 ? 4
+               : m + 2 <= 1 << 19 ? 3
+                                  : 2;
+    k = std::min(k, n - m + 1);
+    increasing_dice(m, k, bound[k], g, dice + rolled);
+    rolled += k;
+    m += k;
+  }
+  return rolled;
+}
+
+// Rolls the dice of shuffle_23456 for the sizes n, n-1, ..., one whole batch
+// at a time, until at least `count` dice are rolled or the shuffle is
+// complete: dice[j] is an (n-j) sided die roll. Returns the number of dice,
+// which is at most count + 5.
+//
+// Preconditions:
+//   n <= 2^30, count >= 1
+template <class URBG>
+inline uint64_t roll_dice_23456_32b(uint64_t n, uint64_t count, URBG &g,
+                                    uint32_t *dice) {
+  // Initial bound of the batches of k dice, for k = 1, ..., 6.
+  constexpr uint64_t initial_bound[7] = {
+      0, 720, (uint64_t)1 << 60, (uint64_t)1 << 57, (uint64_t)1 << 56,
+      (uint64_t)1 << 55, (uint64_t)1 << 54};
+  uint64_t rolled = 0;
+  uint64_t k = 0;
+  uint64_t bound = 0;
+  while (rolled < count && n > 1) {
+    uint64_t next_k = n > 1 << 19 ? 2
+                    : n > 1 << 14 ? 3
+                    : n > 1 << 11 ? 4
+                    : n > 1 << 9  ? 5
+                    : n > 6       ? 6
+                                  : n - 1;
+    if (next_k != k) {
+      k = next_k;
+      bound = initial_bound[k];
+    }
+    bound = partial_shuffle_dice(n, k, bound, g, dice + rolled);
+    rolled += k;
+    n -= k;
+  }
+  return rolled;
+}
+
+// Rolls the five dice of a lane from the 16 random bits r, with the sizes
+// above n replaced by 1, following the schedule of small_dice_schedule.h.
+// Returns the leftover bits.
+inline uint16_t small_lane_roll_16b(uint16_t r, uint32_t lane, uint16_t n,
+                                    uint16_t *dice) {
+  for (uint32_t s = 0; s < 5; s++) {
+    uint16_t size = small_lane_sizes[s][lane];
+    size = size > n ? 1 : size;
+    uint32_t x = uint32_t(size) * r;
+    dice[s * 32 + lane] = uint16_t(x >> 16);
+    r = uint16_t(x);
+  }
+  return r;
+}
+
+// Fisher-Yates shuffle of n <= 64 elements with 16-bit dice, as
+// shuffle_batch_small in C: one 64-bit word from g per four lanes, the dice
+// of the lanes below the head lane in two passes (the first two dice of
+// every lane, then the others), the head lane, and then the few rejected
+// lanes again one at a time.
+//
+// Preconditions:
+//   2 <= n <= 64
+template <class RandomIt, class URBG>
+inline void small_shuffle_16b(RandomIt storage, uint64_t n, URBG &g) {
+  const small_dice_head head = small_dice_heads[n];
+  const uint32_t deep =
+      head.lane < SMALL_DEEP_LANES ? head.lane : SMALL_DEEP_LANES;
+  uint16_t r[32];
+  uint16_t dice[5 * 32];
+  for (uint32_t w = 0; w <= head.lane / 4u; w++) {
+    uint64_t bits = next_word64(g);
+    for (uint32_t j = 0; j < 4; j++) {
+      r[4 * w + j] = uint16_t(bits >> (16 * j));
+    }
+  }
+  for (uint32_t s = 0; s < 5; s++) {
+    uint32_t lanes = s < 2 ? head.lane : deep;
+    for (uint32_t lane = 0; lane < lanes; lane++) {
+      uint32_t x = uint32_t(small_lane_sizes[s][lane]) * r[lane];
+      dice[s * 32 + lane] = uint16_t(x >> 16);
+      r[lane] = uint16_t(x);
+    }
+  }
+  r[head.lane] = small_lane_roll_16b(r[head.lane], head.lane, uint16_t(n), dice);
+  for (uint32_t lane = 0; lane <= head.lane; lane++) {
+    uint16_t t =
+        lane < head.lane ? small_lane_thresholds[lane] : head.threshold;
+    while (r[lane] < t) {
+      r[lane] = small_lane_roll_16b(uint16_t(next_word64(g)), lane,
+                                    uint16_t(n), dice);
+    }
+  }
+  for (uint64_t size = n; size > 1; size--) {
+    std::iter_swap(storage + (size - 1), storage + dice[small_dice_slot[size]]);
+  }
+}
+
 } // namespace batched_random
 
 #endif // TEMPLATE_SHUFFLE_H
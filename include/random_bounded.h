@@ -4,11 +4,101 @@
  */
 #ifndef BATCHED_RANDOM_H
 #define BATCHED_RANDOM_H
+#include <stddef.h>
 #include <stdint.h>
 
 // call this one before calling random_bounded and other shuffling functions.
 void seed(uint64_t s);
 
+// The functions without a context (shuffle_lehmer, shuffle_pcg, ...) use
+// global engines, seeded by seed(): they must not be called from several
+// threads at once. Building the library with -DBATCHED_RANDOM_THREAD_LOCAL
+// gives every thread its own engines instead (every thread has to call
+// seed()). Either way, every engine sits on its own cache line.
+#ifdef BATCHED_RANDOM_THREAD_LOCAL
+#define BR_DEFAULT_ENGINE _Thread_local __attribute__((aligned(64)))
+#else
+#define BR_DEFAULT_ENGINE __attribute__((aligned(64)))
+#endif
+
+// Engine contexts for the reentrant functions (shuffle_lehmer_r, ...): they
+// can be used from any number of threads, one context per thread. The
+// seeding functions give the same streams as seed() for the global engines.
+typedef struct __attribute__((aligned(64))) {
+  __uint128_t state;
+} br_lehmer_t;
+typedef struct __attribute__((aligned(64))) {
+  __uint128_t state;
+  __uint128_t inc;
+} br_pcg_t;
+// ChaCha generates BR_CHACHA_BLOCKS blocks of 16 words at once (with AVX2 or
+// SSE2 when available) into a buffer.
+#define BR_CHACHA_BLOCKS 8
+struct __attribute__((aligned(64))) br_chacha {
+  uint32_t state[16];
+  uint32_t buffer[16 * BR_CHACHA_BLOCKS];
+  size_t rounds;
+  size_t word_index;
+};
+typedef struct br_chacha br_chacha_t;
+
+void br_lehmer_seed(br_lehmer_t *ctx, uint64_t s);
+void br_pcg_seed(br_pcg_t *ctx, uint64_t s);
+void br_chacha_seed(br_chacha_t *ctx, uint64_t s);
+// br_chacha_seed gives ChaCha8 with a zero key and stream s. These take the
+// number of rounds (8, 12 or 20) and, for br_chacha_seed_key, the 256-bit key.
+void br_chacha_seed_rounds(br_chacha_t *ctx, uint64_t s, size_t rounds);
+void br_chacha_seed_key(br_chacha_t *ctx, const uint32_t key[8],
+                        uint64_t stream, size_t rounds);
+uint64_t br_lehmer_next(br_lehmer_t *ctx);
+uint64_t br_pcg_next(br_pcg_t *ctx);
+uint64_t br_chacha_next(br_chacha_t *ctx);
+
+// Moves a context delta outputs ahead, as if br_X_next had been called delta
+// times: in O(log delta) time for Lehmer and PCG, in constant time for ChaCha.
+void br_lehmer_advance(br_lehmer_t *ctx, uint64_t delta);
+void br_pcg_advance(br_pcg_t *ctx, uint64_t delta);
+void br_chacha_advance(br_chacha_t *ctx, uint64_t delta);
+
+// Splits a stream: child gets the next BR_SPLIT_STRIDE outputs of ctx
+// (BR_CHACHA_SPLIT_STRIDE for ChaCha) and ctx moves past them, so that the
+// streams of ctx and of all its children never overlap. A context can be
+// split about 2^62 times (Lehmer), 2^64 times (PCG) or 2^27 times (ChaCha).
+// The stride of the LCGs is odd: modulo 2^128, states 2^k steps apart share
+// their low k bits, which correlates their outputs.
+#define BR_SPLIT_STRIDE UINT64_C(0x9E3779B97F4A7C15)
+#define BR_CHACHA_SPLIT_STRIDE (UINT64_C(1) << 40)
+void br_lehmer_split(br_lehmer_t *ctx, br_lehmer_t *child);
+void br_pcg_split(br_pcg_t *ctx, br_pcg_t *child);
+void br_chacha_split(br_chacha_t *ctx, br_chacha_t *child);
+
+// Counter-based engines: word i of a stream is a function of the key and of
+// i alone, so that any thread can compute any word without generating the
+// words before it. Philox4x64-10 takes a 128-bit key, AES-128 in counter mode
+// (with AES-NI when available) a 128-bit key and a 64-bit nonce; the seeding
+// functions draw the keys from s with splitmix64, and a zero nonce.
+typedef struct __attribute__((aligned(64))) {
+  uint64_t key[2];
+} br_philox_t;
+typedef struct __attribute__((aligned(64))) {
+  uint8_t round_keys[11 * 16];
+  uint64_t nonce;
+} br_aes_t;
+
+void br_philox_seed(br_philox_t *ctx, uint64_t s);
+void br_philox_seed_key(br_philox_t *ctx, const uint64_t key[2]);
+void br_aes_seed(br_aes_t *ctx, uint64_t s);
+void br_aes_seed_key(br_aes_t *ctx, const uint8_t key[16], uint64_t nonce);
+// Writes the words [counter_start, counter_start + count) of the stream to
+// out, several blocks at a time.
+void br_philox_fill(const br_philox_t *ctx, uint64_t counter_start,
+                    uint64_t *out, uint64_t count);
+void br_aes_fill(const br_aes_t *ctx, uint64_t counter_start, uint64_t *out,
+                 uint64_t count);
+// same as br_aes_fill, but never uses AES-NI: the words are the same
+void br_aes_fill_portable(const br_aes_t *ctx, uint64_t counter_start,
+                          uint64_t *out, uint64_t count);
+
 
 // shuffle the storage array, you need to provide your own random number
 // generator (rng)
@@ -17,18 +107,151 @@ void shuffle_batch_2(uint64_t *storage, uint64_t size, uint64_t (*rng)(void));
 void shuffle_batch_23456(uint64_t *storage, uint64_t size,
                          uint64_t (*rng)(void));
 void naive_shuffle_batch_2(uint64_t *storage, uint64_t size, uint64_t (*rng)(void));
+// same as shuffle_batch_23456, but rolls four (or eight) batches of dice at
+// once using AVX2 (or AVX-512) when the processor supports it
+void shuffle_batch_23456_4x(uint64_t *storage, uint64_t size,
+                            uint64_t (*rng)(void));
+void shuffle_batch_23456_8x(uint64_t *storage, uint64_t size,
+                            uint64_t (*rng)(void));
+// same as shuffle_batch_23456_4x, but batch j draws from lane j of rng4,
+// which has four independent generators so that their multiplications can
+// overlap: rng4(out, lanes) writes the next word of every lane j whose bit
+// is set in `lanes` to out[j]. rng rolls the remaining dice
+void shuffle_batch_23456_lanes(uint64_t *storage, uint64_t size,
+                               uint64_t (*rng)(void),
+                               void (*rng4)(uint64_t *, uint64_t));
+// shuffles for small arrays: up to 64 elements, the dice are rolled from
+// 16-bit lanes; larger arrays fall back on shuffle_batch_23456. It is slower
+// than shuffle_batch_23456 at every size up to 64 that we measured (by 2x to
+// 3x with lehmer64): use shuffle_batch_23456 instead.
+void shuffle_batch_small(uint64_t *storage, uint64_t size,
+                         uint64_t (*rng)(void));
+// same as shuffle_batch_23456, but arrays of up to 2^40 elements (instead of
+// 2^30) get batches of dice: three dice from 128 random bits (two rng calls)
+void shuffle_batch_128(uint64_t *storage, uint64_t size,
+                       uint64_t (*rng)(void));
+
+// A shuffle plan caches the batch schedule of shuffle_batch_23456 for one
+// array size, with the exact rejection threshold of every batch, so that
+// arrays of that size can be shuffled repeatedly without any division.
+// It takes 8 bytes per batch of dice (at most 4 bytes per element).
+typedef struct {
+  uint64_t size;
+  uint64_t batches[5]; // number of batches of 2, 3, 4, 5 and 6 dice
+  uint64_t *thresholds; // one per batch, including the last one
+} shuffle_plan;
+// returns 0 on success and -1 if memory could not be allocated
+int shuffle_plan_init(shuffle_plan *plan, uint64_t size);
+void shuffle_plan_free(shuffle_plan *plan);
+// shuffles plan->size elements, with the same result as shuffle_batch_23456
+void shuffle_with_plan(uint64_t *storage, const shuffle_plan *plan,
+                       uint64_t (*rng)(void));
+
+// same as shuffle_batch_23456, but the dice for `block` positions are rolled
+// into a buffer of 32-bit indexes before the swaps are applied; block is
+// clamped to [1, SHUFFLE_MAX_BLOCK]
+#define SHUFFLE_MAX_BLOCK 8192
+#define SHUFFLE_DEFAULT_BLOCK 1024
+void shuffle_batch_23456_blocked(uint64_t *storage, uint64_t size,
+                                 uint64_t block, uint64_t (*rng)(void));
+// same as shuffle_batch_23456, but the dice are rolled `distance` positions
+// ahead of the swaps, and the slots they target are prefetched; distance is
+// at most SHUFFLE_MAX_PREFETCH, SHUFFLE_AUTO_PREFETCH picks it from the size
+// (no prefetching for arrays that fit in cache)
+#define SHUFFLE_MAX_PREFETCH 128
+#define SHUFFLE_PREFETCH_RING 256 // power of two > SHUFFLE_MAX_PREFETCH + 6
+#define SHUFFLE_DEFAULT_PREFETCH 64
+#define SHUFFLE_AUTO_PREFETCH UINT64_MAX
+void shuffle_batch_23456_prefetch(uint64_t *storage, uint64_t size,
+                                  uint64_t distance, uint64_t (*rng)(void));
+// uniform shuffle that first scatters the elements into random buckets that
+// fit in cache, then shuffles every bucket with shuffle_batch_23456; it uses
+// 9 bytes of temporary memory per element. The shuffle_*_bucketed functions
+// only use it above SHUFFLE_BUCKETED_MIN elements (1 GB), and
+// shuffle_batch_23456_prefetch, which is faster, below that size.
+#define SHUFFLE_BUCKETED_MIN ((uint64_t)1 << 27)
+void shuffle_batch_bucketed(uint64_t *storage, uint64_t size,
+                            uint64_t (*rng)(void));
+
+// uniform shuffle using nthreads threads (0: one per processor, at most
+// SHUFFLE_MAX_THREADS), with lehmer64 generators derived from seed; it uses
+// 9 bytes of temporary memory per element. The elements are scattered into
+// random buckets in parallel, then the buckets are shuffled in parallel.
+// The permutation depends on the scheduling of the threads. Arrays of up to
+// SHUFFLE_PARALLEL_MIN elements are shuffled by the calling thread.
+#define SHUFFLE_MAX_THREADS 256
+#define SHUFFLE_PARALLEL_MIN ((uint64_t)1 << 18)
+void shuffle_parallel(uint64_t *storage, uint64_t size, uint64_t nthreads,
+                      uint64_t seed);
+// same as shuffle_parallel, but the permutation only depends on seed, not on
+// the number of threads or their scheduling: the array is split into
+// SHUFFLE_DETERMINISTIC_CHUNKS chunks and 256 buckets, each with its own
+// substream of seed (if the temporary memory cannot be allocated, the array
+// is shuffled sequentially, with a different result)
+#define SHUFFLE_DETERMINISTIC_CHUNKS 64
+void shuffle_parallel_deterministic(uint64_t *storage, uint64_t size,
+                                    uint64_t nthreads, uint64_t seed);
 
 // shuffle with lehmer rng
 void shuffle_lehmer(uint64_t *storage, uint64_t size);
 void shuffle_lehmer_2(uint64_t *storage, uint64_t size);
 void shuffle_lehmer_23456(uint64_t *storage, uint64_t size);
 void naive_shuffle_lehmer_2(uint64_t *storage, uint64_t size);
+void shuffle_lehmer_23456_4x(uint64_t *storage, uint64_t size);
+void shuffle_lehmer_23456_8x(uint64_t *storage, uint64_t size);
+void shuffle_lehmer_23456_lanes(uint64_t *storage, uint64_t size);
+void shuffle_lehmer_128(uint64_t *storage, uint64_t size);
+void shuffle_lehmer_plan(uint64_t *storage, const shuffle_plan *plan);
+void shuffle_lehmer_23456_blocked(uint64_t *storage, uint64_t size);
+void shuffle_lehmer_prefetch(uint64_t *storage, uint64_t size);
+void shuffle_lehmer_bucketed(uint64_t *storage, uint64_t size);
+// same, with a context
+void shuffle_lehmer_r(br_lehmer_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_lehmer_2_r(br_lehmer_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_lehmer_23456_r(br_lehmer_t *ctx, uint64_t *storage, uint64_t size);
+void naive_shuffle_lehmer_2_r(br_lehmer_t *ctx, uint64_t *storage,
+                              uint64_t size);
+void shuffle_lehmer_23456_4x_r(br_lehmer_t *ctx, uint64_t *storage,
+                               uint64_t size);
+void shuffle_lehmer_23456_8x_r(br_lehmer_t *ctx, uint64_t *storage,
+                               uint64_t size);
+void shuffle_lehmer_128_r(br_lehmer_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_lehmer_plan_r(br_lehmer_t *ctx, uint64_t *storage,
+                           const shuffle_plan *plan);
+void shuffle_lehmer_23456_blocked_r(br_lehmer_t *ctx, uint64_t *storage,
+                                    uint64_t size);
+void shuffle_lehmer_prefetch_r(br_lehmer_t *ctx, uint64_t *storage,
+                               uint64_t size);
+void shuffle_lehmer_bucketed_r(br_lehmer_t *ctx, uint64_t *storage,
+                               uint64_t size);
 
 // shuffle with pcg64 rng
 void shuffle_pcg(uint64_t *storage, uint64_t size);
 void shuffle_pcg_2(uint64_t *storage, uint64_t size);
 void shuffle_pcg_23456(uint64_t *storage, uint64_t size);
 void naive_shuffle_pcg_2(uint64_t *storage, uint64_t size);
+void shuffle_pcg_23456_4x(uint64_t *storage, uint64_t size);
+void shuffle_pcg_23456_8x(uint64_t *storage, uint64_t size);
+void shuffle_pcg_23456_lanes(uint64_t *storage, uint64_t size);
+void shuffle_pcg_128(uint64_t *storage, uint64_t size);
+void shuffle_pcg_plan(uint64_t *storage, const shuffle_plan *plan);
+void shuffle_pcg_23456_blocked(uint64_t *storage, uint64_t size);
+void shuffle_pcg_prefetch(uint64_t *storage, uint64_t size);
+void shuffle_pcg_bucketed(uint64_t *storage, uint64_t size);
+// same, with a context
+void shuffle_pcg_r(br_pcg_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_pcg_2_r(br_pcg_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_pcg_23456_r(br_pcg_t *ctx, uint64_t *storage, uint64_t size);
+void naive_shuffle_pcg_2_r(br_pcg_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_pcg_23456_4x_r(br_pcg_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_pcg_23456_8x_r(br_pcg_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_pcg_128_r(br_pcg_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_pcg_plan_r(br_pcg_t *ctx, uint64_t *storage,
+                        const shuffle_plan *plan);
+void shuffle_pcg_23456_blocked_r(br_pcg_t *ctx, uint64_t *storage,
+                                 uint64_t size);
+void shuffle_pcg_prefetch_r(br_pcg_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_pcg_bucketed_r(br_pcg_t *ctx, uint64_t *storage, uint64_t size);
 
 
 // shuffle with chacha rng
@@ -36,9 +259,327 @@ void shuffle_chacha(uint64_t *storage, uint64_t size);
 void shuffle_chacha_2(uint64_t *storage, uint64_t size);
 void shuffle_chacha_23456(uint64_t *storage, uint64_t size);
 void naive_shuffle_chacha_2(uint64_t *storage, uint64_t size);
+void shuffle_chacha_23456_4x(uint64_t *storage, uint64_t size);
+void shuffle_chacha_23456_8x(uint64_t *storage, uint64_t size);
+void shuffle_chacha_128(uint64_t *storage, uint64_t size);
+void shuffle_chacha_plan(uint64_t *storage, const shuffle_plan *plan);
+void shuffle_chacha_23456_blocked(uint64_t *storage, uint64_t size);
+void shuffle_chacha_prefetch(uint64_t *storage, uint64_t size);
+void shuffle_chacha_bucketed(uint64_t *storage, uint64_t size);
+// same, with a context
+void shuffle_chacha_r(br_chacha_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_chacha_2_r(br_chacha_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_chacha_23456_r(br_chacha_t *ctx, uint64_t *storage, uint64_t size);
+void naive_shuffle_chacha_2_r(br_chacha_t *ctx, uint64_t *storage,
+                              uint64_t size);
+void shuffle_chacha_23456_4x_r(br_chacha_t *ctx, uint64_t *storage,
+                               uint64_t size);
+void shuffle_chacha_23456_8x_r(br_chacha_t *ctx, uint64_t *storage,
+                               uint64_t size);
+void shuffle_chacha_128_r(br_chacha_t *ctx, uint64_t *storage, uint64_t size);
+void shuffle_chacha_plan_r(br_chacha_t *ctx, uint64_t *storage,
+                           const shuffle_plan *plan);
+void shuffle_chacha_23456_blocked_r(br_chacha_t *ctx, uint64_t *storage,
+                                    uint64_t size);
+void shuffle_chacha_prefetch_r(br_chacha_t *ctx, uint64_t *storage,
+                               uint64_t size);
+void shuffle_chacha_bucketed_r(br_chacha_t *ctx, uint64_t *storage,
+                               uint64_t size);
+
+// shuffle with the counter-based engines, following the schedule of
+// shuffle_batch_23456: batch b of dice draws word b of the stream, and a
+// rejected word is replaced by word b + 2^48, then b + 2 * 2^48, and so on.
+// Up to 2^48 elements: larger sizes, or a batch rejected 2^16 times in a row
+// (which does not happen in practice), would reuse words, and the program
+// exits instead.
+//
+// Step s (0 <= s < size - 1) of the shuffle swaps storage[size - 1 - s] with
+// storage[die], the die being in [0, size - s). dice_X_23456_r writes the
+// dice of the steps [first, first + count) to dice: they only depend on the
+// key, so that any number of threads can compute them, in any order.
+//
+// The shuffles with a context move it to a new stream afterwards (key[1] + 1
+// for Philox, nonce + 1 for AES) so that every call gives a new permutation.
+void shuffle_philox_23456(uint64_t *storage, uint64_t size);
+void shuffle_aes_23456(uint64_t *storage, uint64_t size);
+void shuffle_philox_23456_r(br_philox_t *ctx, uint64_t *storage,
+                            uint64_t size);
+void shuffle_aes_23456_r(br_aes_t *ctx, uint64_t *storage, uint64_t size);
+void dice_philox_23456_r(const br_philox_t *ctx, uint64_t size,
+                         uint64_t first, uint64_t count, uint64_t *dice);
+void dice_aes_23456_r(const br_aes_t *ctx, uint64_t size, uint64_t first,
+                      uint64_t count, uint64_t *dice);
+
+// shuffle with xoshiro256++ rng
+void shuffle_xoshiro256pp(uint64_t *storage, uint64_t size);
+void shuffle_xoshiro256pp_2(uint64_t *storage, uint64_t size);
+void shuffle_xoshiro256pp_23456(uint64_t *storage, uint64_t size);
+
+// shuffle with wyrand rng
+void shuffle_wyrand(uint64_t *storage, uint64_t size);
+void shuffle_wyrand_2(uint64_t *storage, uint64_t size);
+void shuffle_wyrand_23456(uint64_t *storage, uint64_t size);
 
+// shuffle with SFC64 rng
+void shuffle_sfc64(uint64_t *storage, uint64_t size);
+void shuffle_sfc64_2(uint64_t *storage, uint64_t size);
+void shuffle_sfc64_23456(uint64_t *storage, uint64_t size);
+
+// shuffle with RomuDuoJr rng
+void shuffle_romu(uint64_t *storage, uint64_t size);
+void shuffle_romu_2(uint64_t *storage, uint64_t size);
+void shuffle_romu_23456(uint64_t *storage, uint64_t size);
 
 // returns a random number in the range [0, range)
+uint64_t random_bounded(uint64_t range, uint64_t (*rng)(void));
 uint64_t random_bounded_lehmer(uint64_t range);
+uint64_t random_bounded_lehmer_r(br_lehmer_t *ctx, uint64_t range);
+uint64_t random_bounded_pcg_r(br_pcg_t *ctx, uint64_t range);
+uint64_t random_bounded_chacha_r(br_chacha_t *ctx, uint64_t range);
+
+// fills out[0..count) with independent random numbers in the range [0, range),
+// you need to provide your own random number generator (rng). Several numbers
+// are extracted from each 64-bit random word when range is small.
+void random_bounded_fill(uint64_t range, uint64_t *out, uint64_t count,
+                         uint64_t (*rng)(void));
+void random_bounded_fill_lehmer(uint64_t range, uint64_t *out, uint64_t count);
+void random_bounded_fill_pcg(uint64_t range, uint64_t *out, uint64_t count);
+void random_bounded_fill_chacha(uint64_t range, uint64_t *out, uint64_t count);
+void random_bounded_fill_lehmer_r(br_lehmer_t *ctx, uint64_t range,
+                                  uint64_t *out, uint64_t count);
+void random_bounded_fill_pcg_r(br_pcg_t *ctx, uint64_t range, uint64_t *out,
+                               uint64_t count);
+void random_bounded_fill_chacha_r(br_chacha_t *ctx, uint64_t range,
+                                  uint64_t *out, uint64_t count);
+
+// fills out[0..count) with independent random numbers, out[i] being in the
+// range [0, ranges[i]). Small ranges are grouped so that several numbers are
+// extracted from each 64-bit random word.
+void random_bounded_ranges(const uint64_t *ranges, uint64_t *out,
+                           uint64_t count, uint64_t (*rng)(void));
+void random_bounded_ranges_lehmer(const uint64_t *ranges, uint64_t *out,
+                                  uint64_t count);
+void random_bounded_ranges_pcg(const uint64_t *ranges, uint64_t *out,
+                               uint64_t count);
+void random_bounded_ranges_chacha(const uint64_t *ranges, uint64_t *out,
+                                  uint64_t count);
+void random_bounded_ranges_lehmer_r(br_lehmer_t *ctx, const uint64_t *ranges,
+                                    uint64_t *out, uint64_t count);
+void random_bounded_ranges_pcg_r(br_pcg_t *ctx, const uint64_t *ranges,
+                                 uint64_t *out, uint64_t count);
+void random_bounded_ranges_chacha_r(br_chacha_t *ctx, const uint64_t *ranges,
+                                    uint64_t *out, uint64_t count);
+
+// shuffles the count elements of elem_size bytes at base (IDs, key/value
+// pairs, records, ...) in place, with the dice of shuffle_batch_23456: the
+// elements end up in the same order as the words shuffled by
+// shuffle_batch_23456 from the same random words. Elements of 1, 2, 4, 8, 16,
+// 32 and 64 bytes are swapped by dedicated kernels, with AVX2 moves from 32
+// bytes when available. When the array does not fit in cache, the records
+// the swaps are about to touch are prefetched.
+void shuffle_bytes(void *base, size_t count, size_t elem_size,
+                   uint64_t (*rng)(void));
+void shuffle_bytes_lehmer(void *base, size_t count, size_t elem_size);
+void shuffle_bytes_pcg(void *base, size_t count, size_t elem_size);
+void shuffle_bytes_chacha(void *base, size_t count, size_t elem_size);
+void shuffle_bytes_lehmer_r(br_lehmer_t *ctx, void *base, size_t count,
+                            size_t elem_size);
+void shuffle_bytes_pcg_r(br_pcg_t *ctx, void *base, size_t count,
+                         size_t elem_size);
+void shuffle_bytes_chacha_r(br_chacha_t *ctx, void *base, size_t count,
+                            size_t elem_size);
+
+// shuffles ncols arrays of count elements (the columns of a table: features,
+// labels, weights, ...) with one and the same permutation: arrays[c] holds
+// elements of elem_sizes[c] bytes. Every batch of dice is rolled once, and
+// its swaps are applied to all the arrays; each array ends up as it would
+// with shuffle_bytes from the same random words.
+void shuffle_soa(void *const *arrays, const size_t *elem_sizes, size_t ncols,
+                 size_t count, uint64_t (*rng)(void));
+void shuffle_soa_lehmer(void *const *arrays, const size_t *elem_sizes,
+                        size_t ncols, size_t count);
+void shuffle_soa_pcg(void *const *arrays, const size_t *elem_sizes,
+                     size_t ncols, size_t count);
+void shuffle_soa_chacha(void *const *arrays, const size_t *elem_sizes,
+                        size_t ncols, size_t count);
+void shuffle_soa_lehmer_r(br_lehmer_t *ctx, void *const *arrays,
+                          const size_t *elem_sizes, size_t ncols,
+                          size_t count);
+void shuffle_soa_pcg_r(br_pcg_t *ctx, void *const *arrays,
+                       const size_t *elem_sizes, size_t ncols, size_t count);
+void shuffle_soa_chacha_r(br_chacha_t *ctx, void *const *arrays,
+                          const size_t *elem_sizes, size_t ncols,
+                          size_t count);
+
+// writes a uniformly random permutation of 0, 1, ..., n-1 to out, with the
+// inside-out Fisher-Yates shuffle: there is no need to fill out with 0, 1,
+// ..., n-1 first. The dice for the increasing sizes 1, 2, ..., n are rolled in
+// batches of up to 6 from a single random word, as in shuffle_batch_23456.
+// random_permutation_u32 requires n <= 2^32.
+void random_permutation_u32(uint32_t *out, uint64_t n, uint64_t (*rng)(void));
+void random_permutation_u64(uint64_t *out, uint64_t n, uint64_t (*rng)(void));
+void random_permutation_u32_lehmer(uint32_t *out, uint64_t n);
+void random_permutation_u32_pcg(uint32_t *out, uint64_t n);
+void random_permutation_u32_chacha(uint32_t *out, uint64_t n);
+void random_permutation_u64_lehmer(uint64_t *out, uint64_t n);
+void random_permutation_u64_pcg(uint64_t *out, uint64_t n);
+void random_permutation_u64_chacha(uint64_t *out, uint64_t n);
+void random_permutation_u32_lehmer_r(br_lehmer_t *ctx, uint32_t *out,
+                                     uint64_t n);
+void random_permutation_u32_pcg_r(br_pcg_t *ctx, uint32_t *out, uint64_t n);
+void random_permutation_u32_chacha_r(br_chacha_t *ctx, uint32_t *out,
+                                     uint64_t n);
+void random_permutation_u64_lehmer_r(br_lehmer_t *ctx, uint64_t *out,
+                                     uint64_t n);
+void random_permutation_u64_pcg_r(br_pcg_t *ctx, uint64_t *out, uint64_t n);
+void random_permutation_u64_chacha_r(br_chacha_t *ctx, uint64_t *out,
+                                     uint64_t n);
+
+// runs the first k steps of the Fisher-Yates shuffle of the n elements of
+// storage, with the batches of shuffle_batch_23456: storage[n-k], ...,
+// storage[n-1] are then a uniformly random sample of k elements, in random
+// order (storage[n-1] is picked first). With k >= n - 1, it is
+// shuffle_batch_23456.
+void partial_shuffle(uint64_t *storage, uint64_t n, uint64_t k,
+                     uint64_t (*rng)(void));
+void partial_shuffle_lehmer(uint64_t *storage, uint64_t n, uint64_t k);
+void partial_shuffle_pcg(uint64_t *storage, uint64_t n, uint64_t k);
+void partial_shuffle_chacha(uint64_t *storage, uint64_t n, uint64_t k);
+void partial_shuffle_lehmer_r(br_lehmer_t *ctx, uint64_t *storage, uint64_t n,
+                              uint64_t k);
+void partial_shuffle_pcg_r(br_pcg_t *ctx, uint64_t *storage, uint64_t n,
+                           uint64_t k);
+void partial_shuffle_chacha_r(br_chacha_t *ctx, uint64_t *storage, uint64_t n,
+                              uint64_t k);
+
+// writes to out k distinct values drawn uniformly out of 0, 1, ..., n-1 (all
+// of them if k > n), in random order: out[j] is storage[n-j-1] after
+// partial_shuffle(storage, n, k, rng) on storage = 0, 1, ..., n-1. When k is
+// much smaller than n, the shuffled array is a hash table of the k or so
+// positions the steps touch, so that it takes O(k) time and memory. Returns
+// 0 on success and -1 if memory could not be allocated.
+int sample_without_replacement(uint64_t n, uint64_t k, uint64_t *out,
+                               uint64_t (*rng)(void));
+int sample_without_replacement_lehmer(uint64_t n, uint64_t k, uint64_t *out);
+int sample_without_replacement_pcg(uint64_t n, uint64_t k, uint64_t *out);
+int sample_without_replacement_chacha(uint64_t n, uint64_t k, uint64_t *out);
+int sample_without_replacement_lehmer_r(br_lehmer_t *ctx, uint64_t n,
+                                        uint64_t k, uint64_t *out);
+int sample_without_replacement_pcg_r(br_pcg_t *ctx, uint64_t n, uint64_t k,
+                                     uint64_t *out);
+int sample_without_replacement_chacha_r(br_chacha_t *ctx, uint64_t n,
+                                        uint64_t k, uint64_t *out);
+
+// draws m values out of src[0..n), uniformly and independently (with
+// replacement), into dst[0..m): the bootstrap resampling of src. The indexes
+// are those of random_bounded_fill(n, indexes, m, rng), several per 64-bit
+// random word when n is small. resample_bytes does the same with elements of
+// elem_size bytes. n must be at least 1 unless m is 0.
+void resample_with_replacement(const uint64_t *src, uint64_t n, uint64_t *dst,
+                               uint64_t m, uint64_t (*rng)(void));
+void resample_with_replacement_lehmer(const uint64_t *src, uint64_t n,
+                                      uint64_t *dst, uint64_t m);
+void resample_with_replacement_pcg(const uint64_t *src, uint64_t n,
+                                   uint64_t *dst, uint64_t m);
+void resample_with_replacement_chacha(const uint64_t *src, uint64_t n,
+                                      uint64_t *dst, uint64_t m);
+void resample_with_replacement_lehmer_r(br_lehmer_t *ctx, const uint64_t *src,
+                                        uint64_t n, uint64_t *dst, uint64_t m);
+void resample_with_replacement_pcg_r(br_pcg_t *ctx, const uint64_t *src,
+                                     uint64_t n, uint64_t *dst, uint64_t m);
+void resample_with_replacement_chacha_r(br_chacha_t *ctx, const uint64_t *src,
+                                        uint64_t n, uint64_t *dst, uint64_t m);
+void resample_bytes(const void *src, uint64_t n, size_t elem_size, void *dst,
+                    uint64_t m, uint64_t (*rng)(void));
+void resample_bytes_lehmer(const void *src, uint64_t n, size_t elem_size,
+                           void *dst, uint64_t m);
+void resample_bytes_pcg(const void *src, uint64_t n, size_t elem_size,
+                        void *dst, uint64_t m);
+void resample_bytes_chacha(const void *src, uint64_t n, size_t elem_size,
+                           void *dst, uint64_t m);
+void resample_bytes_lehmer_r(br_lehmer_t *ctx, const void *src, uint64_t n,
+                             size_t elem_size, void *dst, uint64_t m);
+void resample_bytes_pcg_r(br_pcg_t *ctx, const void *src, uint64_t n,
+                          size_t elem_size, void *dst, uint64_t m);
+void resample_bytes_chacha_r(br_chacha_t *ctx, const void *src, uint64_t n,
+                             size_t elem_size, void *dst, uint64_t m);
+
+// sets counts[i], for i in [0, n), to the number of times the element i is
+// drawn by the same resampling: the weights of one bootstrap replicate,
+// without copying the elements.
+void resample_counts(uint64_t n, uint64_t m, uint64_t *counts,
+                     uint64_t (*rng)(void));
+void resample_counts_lehmer(uint64_t n, uint64_t m, uint64_t *counts);
+void resample_counts_pcg(uint64_t n, uint64_t m, uint64_t *counts);
+void resample_counts_chacha(uint64_t n, uint64_t m, uint64_t *counts);
+void resample_counts_lehmer_r(br_lehmer_t *ctx, uint64_t n, uint64_t m,
+                              uint64_t *counts);
+void resample_counts_pcg_r(br_pcg_t *ctx, uint64_t n, uint64_t m,
+                           uint64_t *counts);
+void resample_counts_chacha_r(br_chacha_t *ctx, uint64_t n, uint64_t m,
+                              uint64_t *counts);
+
+// In C, the br_ macros pick the function with a context matching the type of
+// ctx: br_shuffle(ctx, storage, size) is shuffle_lehmer_23456_r(ctx, storage,
+// size) when ctx is a br_lehmer_t *, shuffle_pcg_23456_r when it is a
+// br_pcg_t *, and so on. The generator is inlined in these functions; see
+// random_bounded_inline.h to get the same for your own generator.
+#ifndef __cplusplus
+#define br_shuffle(ctx, storage, size)                                         \
+  _Generic((ctx),                                                              \
+      br_lehmer_t *: shuffle_lehmer_23456_r,                                   \
+      br_pcg_t *: shuffle_pcg_23456_r,                                         \
+      br_chacha_t *: shuffle_chacha_23456_r,                                   \
+      br_philox_t *: shuffle_philox_23456_r,                                   \
+      br_aes_t *: shuffle_aes_23456_r)(ctx, storage, size)
+#define br_random_bounded(ctx, range)                                          \
+  _Generic((ctx),                                                              \
+      br_lehmer_t *: random_bounded_lehmer_r,                                  \
+      br_pcg_t *: random_bounded_pcg_r,                                        \
+      br_chacha_t *: random_bounded_chacha_r)(ctx, range)
+#define br_random_bounded_fill(ctx, range, out, count)                         \
+  _Generic((ctx),                                                              \
+      br_lehmer_t *: random_bounded_fill_lehmer_r,                             \
+      br_pcg_t *: random_bounded_fill_pcg_r,                                   \
+      br_chacha_t *: random_bounded_fill_chacha_r)(ctx, range, out, count)
+#define br_random_bounded_ranges(ctx, ranges, out, count)                      \
+  _Generic((ctx),                                                              \
+      br_lehmer_t *: random_bounded_ranges_lehmer_r,                           \
+      br_pcg_t *: random_bounded_ranges_pcg_r,                                 \
+      br_chacha_t *: random_bounded_ranges_chacha_r)(ctx, ranges, out, count)
+#endif
+
+// Rolls fair dice with sizes n, n-1, ..., n - (4*k - 1) in four interleaved
+// batches: result[i] is an (n-i) sided die roll. See
+// src/batch_shuffle_dice.c for the preconditions. The lanes_4x versions draw
+// the word of batch j from lane j of rng4, as in shuffle_batch_23456_lanes.
+// The _simd versions use AVX2 (4x)
+// or AVX-512 (8x) when available and produce exactly the same results as the
+// portable versions.
+uint64_t partial_shuffle_dice_64b_interleaved_4x(uint64_t n, uint64_t k,
+                                                 uint64_t bound,
+                                                 uint64_t (*rng)(void),
+                                                 uint64_t *result);
+uint64_t partial_shuffle_dice_64b_interleaved_4x_simd(uint64_t n, uint64_t k,
+                                                      uint64_t bound,
+                                                      uint64_t (*rng)(void),
+                                                      uint64_t *result);
+uint64_t partial_shuffle_dice_64b_lanes_4x(uint64_t n, uint64_t k,
+                                           uint64_t bound,
+                                           void (*rng4)(uint64_t *, uint64_t),
+                                           uint64_t *result);
+uint64_t partial_shuffle_dice_64b_lanes_4x_simd(uint64_t n, uint64_t k,
+                                                uint64_t bound,
+                                                void (*rng4)(uint64_t *,
+                                                             uint64_t),
+                                                uint64_t *result);
+uint64_t partial_shuffle_dice_64b_interleaved_8x(uint64_t n, uint64_t k,
+                                                 uint64_t bound,
+                                                 uint64_t (*rng)(void),
+                                                 uint64_t *result);
+uint64_t partial_shuffle_dice_64b_interleaved_8x_simd(uint64_t n, uint64_t k,
+                                                      uint64_t bound,
+                                                      uint64_t (*rng)(void),
+                                                      uint64_t *result);
 
 #endif // BATCHED_RANDOM_H
@@ -0,0 +1,261 @@
+/***
+ * Header-only versions of the C shuffles and bounded functions, for any
+ * generator. The functions taking `uint64_t (*rng)(void)` call the generator
+ * through a pointer for every die, unless the compiler happens to specialize
+ * them; the functions defined here are static inline and call the generator
+ * directly, so that it can be inlined.
+ *
+ * Given a context type and a function `uint64_t next(context_type *)`,
+ *
+ *   BR_DEFINE_INLINE(my, my_rng_t, my_rng_next)
+ *
+ * defines
+ *
+ *   uint64_t my_random_bounded(my_rng_t *ctx, uint64_t range);
+ *   void my_random_bounded_fill(my_rng_t *ctx, uint64_t range, uint64_t *out,
+ *                               uint64_t count);
+ *   void my_random_bounded_ranges(my_rng_t *ctx, const uint64_t *ranges,
+ *                                 uint64_t *out, uint64_t count);
+ *   void my_shuffle(my_rng_t *ctx, uint64_t *storage, uint64_t size);
+ *   void my_shuffle_2(my_rng_t *ctx, uint64_t *storage, uint64_t size);
+ *   void my_shuffle_23456(my_rng_t *ctx, uint64_t *storage, uint64_t size);
+ *
+ * which give the same results as random_bounded, random_bounded_fill,
+ * random_bounded_ranges, shuffle, shuffle_batch_2 and shuffle_batch_23456
+ * with a generator producing the same words: the library defines those
+ * function pointer versions with this macro, the context being the function
+ * itself.
+ */
+#ifndef BATCHED_RANDOM_INLINE_H
+#define BATCHED_RANDOM_INLINE_H
+#include <stdint.h>
+
+// Returns how many dice of size `range` we should roll per 64-bit word (at
+// most max_k). Among the batch sizes k whose product range^k fits in 64 bits,
+// we pick the one that produces the most accepted dice per word, that is, the
+// one maximizing k * (2^64 - t) where t = -(range^k) % (range^k).
+//
+// The threshold for the chosen k is written to `threshold`.
+static inline uint64_t random_bounded_batch_size(uint64_t range, uint64_t max_k,
+                                                 uint64_t *threshold) {
+  uint64_t best_k = 1;
+  uint64_t best_t = -range % range;
+  __uint128_t best_yield = ((__uint128_t)1 << 64) - best_t;
+  uint64_t product = range;
+  for (uint64_t k = 2; k <= max_k; k++) {
+    if (product > UINT64_MAX / range) {
+      break;
+    }
+    product *= range;
+    uint64_t t = -product % product;
+    // k * (2^64 - t)
+    __uint128_t yield = (__uint128_t)k * (((__uint128_t)1 << 64) - t);
+    if (yield > best_yield) {
+      best_yield = yield;
+      best_k = k;
+      best_t = t;
+    }
+  }
+  *threshold = best_t;
+  return best_k;
+}
+
+// The schedule of shuffle_batch_23456: batches of k dice, for k = 2, ..., 6,
+// while the size is above br_23456_phase_end[k - 2], with the first bound
+// br_23456_phase_bound[k - 2] (a power of two above every product of k dice
+// in the phase). Up to 2^30 elements come before the first phase, one die at
+// a time, and the last batch takes the remaining dice.
+__attribute__((unused)) static const uint64_t br_23456_phase_end[5] = {
+    1 << 19, 1 << 14, 1 << 11, 1 << 9, 6};
+__attribute__((unused)) static const uint64_t br_23456_phase_bound[5] = {
+    (uint64_t)1 << 60, (uint64_t)1 << 57, (uint64_t)1 << 56, (uint64_t)1 << 55,
+    (uint64_t)1 << 54};
+
+// See src/batch_shuffle_dice.c and src/random_bounded.c for comments on the
+// algorithms.
+#define BR_DEFINE_INLINE(prefix, context_type, next)                           \
+  static inline uint64_t prefix##_random_bounded(context_type *ctx,            \
+                                                 uint64_t range) {             \
+    __uint128_t multiresult = (__uint128_t)next(ctx) * range;                  \
+    uint64_t leftover = (uint64_t)multiresult;                                 \
+    if (leftover < range) {                                                    \
+      uint64_t threshold = -range % range;                                     \
+      while (leftover < threshold) {                                           \
+        multiresult = (__uint128_t)next(ctx) * range;                          \
+        leftover = (uint64_t)multiresult;                                      \
+      }                                                                        \
+    }                                                                          \
+    return (uint64_t)(multiresult >> 64);                                      \
+  }                                                                            \
+  static inline void prefix##_random_bounded_dice_64b(                         \
+      context_type *ctx, uint64_t range, uint64_t k, uint64_t t,               \
+      uint64_t *result) {                                                      \
+    __uint128_t x;                                                             \
+    uint64_t r;                                                                \
+    do {                                                                       \
+      r = next(ctx);                                                           \
+      for (uint64_t i = 0; i < k; i++) {                                       \
+        x = (__uint128_t)range * (__uint128_t)r;                               \
+        r = (uint64_t)x;                                                       \
+        result[i] = (uint64_t)(x >> 64);                                       \
+      }                                                                        \
+    } while (r < t);                                                           \
+  }                                                                            \
+  static inline void prefix##_random_bounded_fill_batches(                     \
+      context_type *ctx, uint64_t range, uint64_t k, uint64_t t,               \
+      uint64_t *out, uint64_t count) {                                         \
+    uint64_t i = 0;                                                            \
+    for (; i + k <= count; i += k) {                                           \
+      prefix##_random_bounded_dice_64b(ctx, range, k, t, out + i);             \
+    }                                                                          \
+    if (i < count) {                                                           \
+      uint64_t tail = count - i;                                               \
+      uint64_t product = range;                                                \
+      for (uint64_t j = 1; j < tail; j++) {                                    \
+        product *= range;                                                      \
+      }                                                                        \
+      prefix##_random_bounded_dice_64b(ctx, range, tail, -product % product,   \
+                                       out + i);                               \
+    }                                                                          \
+  }                                                                            \
+  static inline void prefix##_random_bounded_fill(                             \
+      context_type *ctx, uint64_t range, uint64_t *out, uint64_t count) {      \
+    if (range == 1) {                                                          \
+      for (uint64_t i = 0; i < count; i++) {                                   \
+        out[i] = 0;                                                            \
+      }                                                                        \
+      return;                                                                  \
+    }                                                                          \
+    uint64_t t;                                                                \
+    uint64_t k = random_bounded_batch_size(range, 64, &t);                     \
+    prefix##_random_bounded_fill_batches(ctx, range, k, t, out, count);        \
+  }                                                                            \
+  static inline void prefix##_random_bounded_group_64b(                        \
+      context_type *ctx, const uint64_t *ranges, uint64_t k, uint64_t product, \
+      uint64_t *result) {                                                      \
+    __uint128_t x;                                                             \
+    uint64_t r = next(ctx);                                                    \
+    for (uint64_t i = 0; i < k; i++) {                                         \
+      x = (__uint128_t)ranges[i] * (__uint128_t)r;                             \
+      r = (uint64_t)x;                                                         \
+      result[i] = (uint64_t)(x >> 64);                                         \
+    }                                                                          \
+    if (r < product) {                                                         \
+      uint64_t t = -product % product;                                         \
+      while (r < t) {                                                          \
+        r = next(ctx);                                                         \
+        for (uint64_t i = 0; i < k; i++) {                                     \
+          x = (__uint128_t)ranges[i] * (__uint128_t)r;                         \
+          r = (uint64_t)x;                                                     \
+          result[i] = (uint64_t)(x >> 64);                                     \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+  static inline void prefix##_random_bounded_ranges(                           \
+      context_type *ctx, const uint64_t *ranges, uint64_t *out,                \
+      uint64_t count) {                                                        \
+    const uint64_t limit = (uint64_t)1 << 60;                                  \
+    uint64_t i = 0;                                                            \
+    while (i < count) {                                                        \
+      uint64_t product = ranges[i];                                            \
+      uint64_t end = i + 1;                                                    \
+      while (end < count &&                                                    \
+             (__uint128_t)product * (__uint128_t)ranges[end] <= limit) {       \
+        product *= ranges[end];                                                \
+        end++;                                                                 \
+      }                                                                        \
+      prefix##_random_bounded_group_64b(ctx, ranges + i, end - i, product,     \
+                                        out + i);                              \
+      i = end;                                                                 \
+    }                                                                          \
+  }                                                                            \
+  static inline uint64_t prefix##_partial_shuffle_64b(                         \
+      context_type *ctx, uint64_t *storage, uint64_t n, uint64_t k,            \
+      uint64_t bound) {                                                        \
+    __uint128_t x;                                                             \
+    uint64_t r = next(ctx);                                                    \
+    uint64_t indexes[7];                                                       \
+    for (uint64_t i = 0; i < k; i++) {                                         \
+      x = (__uint128_t)(n - i) * (__uint128_t)r;                               \
+      r = (uint64_t)x;                                                         \
+      indexes[i] = (uint64_t)(x >> 64);                                        \
+    }                                                                          \
+    if (r < bound) {                                                           \
+      bound = n;                                                               \
+      for (uint64_t i = 1; i < k; i++) {                                       \
+        bound *= n - i;                                                        \
+      }                                                                        \
+      uint64_t t = -bound % bound;                                             \
+      while (r < t) {                                                          \
+        r = next(ctx);                                                         \
+        for (uint64_t i = 0; i < k; i++) {                                     \
+          x = (__uint128_t)(n - i) * (__uint128_t)r;                           \
+          r = (uint64_t)x;                                                     \
+          indexes[i] = (uint64_t)(x >> 64);                                    \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+    for (uint64_t i = 0; i < k; i++) {                                         \
+      uint64_t pos1 = n - i - 1;                                               \
+      uint64_t pos2 = indexes[i];                                              \
+      uint64_t val1 = storage[pos1];                                           \
+      uint64_t val2 = storage[pos2];                                           \
+      storage[pos1] = val2;                                                    \
+      storage[pos2] = val1;                                                    \
+    }                                                                          \
+    return bound;                                                              \
+  }                                                                            \
+  static inline void prefix##_shuffle(context_type *ctx, uint64_t *storage,    \
+                                      uint64_t size) {                         \
+    for (uint64_t i = size; i > 1; i--) {                                      \
+      uint64_t nextpos = prefix##_random_bounded(ctx, i);                      \
+      uint64_t tmp = storage[i - 1];                                           \
+      uint64_t val = storage[nextpos];                                         \
+      storage[i - 1] = val;                                                    \
+      storage[nextpos] = tmp;                                                  \
+    }                                                                          \
+  }                                                                            \
+  static inline void prefix##_shuffle_2(context_type *ctx, uint64_t *storage,  \
+                                        uint64_t size) {                       \
+    uint64_t i = size;                                                         \
+    for (; i > 1 << 30; i--) {                                                 \
+      prefix##_partial_shuffle_64b(ctx, storage, i, 1, i);                     \
+    }                                                                          \
+    uint64_t bound = (uint64_t)1 << 60;                                        \
+    for (; i > 1; i -= 2) {                                                    \
+      bound = prefix##_partial_shuffle_64b(ctx, storage, i, 2, bound);         \
+    }                                                                          \
+  }                                                                            \
+  static inline void prefix##_shuffle_23456(                                   \
+      context_type *ctx, uint64_t *storage, uint64_t size) {                   \
+    uint64_t i = size;                                                         \
+    for (; i > 1 << 30; i--) {                                                 \
+      prefix##_partial_shuffle_64b(ctx, storage, i, 1, i);                     \
+    }                                                                          \
+    uint64_t bound = br_23456_phase_bound[0];                                  \
+    for (; i > br_23456_phase_end[0]; i -= 2) {                                \
+      bound = prefix##_partial_shuffle_64b(ctx, storage, i, 2, bound);         \
+    }                                                                          \
+    bound = br_23456_phase_bound[1];                                           \
+    for (; i > br_23456_phase_end[1]; i -= 3) {                                \
+      bound = prefix##_partial_shuffle_64b(ctx, storage, i, 3, bound);         \
+    }                                                                          \
+    bound = br_23456_phase_bound[2];                                           \
+    for (; i > br_23456_phase_end[2]; i -= 4) {                                \
+      bound = prefix##_partial_shuffle_64b(ctx, storage, i, 4, bound);         \
+    }                                                                          \
+    bound = br_23456_phase_bound[3];                                           \
+    for (; i > br_23456_phase_end[3]; i -= 5) {                                \
+      bound = prefix##_partial_shuffle_64b(ctx, storage, i, 5, bound);         \
+    }                                                                          \
+    bound = br_23456_phase_bound[4];                                           \
+    for (; i > br_23456_phase_end[4]; i -= 6) {                                \
+      bound = prefix##_partial_shuffle_64b(ctx, storage, i, 6, bound);         \
+    }                                                                          \
+    if (i > 1) {                                                               \
+      prefix##_partial_shuffle_64b(ctx, storage, i, i - 1, 720);               \
+    }                                                                          \
+  }
+
+#endif // BATCHED_RANDOM_INLINE_H
@@ -0,0 +1,68 @@
+#ifndef SMALL_DICE_SCHEDULE_H
+#define SMALL_DICE_SCHEDULE_H
+#include <stdint.h>
+
+// Dice schedule for shuffling up to 64 elements with 16-bit dice, shared by
+// shuffle_batch_small (src/batch_shuffle_dice.c) and batched_random::
+// shuffle_small (partial-shuffle-inl.h). tests/basic.cpp derives it again
+// from the rules below and checks these tables.
+//
+// The die sizes 2, 3, ..., 64 are split into 29 groups whose product does not
+// exceed 2^12, greedily from the top (64, 63, ...), and each group is rolled
+// from its own 16-bit lane, so that the rejection probability of a lane is
+// below 1/16. Lane 0 holds the smallest sizes: to shuffle n elements, we only
+// need the lanes up to the one that contains n, and the sizes above n in
+// that lane are replaced by 1. Lanes 0 to 4 roll up to five dice, the others
+// two; unused slots have size 1.
+//
+// small_lane_sizes[s][lane] is the size of the s-th die of the lane and
+// small_lane_thresholds[lane] = 2^16 % (product of the sizes of the lane).
+// The s-sided die ends up in dice[small_dice_slot[s]] = dice[s*32 + lane].
+// Only the first SMALL_DEEP_LANES lanes have more than two dice.
+#define SMALL_DEEP_LANES 5
+static const uint16_t small_lane_sizes[5][32] = {
+    {2, 7, 10, 13, 16, 18, 20, 22, 24, 26, 28, 30, 32, 34, 36, 38,
+     40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 60, 62, 64, 1, 1, 1},
+    {1, 6, 9, 12, 15, 17, 19, 21, 23, 25, 27, 29, 31, 33, 35, 37,
+     39, 41, 43, 45, 47, 49, 51, 53, 55, 57, 59, 61, 63, 1, 1, 1},
+    {1, 5, 8, 11, 14, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+     1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+    {1, 4, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+     1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+    {1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+     1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}
+};
+static const uint16_t small_lane_thresholds[32] = {
+    0, 16, 16, 328, 1696, 52, 176, 394, 400, 536, 520,
+    286, 64, 460, 16, 860, 16, 100, 1208, 1366, 112, 1836,
+    1888, 2572, 856, 2722, 1816, 1242, 1024, 0, 0, 0
+};
+static const uint8_t small_dice_slot[65] = {
+    0, 0, 0, 129, 97, 65, 33, 1, 66, 34, 2, 67, 35,
+    3, 68, 36, 4, 37, 5, 38, 6, 39, 7, 40, 8, 41,
+    9, 42, 10, 43, 11, 44, 12, 45, 13, 46, 14, 47, 15,
+    48, 16, 49, 17, 50, 18, 51, 19, 52, 20, 53, 21, 54,
+    22, 55, 23, 56, 24, 57, 25, 58, 26, 59, 27, 60, 28
+};
+
+// small_dice_heads[n] = {lane, threshold}: `lane` is the last lane needed to
+// shuffle n elements and `threshold` is 2^16 % (product of its sizes <= n).
+typedef struct {
+  uint8_t lane;
+  uint16_t threshold;
+} small_dice_head;
+
+static const small_dice_head small_dice_heads[65] = {
+    {0, 0}, {0, 0}, {0, 0}, {1, 1}, {1, 4}, {1, 16}, {1, 16},
+    {1, 16}, {2, 0}, {2, 16}, {2, 16}, {3, 9}, {3, 64}, {3, 328},
+    {4, 2}, {4, 16}, {4, 1696}, {5, 1}, {5, 52}, {6, 5}, {6, 176},
+    {7, 16}, {7, 394}, {8, 9}, {8, 400}, {9, 11}, {9, 536}, {10, 7},
+    {10, 520}, {11, 25}, {11, 286}, {12, 2}, {12, 64}, {13, 31}, {13, 460},
+    {14, 16}, {14, 16}, {15, 9}, {15, 860}, {16, 16}, {16, 16}, {17, 18},
+    {17, 100}, {18, 4}, {18, 1208}, {19, 16}, {19, 1366}, {20, 18}, {20, 112},
+    {21, 23}, {21, 1836}, {22, 1}, {22, 1888}, {23, 28}, {23, 2572}, {24, 31},
+    {24, 856}, {25, 43}, {25, 2722}, {26, 46}, {26, 1816}, {27, 22}, {27, 1242},
+    {28, 16}, {28, 1024}
+};
+
+#endif // SMALL_DICE_SCHEDULE_H
@@ -8,9 +8,21 @@
 #define TEMPLATE_SHUFFLE_H
  
 #include "partial-shuffle-inl.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <execution>
 #include <iterator>
+#include <memory>
+#include <ranges>
+#include <system_error>
+#include <thread>
+#include <span>
+#include <stdexcept>
+#include <utility>
 #include <concepts>
 #include <type_traits>
+#include <vector>
 
 // This code is meant to look like the C++ standard library.
 namespace batched_random {
@@ -19,21 +31,20 @@ namespace batched_random {
 template <class random_it, class URBG>
 void shuffle_2p(random_it first, random_it last, URBG&& g) {
     static_assert(std::is_same<typename std::iterator_traits<random_it>::iterator_category, std::random_access_iterator_tag>::value, "random_it must be a random access iterator");
-    static_assert(std::is_same<typename std::decay_t<URBG>::result_type, uint64_t>::value, "result_type must be uint64_t");
     
     uint64_t i = std::distance(first, last);
     
     // Phase 1: Single-element shuffles for sizes above 2^30
     for (; i > 1ULL << 30; i--) {
         __uint128_t x;
-        uint64_t r = g();
+        uint64_t r = next_word64(g);
         x = (__uint128_t)(i) * (__uint128_t)r;
         uint64_t index = (uint64_t)(x >> 64);
         uint64_t bound = i;
         [[unlikely]] if (r < bound) {
             uint64_t t = -bound % bound;
             while (r < t) {
-                r = g();
+                r = next_word64(g);
                 x = (__uint128_t)(i) * (__uint128_t)r;
                 index = (uint64_t)(x >> 64);
             }
@@ -45,7 +56,7 @@ void shuffle_2p(random_it first, random_it last, URBG&& g) {
     uint64_t bound = (uint64_t)1 << 60;
     for (; i > 1; i -= 2) {
         __uint128_t x;
-        uint64_t r = g();
+        uint64_t r = next_word64(g);
         uint64_t index0, index1;
         // Generate indices for the batch of 2
         x = (__uint128_t)(i - 0) * (__uint128_t)r;
@@ -60,7 +71,7 @@ void shuffle_2p(random_it first, random_it last, URBG&& g) {
             new_bound *= (i - 1);
             uint64_t t = -new_bound % new_bound;
             while (r < t) {
-                r = g();
+                r = next_word64(g);
                 x = (__uint128_t)(i - 0) * (__uint128_t)r;
                 r = (uint64_t)x;
                 index0 = (uint64_t)(x >> 64);
@@ -80,21 +91,20 @@ void shuffle_2p(random_it first, random_it last, URBG&& g) {
 template <class random_it, class URBG>
 void shuffle_24(random_it first, random_it last, URBG&& g) {
     static_assert(std::is_same<typename std::iterator_traits<random_it>::iterator_category, std::random_access_iterator_tag>::value, "random_it must be a random access iterator");
-    static_assert(std::is_same<typename std::decay_t<URBG>::result_type, uint64_t>::value, "result_type must be uint64_t");
     
     uint64_t i = std::distance(first, last);
 
     // Phase 1: Single-element shuffles for sizes above 2^30
     for (; i > 1ULL << 30; i--) {
         __uint128_t x;
-        uint64_t r = g();
+        uint64_t r = next_word64(g);
         x = (__uint128_t)(i) * (__uint128_t)r;
         uint64_t index = (uint64_t)(x >> 64);
         uint64_t bound = i;
         [[unlikely]] if (r < bound) {
             uint64_t t = -bound % bound;
             while (r < t) {
-                r = g();
+                r = next_word64(g);
                 x = (__uint128_t)(i) * (__uint128_t)r;
                 index = (uint64_t)(x >> 64);
             }
@@ -106,7 +116,7 @@ void shuffle_24(random_it first, random_it last, URBG&& g) {
     uint64_t bound = (uint64_t)1 << 60;
     for (; i > 1ULL << 14; i -= 2) {
         __uint128_t x;
-        uint64_t r = g();
+        uint64_t r = next_word64(g);
         uint64_t index0, index1;
         x = (__uint128_t)(i - 0) * (__uint128_t)r;
         r = (uint64_t)x;
@@ -119,7 +129,7 @@ void shuffle_24(random_it first, random_it last, URBG&& g) {
             new_bound *= (i - 1);
             uint64_t t = -new_bound % new_bound;
             while (r < t) {
-                r = g();
+                r = next_word64(g);
                 x = (__uint128_t)(i - 0) * (__uint128_t)r;
                 r = (uint64_t)x;
                 index0 = (uint64_t)(x >> 64);
@@ -137,7 +147,7 @@ void shuffle_24(random_it first, random_it last, URBG&& g) {
     bound = (uint64_t)1 << 56;
     for (; i > 4; i -= 4) {
         __uint128_t x;
-        uint64_t r = g();
+        uint64_t r = next_word64(g);
         uint64_t index0, index1, index2, index3;
         x = (__uint128_t)(i - 0) * (__uint128_t)r;
         r = (uint64_t)x;
@@ -158,7 +168,7 @@ void shuffle_24(random_it first, random_it last, URBG&& g) {
             }
             uint64_t t = -new_bound % new_bound;
             while (r < t) {
-                r = g();
+                r = next_word64(g);
                 x = (__uint128_t)(i - 0) * (__uint128_t)r;
                 r = (uint64_t)x;
                 index0 = (uint64_t)(x >> 64);
@@ -183,7 +193,7 @@ void shuffle_24(random_it first, random_it last, URBG&& g) {
     // Final cleanup: Handle remaining elements (i-1 swaps if i > 1)
     if (i > 1) {
         __uint128_t x;
-        uint64_t r = g();
+        uint64_t r = next_word64(g);
         uint64_t k = i - 1;
         uint64_t indexes[4];
         for (uint64_t j = 0; j < k; ++j) {
@@ -198,7 +208,7 @@ void shuffle_24(random_it first, random_it last, URBG&& g) {
             }
             uint64_t t = -new_bound % new_bound;
             while (r < t) {
-                r = g();
+                r = next_word64(g);
                 for (uint64_t j = 0; j < k; ++j) {
                     x = (__uint128_t)(i - j) * (__uint128_t)r;
                     r = (uint64_t)x;
@@ -230,14 +240,85 @@ extern void shuffle_2(random_it first, random_it last, URBG &&g) {
   }
 }
 
+// This is a template function that shuffles the elements in the range [first,
+// last) with a generator of uniformly random 32-bit words (is_word32_generator,
+// such as std::mt19937), picking for every size the batches that roll the
+// most dice per call to g: one die per call from 2^19 to 2^32 elements,
+// batches of 3 to 6 dice from two calls down to 2^7 elements, and then
+// batches of 4 to 6 dice from a single call.
+template <class random_it, class URBG>
+void shuffle_23456_32b(random_it first, random_it last, URBG &&g) {
+  uint64_t i = std::distance(first, last);
+  for (; i > UINT32_MAX; i--) {
+    partial_shuffle_64b(first, i, 1, i, g);
+  }
+
+  for (; i > 1 << 19; i--) {
+    partial_shuffle_32b(first, uint32_t(i), 1, uint32_t(i), g);
+  }
+
+  // Batches of 3 for sizes up to 2^19 elements
+  uint64_t bound = (uint64_t)1 << 57;
+  for (; i > 1 << 14; i -= 3) {
+    bound = partial_shuffle_64b(first, i, 3, bound, g);
+  }
+
+  // Batches of 4 for sizes up to 2^14 elements
+  bound = (uint64_t)1 << 56;
+  for (; i > 1 << 11; i -= 4) {
+    bound = partial_shuffle_64b(first, i, 4, bound, g);
+  }
+
+  // Batches of 5 for sizes up to 2^11 elements
+  bound = (uint64_t)1 << 55;
+  for (; i > 1 << 9; i -= 5) {
+    bound = partial_shuffle_64b(first, i, 5, bound, g);
+  }
+
+  // Batches of 6 for sizes up to 2^9 elements
+  bound = (uint64_t)1 << 54;
+  for (; i > 1 << 7; i -= 6) {
+    bound = partial_shuffle_64b(first, i, 6, bound, g);
+  }
+
+  // Batches of 4 from 32 bits for sizes up to 2^7 elements
+  uint32_t bound32 = uint32_t(1) << 28;
+  for (; i > 1 << 5; i -= 4) {
+    bound32 = partial_shuffle_32b(first, uint32_t(i), 4, bound32, g);
+  }
+
+  // Batches of 5 from 32 bits for sizes up to 2^5 elements
+  bound32 = uint32_t(1) << 25;
+  for (; i > 1 << 4; i -= 5) {
+    bound32 = partial_shuffle_32b(first, uint32_t(i), 5, bound32, g);
+  }
+
+  // Batches of 6 from 32 bits for sizes up to 2^4 elements
+  bound32 = uint32_t(1) << 24;
+  for (; i > 6; i -= 6) {
+    bound32 = partial_shuffle_32b(first, uint32_t(i), 6, bound32, g);
+  }
+
+  if (i > 1) {
+    partial_shuffle_32b(first, uint32_t(i), uint32_t(i - 1), 720, g);
+  }
+}
+
 // This is a template function that shuffles the elements in the range [first,
 // last)
 //
-// It is similar to std::shuffle, but it uses a different algorithm.
+// It is similar to std::shuffle, but it uses a different algorithm. Any
+// uniform random bit generator works (see next_word64); those producing
+// 32-bit words are given to shuffle_23456_32b, so that the functions said to
+// give the same result as shuffle_23456 only do with other generators.
 //
 // Performance note: This function might be slow under GCC: see shuffle_2.
 template <class random_it, class URBG>
 extern void shuffle_23456(random_it first, random_it last, URBG &&g) {
+  if constexpr (is_word32_generator<std::remove_reference_t<URBG>>) {
+    shuffle_23456_32b(first, last, g);
+    return;
+  }
   uint64_t i = std::distance(first, last);
   for (; i > 1 << 30; i--) {
     partial_shuffle_64b(first, i, 1, i, g);
@@ -282,8 +363,6 @@ extern void shuffle_23456(random_it first, random_it last, URBG &&g) {
 
 template <class random_it, class URBG>
 void shuffle_23456p(random_it first, random_it last, URBG &&g) {
-    // Ensure the random number generator produces 64-bit unsigned integers
-    static_assert(std::is_same<typename std::remove_reference<URBG>::type::result_type, uint64_t>::value, "result_type must be uint64_t");
     
     // Calculate the number of elements to shuffle
     uint64_t i = std::distance(first, last);
@@ -294,7 +373,7 @@ void shuffle_23456p(random_it first, random_it last, URBG &&g) {
             // Use 128-bit arithmetic to avoid overflow in random number scaling
             __uint128_t x;
             // Get a random 64-bit value from the generator
-            uint64_t r = gen();
+            uint64_t r = next_word64(gen);
             // Store indices for swapping (k <= 7, so fixed-size array is safe)
             uint64_t indexes[7];
             // Generate k random indices using the division method
@@ -315,7 +394,7 @@ void shuffle_23456p(random_it first, random_it last, URBG &&g) {
                 uint64_t t = -bound % bound;
                 // Regenerate random numbers until unbiased
                 while (r < t) {
-                    r = gen();
+                    r = next_word64(gen);
                     for (uint64_t j = 0; j < k; j++) {
                         x = (__uint128_t)(n - j) * (__uint128_t)r;
                         r = (uint64_t)x;
@@ -366,6 +445,643 @@ void shuffle_23456p(random_it first, random_it last, URBG &&g) {
     }
 }
 
+// This is a template function that shuffles the elements of a range whose
+// size N is known at compile time, with the same result as shuffle_23456.
+// Up to 2^14 elements, the batch schedule and the exact rejection thresholds
+// are constexpr tables: the batches are fully unrolled when there are at most
+// 32 of them (N <= 192), and read from the table otherwise. Larger ranges
+// are shuffled with shuffle_23456.
+template <uint64_t N, class random_it, class URBG>
+void shuffle_fixed(random_it first, URBG &&g) {
+  if constexpr (N > 1 << 14) {
+    shuffle_23456(first, first + N, g);
+  } else if constexpr (fixed_shuffle_batch_count(N) <= 32) {
+    fixed_shuffle_unrolled<N>(
+        first, g, std::make_index_sequence<fixed_shuffle_batch_count(N)>());
+  } else {
+    // Below 2^14 elements, the batches have 4, 5 and 6 dice, and then the
+    // last batch takes the remaining dice.
+    constexpr auto &schedule = fixed_shuffle_schedule<N>;
+    size_t j = 0;
+    for (; schedule[j].k == 4; j++) {
+      partial_shuffle_64b_exact(first, schedule[j].n, 4, schedule[j].threshold,
+                                g);
+    }
+    for (; schedule[j].k == 5; j++) {
+      partial_shuffle_64b_exact(first, schedule[j].n, 5, schedule[j].threshold,
+                                g);
+    }
+    for (; j + 1 < schedule.size(); j++) {
+      partial_shuffle_64b_exact(first, schedule[j].n, 6, schedule[j].threshold,
+                                g);
+    }
+    partial_shuffle_64b_exact(first, schedule[j].n, schedule[j].k,
+                              schedule[j].threshold, g);
+  }
+}
+
+template <class T, size_t N, class URBG>
+void shuffle(std::array<T, N> &a, URBG &&g) {
+  shuffle_fixed<N>(a.begin(), g);
+}
+
+template <class T, size_t N, class URBG>
+  requires(N != std::dynamic_extent)
+void shuffle(std::span<T, N> s, URBG &&g) {
+  shuffle_fixed<N>(s.begin(), g);
+}
+
+// A shuffle plan caches the batch schedule of shuffle_23456 for one size n,
+// with the exact rejection threshold of every batch, so that ranges of that
+// size can be shuffled repeatedly without any division. It takes 8 bytes per
+// batch of dice (at most 4 bytes per element).
+//
+// Usage:
+//   batched_random::shuffle_plan plan(v.size());
+//   plan.shuffle(v.begin(), v.end(), g); // same result as shuffle_23456
+class shuffle_plan {
+public:
+  explicit shuffle_plan(uint64_t n) : n_(n) {
+    // The sizes above 2^30 are shuffled one die at a time, without a plan.
+    uint64_t i = n > uint64_t(1) << 30 ? uint64_t(1) << 30 : n;
+    for (uint64_t k = 2; k <= 6; k++) {
+      for (; i > phase_end[k - 2]; i -= k) {
+        thresholds_.push_back(threshold(i, k));
+        batches_[k - 2]++;
+      }
+    }
+    if (i > 1) {
+      thresholds_.push_back(threshold(i, i - 1));
+    }
+  }
+
+  uint64_t size() const { return n_; }
+
+  // Shuffles [first, last), which must contain size() elements.
+  template <class random_it, class URBG>
+  void shuffle(random_it first, random_it last, URBG &&g) const {
+    uint64_t i = std::distance(first, last);
+    for (; i > 1 << 30; i--) {
+      partial_shuffle_64b(first, i, 1, i, g);
+    }
+
+    const uint64_t *t = thresholds_.data();
+    for (uint64_t j = batches_[0]; j > 0; j--, i -= 2) {
+      partial_shuffle_64b_exact(first, i, 2, *t++, g);
+    }
+    for (uint64_t j = batches_[1]; j > 0; j--, i -= 3) {
+      partial_shuffle_64b_exact(first, i, 3, *t++, g);
+    }
+    for (uint64_t j = batches_[2]; j > 0; j--, i -= 4) {
+      partial_shuffle_64b_exact(first, i, 4, *t++, g);
+    }
+    for (uint64_t j = batches_[3]; j > 0; j--, i -= 5) {
+      partial_shuffle_64b_exact(first, i, 5, *t++, g);
+    }
+    for (uint64_t j = batches_[4]; j > 0; j--, i -= 6) {
+      partial_shuffle_64b_exact(first, i, 6, *t++, g);
+    }
+
+    if (i > 1) {
+      partial_shuffle_64b_exact(first, i, i - 1, *t, g);
+    }
+  }
+
+private:
+  // Sizes at which shuffle_23456 moves from batches of k dice to batches of
+  // k+1 dice, for k = 2, ..., 6.
+  static constexpr uint64_t phase_end[5] = {1 << 19, 1 << 14, 1 << 11, 1 << 9,
+                                            6};
+
+  // Exact rejection threshold for the dice of sizes n, n-1, ..., n-(k-1).
+  static uint64_t threshold(uint64_t n, uint64_t k) {
+    uint64_t product = n;
+    for (uint64_t i = 1; i < k; i++) {
+      product *= n - i;
+    }
+    return -product % product;
+  }
+
+  uint64_t n_;
+  uint64_t batches_[5]{}; // number of batches of 2, 3, 4, 5 and 6 dice
+  std::vector<uint64_t> thresholds_;
+};
+
+// This is a template function that shuffles the elements in the range [first,
+// last). It differs from shuffle_23456 for ranges of more than 2^30 elements:
+// between 2^30 and 2^40 elements, it rolls batches of three dice from 128
+// random bits (two calls to g) instead of one die per call.
+template <class random_it, class URBG>
+void shuffle_128(random_it first, random_it last, URBG &&g) {
+  uint64_t i = std::distance(first, last);
+  for (; i > (uint64_t)1 << 40; i--) {
+    partial_shuffle_64b(first, i, 1, i, g);
+  }
+
+  // Batches of 3 for sizes up to 2^40 elements
+  __uint128_t bound = (__uint128_t)1 << 120;
+  for (; i > 1 << 30; i -= 3) {
+    bound = partial_shuffle_128b(first, i, 3, bound, g);
+  }
+
+  shuffle_23456(first, first + i, g);
+}
+
+// This is a template function that shuffles the elements in the range [first,
+// last), with the same result as shuffle_23456. The positions are processed
+// in blocks of `block` elements (clamped to [1, max_shuffle_block]): the dice
+// of a block are first rolled into a buffer of 32-bit indexes, then the swaps
+// are applied.
+inline constexpr uint64_t max_shuffle_block = 8192;
+inline constexpr uint64_t default_shuffle_block = 1024;
+
+template <class random_it, class URBG>
+void shuffle_23456_blocked(random_it first, random_it last, URBG &&g,
+                           uint64_t block = default_shuffle_block) {
+  uint32_t dice[max_shuffle_block + 5];
+  block = std::clamp<uint64_t>(block, 1, max_shuffle_block);
+  uint64_t i = std::distance(first, last);
+  for (; i > 1 << 30; i--) {
+    partial_shuffle_64b(first, i, 1, i, g);
+  }
+
+  while (i > 1) {
+    uint64_t rolled = roll_dice_23456_32b(i, block, g, dice);
+    for (uint64_t j = 0; j < rolled; j++) {
+      std::iter_swap(first + (i - j - 1), first + dice[j]);
+    }
+    i -= rolled;
+  }
+}
+
+// This is a template function that applies one random permutation to several
+// ranges (the columns of a table: features, labels, weights, ...): every
+// batch of dice is rolled once, a block at a time as in shuffle_23456_blocked,
+// and its swaps are applied to each range. Each range ends up as it would
+// with shuffle_23456_blocked from the same random words. The ranges must
+// have the same size: it throws std::invalid_argument, before any swap,
+// otherwise.
+//
+// Usage:
+//   batched_random::shuffle_together(g, features, labels, weights);
+template <class URBG, std::ranges::random_access_range... Ranges>
+  requires(sizeof...(Ranges) > 0 && (std::ranges::sized_range<Ranges> && ...))
+void shuffle_together(URBG &&g, Ranges &&...ranges) {
+  uint32_t dice[default_shuffle_block + 5];
+  const uint64_t sizes[] = {uint64_t(std::ranges::size(ranges))...};
+  uint64_t i = sizes[0];
+  if (((uint64_t(std::ranges::size(ranges)) != i) || ...)) {
+    throw std::invalid_argument(
+        "shuffle_together: the ranges must have the same size");
+  }
+  for (; i > 1 << 30; i--) {
+    uint64_t die;
+    partial_shuffle_dice(i, 1, i, g, &die);
+    (std::iter_swap(std::ranges::begin(ranges) + (i - 1),
+                    std::ranges::begin(ranges) + die),
+     ...);
+  }
+
+  while (i > 1) {
+    uint64_t rolled = roll_dice_23456_32b(i, default_shuffle_block, g, dice);
+    auto apply = [&](auto first) {
+      for (uint64_t j = 0; j < rolled; j++) {
+        std::iter_swap(first + (i - j - 1), first + dice[j]);
+      }
+    };
+    (apply(std::ranges::begin(ranges)), ...);
+    i -= rolled;
+  }
+}
+
+// This is a template function that runs the first k steps of shuffle_23456
+// on the range [first, last) of n elements (all of them when k >= n - 1): the
+// last k elements are then a uniformly random sample of the range, in random
+// order, and it returns an iterator to the first of them. The result is the
+// same as partial_shuffle in C from the same random words.
+template <class random_it, class URBG>
+random_it partial_shuffle(random_it first, random_it last, uint64_t k,
+                          URBG &&g) {
+  uint64_t n = std::distance(first, last);
+  uint64_t stop = k < n ? n - k : 1;
+  uint64_t i = n;
+  for (; i > 1 << 30 && i > stop; i--) {
+    partial_shuffle_64b(first, i, 1, i, g);
+  }
+
+  // Batches of 2 for sizes up to 2^30 elements
+  uint64_t bound = (uint64_t)1 << 60;
+  for (; i > 1 << 19 && i >= stop + 2; i -= 2) {
+    bound = partial_shuffle_64b(first, i, 2, bound, g);
+  }
+
+  // Batches of 3 for sizes up to 2^19 elements
+  bound = (uint64_t)1 << 57;
+  for (; i > 1 << 14 && i >= stop + 3; i -= 3) {
+    bound = partial_shuffle_64b(first, i, 3, bound, g);
+  }
+
+  // Batches of 4 for sizes up to 2^14 elements
+  bound = (uint64_t)1 << 56;
+  for (; i > 1 << 11 && i >= stop + 4; i -= 4) {
+    bound = partial_shuffle_64b(first, i, 4, bound, g);
+  }
+
+  // Batches of 5 for sizes up to 2^11 elements
+  bound = (uint64_t)1 << 55;
+  for (; i > 1 << 9 && i >= stop + 5; i -= 5) {
+    bound = partial_shuffle_64b(first, i, 5, bound, g);
+  }
+
+  // Batches of 6 for sizes up to 2^9 elements
+  bound = (uint64_t)1 << 54;
+  for (; i > 6 && i >= stop + 6; i -= 6) {
+    bound = partial_shuffle_64b(first, i, 6, bound, g);
+  }
+
+  // The last batch, with fewer dice, has its exact rejection threshold
+  if (i > stop) {
+    partial_shuffle_64b(first, i, i - stop, UINT64_MAX, g);
+  }
+  return first + (n - std::min(k, n));
+}
+
+// This is a template function that writes a uniformly random permutation of
+// 0, 1, ..., n-1 to the range [first, last) of n elements, with the inside-out
+// Fisher-Yates shuffle: an element is only read after it was assigned, and
+// never moved onto itself, so the prior values in the range do not matter
+// (the elements must still be live objects). The dice for the increasing
+// sizes 1, 2, ..., n are rolled in batches of up to 6 from a single random
+// word. The result is the same as random_permutation_u64 in C from the same
+// random words.
+template <class random_it, class URBG>
+void random_permutation(random_it first, random_it last, URBG &&g) {
+  using value_type = typename std::iterator_traits<random_it>::value_type;
+  uint32_t dice[default_shuffle_block + 5];
+  uint64_t n = std::distance(first, last);
+  uint64_t batched = std::min<uint64_t>(n, 1 << 30);
+  uint64_t i = 0;
+  while (i < batched) {
+    uint64_t rolled =
+        roll_increasing_dice_32b(i + 1, batched, default_shuffle_block, g, dice);
+    for (uint64_t j = 0; j < rolled; j++) {
+      if (dice[j] != i + j) {
+        first[i + j] = std::move(first[dice[j]]);
+      }
+      first[dice[j]] = value_type(i + j);
+    }
+    i += rolled;
+  }
+  for (; i < n; i++) {
+    uint64_t d;
+    increasing_dice(i + 1, 1, i + 1, g, &d);
+    if (d != i) {
+      first[i] = std::move(first[d]);
+    }
+    first[d] = value_type(i);
+  }
+}
+
+// This is a template function that shuffles the elements in the range [first,
+// last), with the same result as shuffle_23456. The dice are rolled
+// `distance` positions (at most max_shuffle_prefetch) ahead of the swaps,
+// and the elements they target are prefetched. By default, the distance is
+// picked from the size: ranges of up to 2^19 elements are not prefetched.
+//
+// The prefetches only help if the range is contiguous in memory.
+inline constexpr uint64_t max_shuffle_prefetch = 128;
+inline constexpr uint64_t default_shuffle_prefetch = 64;
+inline constexpr uint64_t auto_shuffle_prefetch = UINT64_MAX;
+
+template <class random_it, class URBG>
+void shuffle_23456_prefetch(random_it first, random_it last, URBG &&g,
+                            uint64_t distance = auto_shuffle_prefetch) {
+  constexpr uint64_t initial_bound[7] = {
+      0, 720, (uint64_t)1 << 60, (uint64_t)1 << 57, (uint64_t)1 << 56,
+      (uint64_t)1 << 55, (uint64_t)1 << 54};
+  constexpr uint64_t ring = 256; // power of two > max_shuffle_prefetch + 6
+  uint64_t size = std::distance(first, last);
+  if (distance == auto_shuffle_prefetch) {
+    distance = size <= 1 << 19 ? 0 : default_shuffle_prefetch;
+  }
+  distance = std::min(distance, max_shuffle_prefetch);
+  if (distance == 0) {
+    shuffle_23456(first, last, g);
+    return;
+  }
+  uint64_t dice[ring]; // dice[j % ring] is the die of position size - j - 1
+  uint64_t batch[6];
+  uint64_t rolled = 0;
+  uint64_t swapped = 0;
+  uint64_t k = 0;
+  uint64_t bound = 0;
+  for (uint64_t n = size; n > 1; n -= k) {
+    if (n > 1 << 30) {
+      k = 1;
+      bound = n;
+    } else {
+      uint64_t next_k = n > 1 << 19 ? 2
+                      : n > 1 << 14 ? 3
+                      : n > 1 << 11 ? 4
+                      : n > 1 << 9  ? 5
+                      : n > 6       ? 6
+                                    : n - 1;
+      if (next_k != k) {
+        k = next_k;
+        bound = initial_bound[k];
+      }
+    }
+    bound = partial_shuffle_dice(n, k, bound, g, batch);
+    for (uint64_t j = 0; j < k; j++) {
+      __builtin_prefetch(std::addressof(first[batch[j]]), 1);
+      dice[(rolled + j) % ring] = batch[j];
+    }
+    rolled += k;
+    // The swaps read the elements when they happen: an element that an
+    // earlier swap moved is handled correctly, it may only miss the cache.
+    for (; rolled - swapped > distance; swapped++) {
+      std::iter_swap(first + (size - swapped - 1),
+                     first + dice[swapped % ring]);
+    }
+  }
+  for (; swapped < rolled; swapped++) {
+    std::iter_swap(first + (size - swapped - 1), first + dice[swapped % ring]);
+  }
+}
+
+// Buckets of shuffle_bucketed: the bucket id of an element is 5 random bits,
+// and buckets of up to 2^17 elements are shuffled with shuffle_23456.
+inline constexpr uint64_t shuffle_bucket_bits = 5;
+inline constexpr uint64_t shuffle_bucket_leaf = 1 << 17;
+
+// Moves every element of src to a bucket of other picked uniformly at
+// random, and shuffles every bucket recursively, the roles of src and other
+// being swapped at every level. The result is in other if to_other is set,
+// in src otherwise.
+template <class src_it, class other_it, class URBG>
+void shuffle_bucketed_level(src_it src, other_it other, uint64_t size,
+                            bool to_other, uint8_t *ids, URBG &g) {
+  if (size <= shuffle_bucket_leaf) {
+    if (to_other) {
+      std::move(src, src + size, other);
+      shuffle_23456(other, other + size, g);
+    } else {
+      shuffle_23456(src, src + size, g);
+    }
+    return;
+  }
+  constexpr uint64_t buckets = 1 << shuffle_bucket_bits;
+  constexpr uint64_t per_word = 64 / shuffle_bucket_bits;
+  uint64_t count[buckets] = {0};
+  uint64_t i = 0;
+  for (; i + per_word <= size; i += per_word) {
+    uint64_t r = next_word64(g);
+    for (uint64_t j = 0; j < per_word; j++, r >>= shuffle_bucket_bits) {
+      ids[i + j] = uint8_t(r & (buckets - 1));
+      count[r & (buckets - 1)]++;
+    }
+  }
+  for (uint64_t r = next_word64(g); i < size; i++, r >>= shuffle_bucket_bits) {
+    ids[i] = uint8_t(r & (buckets - 1));
+    count[r & (buckets - 1)]++;
+  }
+
+  uint64_t offset[buckets];
+  uint64_t start = 0;
+  for (uint64_t b = 0; b < buckets; b++) {
+    offset[b] = start;
+    start += count[b];
+  }
+  for (i = 0; i < size; i++) {
+    other[offset[ids[i]]++] = std::move(src[i]);
+  }
+
+  start = 0;
+  for (uint64_t b = 0; b < buckets; b++) {
+    shuffle_bucketed_level(other + start, src + start, count[b], !to_other,
+                           ids + start, g);
+    start += count[b];
+  }
+}
+
+// This is a template function that shuffles the elements in the range [first,
+// last), for ranges that do not fit in cache: the elements are scattered into
+// 32 buckets picked at random, recursively, until the buckets fit in cache,
+// and then every bucket is shuffled with shuffle_23456. The result is a
+// uniformly random permutation, and it is the same as shuffle_batch_bucketed
+// in C from the same random words. It uses a temporary buffer of the size
+// of the range, plus one byte per element.
+//
+// It is slower than shuffle_23456_prefetch below 2^27 elements or so.
+template <class random_it, class URBG>
+void shuffle_bucketed(random_it first, random_it last, URBG &&g) {
+  uint64_t size = std::distance(first, last);
+  if (size <= shuffle_bucket_leaf) {
+    shuffle_23456(first, last, g);
+    return;
+  }
+  // No need to initialize the buffers: every element is written before it
+  // is read.
+  auto buffer = std::make_unique_for_overwrite<
+      typename std::iterator_traits<random_it>::value_type[]>(size);
+  auto ids = std::make_unique_for_overwrite<uint8_t[]>(size);
+  shuffle_bucketed_level(first, buffer.get(), size, false, ids.get(), g);
+}
+
+// Runs task(t) for t = 0, ..., nthreads - 1, in as many threads. If a thread
+// cannot be created, its task runs in the calling thread.
+template <class Task> void run_parallel(uint64_t nthreads, Task &task) {
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> inline_tasks{0};
+  for (uint64_t t = 1; t < nthreads; t++) {
+    try {
+      threads.emplace_back(std::ref(task), t);
+    } catch (const std::system_error &) {
+      inline_tasks.push_back(t);
+    }
+  }
+  for (uint64_t t : inline_tasks) {
+    task(t);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+// Scatters the elements of [first, last) into 2^bits random buckets, in
+// `chunks` chunks, and shuffles the buckets, using nthreads threads. Every
+// chunk rolls its bucket ids with its own generator. The buckets are
+// shuffled with the generator of the thread or, if deterministic is set,
+// with the generator of the bucket. The generators are of the same type as
+// g, seeded with values drawn from g.
+template <class random_it, class URBG>
+void shuffle_parallel_buckets(random_it first, random_it last, URBG &g,
+                              uint64_t nthreads, uint64_t chunks,
+                              uint64_t bits, bool deterministic) {
+  using engine = std::remove_cvref_t<URBG>;
+  static_assert(std::is_constructible_v<engine, uint64_t>,
+                "the generator must be constructible from a 64-bit seed");
+  using value_type = typename std::iterator_traits<random_it>::value_type;
+  uint64_t size = std::distance(first, last);
+  const uint64_t buckets = uint64_t(1) << bits;
+  const uint64_t per_word = 64 / bits;
+  auto buffer = std::make_unique_for_overwrite<value_type[]>(size);
+  auto ids = std::make_unique_for_overwrite<uint8_t[]>(size);
+  // counts[c * buckets + b] is the number of elements of chunk c in bucket
+  // b, and then the offset of these elements in buffer
+  std::vector<uint64_t> counts(chunks * buckets);
+  std::vector<uint64_t> bucket_start(buckets + 1);
+  std::vector<engine> engines;
+  uint64_t streams = chunks + (deterministic ? buckets : nthreads);
+  for (uint64_t i = 0; i < streams; i++) {
+    engines.emplace_back(next_word64(g));
+  }
+  auto chunk_start = [size, chunks](uint64_t c) {
+    return uint64_t((__uint128_t)size * c / chunks);
+  };
+  std::atomic<uint64_t> next_task{0};
+
+  // First pass: the bucket ids of every chunk, and the size of its buckets
+  auto count = [&](uint64_t) {
+    for (uint64_t c; (c = next_task.fetch_add(1)) < chunks;) {
+      engine &rng = engines[c];
+      uint64_t *chunk_count = counts.data() + c * buckets;
+      uint64_t i = chunk_start(c);
+      uint64_t end = chunk_start(c + 1);
+      for (; i + per_word <= end; i += per_word) {
+        uint64_t r = next_word64(rng);
+        for (uint64_t j = 0; j < per_word; j++, r >>= bits) {
+          ids[i + j] = uint8_t(r & (buckets - 1));
+          chunk_count[r & (buckets - 1)]++;
+        }
+      }
+      for (uint64_t r = next_word64(rng); i < end; i++, r >>= bits) {
+        ids[i] = uint8_t(r & (buckets - 1));
+        chunk_count[r & (buckets - 1)]++;
+      }
+    }
+  };
+  run_parallel(nthreads, count);
+  // The elements of bucket b from chunk c go after those of the chunks
+  // before c.
+  uint64_t offset = 0;
+  for (uint64_t b = 0; b < buckets; b++) {
+    bucket_start[b] = offset;
+    for (uint64_t c = 0; c < chunks; c++) {
+      offset += std::exchange(counts[c * buckets + b], offset);
+    }
+  }
+  bucket_start[buckets] = offset;
+
+  // Second pass: the elements of every chunk go to their buckets
+  next_task = 0;
+  auto scatter = [&](uint64_t) {
+    for (uint64_t c; (c = next_task.fetch_add(1)) < chunks;) {
+      uint64_t *chunk_offset = counts.data() + c * buckets;
+      for (uint64_t i = chunk_start(c); i < chunk_start(c + 1); i++) {
+        buffer[chunk_offset[ids[i]]++] = std::move(first[i]);
+      }
+    }
+  };
+  run_parallel(nthreads, scatter);
+
+  // Last pass: the threads take the buckets one at a time and shuffle them
+  // back into the range.
+  next_task = 0;
+  auto shuffle_buckets = [&](uint64_t t) {
+    for (uint64_t b; (b = next_task.fetch_add(1)) < buckets;) {
+      engine &rng = engines[chunks + (deterministic ? b : t)];
+      uint64_t start = bucket_start[b];
+      shuffle_bucketed_level(buffer.get() + start, first + start,
+                             bucket_start[b + 1] - start, true,
+                             ids.get() + start, rng);
+    }
+  };
+  run_parallel(nthreads, shuffle_buckets);
+}
+
+inline uint64_t parallel_thread_count(uint64_t nthreads) {
+  if (nthreads == 0) {
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return std::min<uint64_t>(nthreads, 256);
+}
+
+// This is a template function that shuffles the elements in the range [first,
+// last) using nthreads threads (0: one per hardware thread): the elements are
+// scattered into random buckets in parallel, then the buckets are shuffled in
+// parallel with shuffle_bucketed_level. The result is a uniformly random
+// permutation, which depends on the scheduling of the threads.
+//
+// Every thread has its own generator, of the same type as g, seeded with a
+// value drawn from g: URBG must be constructible from a 64-bit seed. It uses
+// a temporary buffer of the size of the range, plus one byte per element.
+template <class random_it, class URBG>
+void shuffle_parallel(random_it first, random_it last, URBG &&g,
+                      uint64_t nthreads = 0) {
+  nthreads = parallel_thread_count(nthreads);
+  if (nthreads == 1 || std::distance(first, last) <= 1 << 18) {
+    shuffle_23456_prefetch(first, last, g);
+    return;
+  }
+  // one chunk per thread, at least four buckets per thread, at least 32 and
+  // at most 256 buckets
+  uint64_t bits = 5;
+  while (bits < 8 && (uint64_t(1) << bits) < 4 * nthreads) {
+    bits++;
+  }
+  shuffle_parallel_buckets(first, last, g, nthreads, nthreads, bits, false);
+}
+
+// Same as shuffle_parallel, but the permutation only depends on the state of
+// g, not on the number of threads or their scheduling: the range is split
+// into 64 chunks and 256 buckets, each with its own generator.
+template <class random_it, class URBG>
+void shuffle_parallel_deterministic(random_it first, random_it last, URBG &&g,
+                                    uint64_t nthreads = 0) {
+  if (std::distance(first, last) <= 1 << 18) {
+    shuffle_23456_prefetch(first, last, g);
+    return;
+  }
+  shuffle_parallel_buckets(first, last, g, parallel_thread_count(nthreads),
+                           64, 8, true);
+}
+
+// Same as shuffle_23456, with an execution policy: std::execution::par and
+// std::execution::par_unseq shuffle with shuffle_parallel, the other
+// policies with shuffle_23456.
+template <class ExecutionPolicy, class random_it, class URBG>
+  requires std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>>
+void shuffle_23456(ExecutionPolicy &&, random_it first, random_it last,
+                   URBG &&g) {
+  using policy = std::remove_cvref_t<ExecutionPolicy>;
+  if constexpr (std::is_same_v<policy, std::execution::parallel_policy> ||
+                std::is_same_v<policy,
+                               std::execution::parallel_unsequenced_policy>) {
+    shuffle_parallel(first, last, g);
+  } else {
+    shuffle_23456(first, last, g);
+  }
+}
+
+// This is a template function that shuffles the elements in the range [first,
+// last). It is meant for small ranges: up to 64 elements, all the dice are
+// rolled from 16-bit lanes following a precomputed schedule. Larger ranges
+// are shuffled with shuffle_23456. Like shuffle_batch_small in C, it is
+// slower than shuffle_23456 at every size up to 64 that we measured.
+template <class random_it, class URBG>
+void shuffle_small(random_it first, random_it last, URBG &&g) {
+  uint64_t n = std::distance(first, last);
+  if (n > 64) {
+    shuffle_23456(first, last, g);
+    return;
+  }
+  if (n < 2) {
+    return;
+  }
+  small_shuffle_16b(first, n, g);
+}
+
 } // namespace batched_random
 
 #endif // TEMPLATE_SHUFFLE_H
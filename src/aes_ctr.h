@@ -0,0 +1,216 @@
+#ifndef AES_CTR_H
+#define AES_CTR_H
+#include <stdint.h>
+
+#include "cpu_features.h"
+
+/**
+ * AES-128 (FIPS 197) in counter mode, with AES-NI when the processor has it
+ * and a portable (and much slower) implementation otherwise. Both give the
+ * same words.
+ *
+ * The block with the counter c is the encryption of the 128-bit integer
+ * nonce * 2^64 + c, little endian; word i of the stream is word i % 2 of the
+ * block i / 2, so that the blocks can be computed in any order, by any
+ * thread.
+ */
+static const uint8_t aes_sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b,
+    0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+    0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26,
+    0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2,
+    0xeb, 0x27, 0xb2, 0x75, 0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+    0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed,
+    0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f,
+    0x50, 0x3c, 0x9f, 0xa8, 0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+    0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c, 0x13, 0xec,
+    0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14,
+    0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+    0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79, 0xe7, 0xc8, 0x37, 0x6d,
+    0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f,
+    0x4b, 0xbd, 0x8b, 0x8a, 0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+    0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11,
+    0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f,
+    0xb0, 0x54, 0xbb, 0x16,
+};
+
+static inline uint8_t aes_xtime(uint8_t x) {
+  return (uint8_t)((x << 1) ^ ((x >> 7) * 0x1b));
+}
+
+// The 11 round keys, one after another.
+static inline void aes128_expand_key(const uint8_t key[16],
+                                     uint8_t round_keys[176]) {
+  for (int i = 0; i < 16; i++) {
+    round_keys[i] = key[i];
+  }
+  uint8_t rcon = 1;
+  for (int i = 16; i < 176; i += 4) {
+    uint8_t t[4] = {round_keys[i - 4], round_keys[i - 3], round_keys[i - 2],
+                    round_keys[i - 1]};
+    if (i % 16 == 0) {
+      uint8_t t0 = t[0];
+      t[0] = aes_sbox[t[1]] ^ rcon;
+      t[1] = aes_sbox[t[2]];
+      t[2] = aes_sbox[t[3]];
+      t[3] = aes_sbox[t0];
+      rcon = aes_xtime(rcon);
+    }
+    for (int j = 0; j < 4; j++) {
+      round_keys[i + j] = round_keys[i - 16 + j] ^ t[j];
+    }
+  }
+}
+
+// The state is stored column by column: byte r + 4c is in row r, column c.
+static inline void aes128_encrypt_portable(const uint8_t round_keys[176],
+                                           uint8_t s[16]) {
+  for (int i = 0; i < 16; i++) {
+    s[i] ^= round_keys[i];
+  }
+  for (int round = 1; round <= 10; round++) {
+    uint8_t t[16];
+    // SubBytes and ShiftRows: row r moves r columns to the left
+    for (int c = 0; c < 4; c++) {
+      for (int r = 0; r < 4; r++) {
+        t[r + 4 * c] = aes_sbox[s[r + 4 * ((c + r) % 4)]];
+      }
+    }
+    if (round < 10) {
+      for (int c = 0; c < 4; c++) {
+        uint8_t *a = t + 4 * c;
+        uint8_t all = a[0] ^ a[1] ^ a[2] ^ a[3];
+        uint8_t a0 = a[0];
+        a[0] ^= all ^ aes_xtime(a[0] ^ a[1]);
+        a[1] ^= all ^ aes_xtime(a[1] ^ a[2]);
+        a[2] ^= all ^ aes_xtime(a[2] ^ a[3]);
+        a[3] ^= all ^ aes_xtime(a[3] ^ a0);
+      }
+    }
+    for (int i = 0; i < 16; i++) {
+      s[i] = t[i] ^ round_keys[16 * round + i];
+    }
+  }
+}
+
+// Writes the blocks [block, block + blocks) to out, two words per block.
+static inline void aes_ctr_blocks_portable(const uint8_t round_keys[176],
+                                           uint64_t nonce, uint64_t block,
+                                           uint64_t *out, uint64_t blocks) {
+  for (uint64_t b = 0; b < blocks; b++) {
+    uint8_t s[16];
+    for (int j = 0; j < 8; j++) {
+      s[j] = (uint8_t)((block + b) >> (8 * j));
+      s[8 + j] = (uint8_t)(nonce >> (8 * j));
+    }
+    aes128_encrypt_portable(round_keys, s);
+    uint64_t lo = 0, hi = 0;
+    for (int j = 0; j < 8; j++) {
+      lo |= (uint64_t)s[j] << (8 * j);
+      hi |= (uint64_t)s[8 + j] << (8 * j);
+    }
+    out[2 * b] = lo;
+    out[2 * b + 1] = hi;
+  }
+}
+
+#ifdef BATCHED_RANDOM_X64
+
+// Four blocks at a time keep the AES unit busy.
+__attribute__((target("aes,sse2"))) static void
+aes_ctr_blocks_aesni(const uint8_t round_keys[176], uint64_t nonce,
+                     uint64_t block, uint64_t *out, uint64_t blocks) {
+  __m128i k[11];
+  for (int r = 0; r < 11; r++) {
+    k[r] = _mm_loadu_si128((const __m128i *)(round_keys + 16 * r));
+  }
+  uint64_t b = 0;
+  for (; b + 4 <= blocks; b += 4) {
+    __m128i x[4];
+    for (int j = 0; j < 4; j++) {
+      x[j] = _mm_xor_si128(_mm_set_epi64x((long long)nonce,
+                                          (long long)(block + b + (uint64_t)j)),
+                           k[0]);
+    }
+    for (int r = 1; r < 10; r++) {
+      for (int j = 0; j < 4; j++) {
+        x[j] = _mm_aesenc_si128(x[j], k[r]);
+      }
+    }
+    for (int j = 0; j < 4; j++) {
+      x[j] = _mm_aesenclast_si128(x[j], k[10]);
+      _mm_storeu_si128((__m128i *)(out + 2 * (b + (uint64_t)j)), x[j]);
+    }
+  }
+  for (; b < blocks; b++) {
+    __m128i x = _mm_xor_si128(
+        _mm_set_epi64x((long long)nonce, (long long)(block + b)), k[0]);
+    for (int r = 1; r < 10; r++) {
+      x = _mm_aesenc_si128(x, k[r]);
+    }
+    x = _mm_aesenclast_si128(x, k[10]);
+    _mm_storeu_si128((__m128i *)(out + 2 * b), x);
+  }
+}
+
+#endif // x64
+
+static inline void aes_ctr_blocks(const uint8_t round_keys[176],
+                                  uint64_t nonce, uint64_t block,
+                                  uint64_t *out, uint64_t blocks) {
+#ifdef BATCHED_RANDOM_X64
+  if (batched_random_has_aesni()) {
+    aes_ctr_blocks_aesni(round_keys, nonce, block, out, blocks);
+    return;
+  }
+#endif
+  aes_ctr_blocks_portable(round_keys, nonce, block, out, blocks);
+}
+
+typedef void (*aes_ctr_blocks_fn)(const uint8_t round_keys[176],
+                                  uint64_t nonce, uint64_t block,
+                                  uint64_t *out, uint64_t blocks);
+
+// Writes the words [counter_start, counter_start + count) to out, with the
+// blocks of `blocks`.
+__attribute__((always_inline)) static inline void
+aes_ctr_fill_with(const uint8_t round_keys[176], uint64_t nonce,
+                  uint64_t counter_start, uint64_t *out, uint64_t count,
+                  aes_ctr_blocks_fn blocks) {
+  uint64_t block = counter_start / 2;
+  uint64_t pair[2];
+  if (count > 0 && counter_start % 2 == 1) {
+    blocks(round_keys, nonce, block++, pair, 1);
+    *out++ = pair[1];
+    count--;
+  }
+  blocks(round_keys, nonce, block, out, count / 2);
+  if (count % 2 == 1) {
+    blocks(round_keys, nonce, block + count / 2, pair, 1);
+    out[count - 1] = pair[0];
+  }
+}
+
+static inline void aes_ctr_fill(const uint8_t round_keys[176], uint64_t nonce,
+                                uint64_t counter_start, uint64_t *out,
+                                uint64_t count) {
+  aes_ctr_fill_with(round_keys, nonce, counter_start, out, count,
+                    aes_ctr_blocks);
+}
+
+// Same as aes_ctr_fill, without AES-NI, so that the portable blocks can be
+// tested on any processor.
+static inline void aes_ctr_fill_portable(const uint8_t round_keys[176],
+                                         uint64_t nonce,
+                                         uint64_t counter_start, uint64_t *out,
+                                         uint64_t count) {
+  aes_ctr_fill_with(round_keys, nonce, counter_start, out, count,
+                    aes_ctr_blocks_portable);
+}
+
+#endif
@@ -1,21 +1,63 @@
 #include <stdint.h>
 
+#include "cpu_features.h"
+#include "random_bounded_inline.h" // random_bounded_batch_size
+#include "small_dice_schedule.h"
+
+// The function pointer versions of the kernels are the BR_DEFINE_INLINE
+// ones, with rng itself as the context: each algorithm has a single
+// implementation, in random_bounded_inline.h. Passing the pointer as such
+// lets the compiler propagate a known generator and inline it.
+typedef uint64_t br_rng_fn_t(void);
+
+static inline uint64_t br_rng_fn_next(br_rng_fn_t *rng) { return rng(); }
+
+BR_DEFINE_INLINE(br_rng_fn, br_rng_fn_t, br_rng_fn_next)
+
 uint64_t random_bounded(uint64_t range, uint64_t (*rng)(void)) {
-  __uint128_t random64bit, multiresult;
-  uint64_t leftover;
-  uint64_t threshold;
-  random64bit = rng();
-  multiresult = random64bit * range;
-  leftover = (uint64_t)multiresult;
-  if (leftover < range) {
-    threshold = -range % range;
-    while (leftover < threshold) {
-      random64bit = rng();
-      multiresult = random64bit * range;
-      leftover = (uint64_t)multiresult;
-    }
-  }
-  return (uint64_t)(multiresult >> 64); // [0, range)
+  return br_rng_fn_random_bounded(rng, range); // [0, range)
+}
+
+// Fills `out` with `count` dice of size `range`, k per 64-bit word, where k
+// and t come from random_bounded_batch_size(range, 64, &t). Callers that fill
+// many buffers for the same range compute k and t once. Each word rolls k
+// dice with a single rejection check against t == -(range^k) % (range^k);
+// the tail gets its own (smaller) batch and threshold.
+static inline void random_bounded_fill_batches(uint64_t range, uint64_t k,
+                                               uint64_t t, uint64_t *out,
+                                               uint64_t count,
+                                               uint64_t (*rng)(void)) {
+  br_rng_fn_random_bounded_fill_batches(rng, range, k, t, out, count);
+}
+
+// Fills `out` with `count` independent values in [0, range), each distributed
+// like random_bounded(range, rng).
+//
+// Several values are extracted from each 64-bit word when range is small:
+// we roll a batch of dice of size range and use a single rejection check
+// against range^k. The rejection threshold is computed once per call, not
+// once per word.
+//
+// Preconditions:
+//   range >= 1
+//   rng() produces uniformly random 64-bit values
+void random_bounded_fill(uint64_t range, uint64_t *out, uint64_t count,
+                         uint64_t (*rng)(void)) {
+  br_rng_fn_random_bounded_fill(rng, range, out, count);
+}
+
+// Fills `out` with independent random values, out[i] being in [0, ranges[i]).
+//
+// Consecutive ranges are grouped greedily as long as the product of the
+// group stays at or below 2^60, so that each group can be rolled from a
+// single 64-bit word with one (rarely taken) rejection check.
+//
+// Preconditions:
+//   ranges[i] >= 1
+//   rng() produces uniformly random 64-bit values
+void random_bounded_ranges(const uint64_t *ranges, uint64_t *out,
+                           uint64_t count, uint64_t (*rng)(void)) {
+  br_rng_fn_random_bounded_ranges(rng, ranges, out, count);
 }
 
 // This is a naive batched shuffle. We generate a single random number r in n*(n-1)*...*(n-(k-1)).
@@ -64,8 +106,23 @@ inline void naive_partial_shuffle_64b(uint64_t *storage, uint64_t n, uint64_t k,
 //   rng() produces uniformly random 64-bit values
 //
 // The return value is usable as `bound` for smaller batches of size k.
-static inline uint64_t partial_shuffle_64b(uint64_t *storage, uint64_t n, uint64_t k,
-                                    uint64_t bound, uint64_t (*rng)(void)) {
+static inline uint64_t partial_shuffle_64b(uint64_t *storage, uint64_t n,
+                                           uint64_t k, uint64_t bound,
+                                           uint64_t (*rng)(void)) {
+  return br_rng_fn_partial_shuffle_64b(rng, storage, n, k, bound);
+}
+
+// Same as partial_shuffle_64b, but with the exact rejection threshold t
+// precomputed by the caller: there is no division.
+//
+// Preconditions:
+//   n >= k >= 1, k <= 7
+//   t == -(n*(n-1)*...*(n-(k-1))) % (n*(n-1)*...*(n-(k-1))), the product
+//   must not overflow
+//   rng() produces uniformly random 64-bit values
+static inline void partial_shuffle_64b_exact(uint64_t *storage, uint64_t n,
+                                             uint64_t k, uint64_t t,
+                                             uint64_t (*rng)(void)) {
   __uint128_t x;
   uint64_t r = rng();
   uint64_t pos1, pos2;
@@ -77,21 +134,12 @@ static inline uint64_t partial_shuffle_64b(uint64_t *storage, uint64_t n, uint64
     r = (uint64_t)x;
     indexes[i] = (uint64_t)(x >> 64);
   }
-
-  if (r < bound) {
-    bound = n;
-    for (uint64_t i = 1; i < k; i++) {
-      bound *= n - i;
-    }
-    uint64_t t = -bound % bound;
-
-    while (r < t) {
-      r = rng();
-      for (uint64_t i = 0; i < k; i++) {
-        x = (__uint128_t)(n - i) * (__uint128_t)r;
-        r = (uint64_t)x;
-        indexes[i] = (uint64_t)(x >> 64);
-      }
+  while (r < t) {
+    r = rng();
+    for (uint64_t i = 0; i < k; i++) {
+      x = (__uint128_t)(n - i) * (__uint128_t)r;
+      r = (uint64_t)x;
+      indexes[i] = (uint64_t)(x >> 64);
     }
   }
   for (uint64_t i = 0; i < k; i++) {
@@ -102,7 +150,6 @@ static inline uint64_t partial_shuffle_64b(uint64_t *storage, uint64_t n, uint64
     storage[pos1] = val2;
     storage[pos2] = val1; // will be read later
   }
-  return bound;
 }
 
 // Rolls a batch of fair dice with sizes n, n-1, ..., n-(k-1)
@@ -117,9 +164,10 @@ static inline uint64_t partial_shuffle_64b(uint64_t *storage, uint64_t n, uint64
 //   result[i] is an (n-i) sided die roll
 //
 // The return value is usable as `bound` for smaller batches of size k.
-inline uint64_t partial_shuffle_dice_64b(uint64_t n, uint64_t k, uint64_t bound,
-                                         uint64_t (*rng)(void),
-                                         uint64_t *result) {
+static inline uint64_t partial_shuffle_dice_64b(uint64_t n, uint64_t k,
+                                                uint64_t bound,
+                                                uint64_t (*rng)(void),
+                                                uint64_t *result) {
   __uint128_t x;
   uint64_t r = rng();
 
@@ -148,6 +196,136 @@ inline uint64_t partial_shuffle_dice_64b(uint64_t n, uint64_t k, uint64_t bound,
   return bound;
 }
 
+// Same as partial_shuffle_dice_64b, but the dice are written as 32-bit
+// values.
+//
+// Preconditions:
+//   n <= 2^32 and the preconditions of partial_shuffle_dice_64b
+static inline uint64_t partial_shuffle_dice_32b(uint64_t n, uint64_t k,
+                                                uint64_t bound,
+                                                uint64_t (*rng)(void),
+                                                uint32_t *result) {
+  __uint128_t x;
+  uint64_t r = rng();
+
+  for (uint64_t i = 0; i < k; i++) {
+    x = (__uint128_t)(n - i) * (__uint128_t)r;
+    r = (uint64_t)x;
+    result[i] = (uint32_t)(x >> 64);
+  }
+
+  if (r < bound) {
+    bound = n;
+    for (uint64_t i = 1; i < k; i++) {
+      bound *= n - i;
+    }
+    uint64_t t = -bound % bound;
+    while (r < t) {
+      r = rng();
+      for (uint64_t i = 0; i < k; i++) {
+        x = (__uint128_t)(n - i) * (__uint128_t)r;
+        r = (uint64_t)x;
+        result[i] = (uint32_t)(x >> 64);
+      }
+    }
+  }
+
+  return bound;
+}
+
+// Rolls a batch of fair dice with increasing sizes m, m+1, ..., m+(k-1), as
+// in the inside-out Fisher-Yates shuffle. Since the sizes grow from one batch
+// to the next, the product of a batch does not bound the next one, and the
+// caller passes a fixed bound for a whole range of sizes instead (see
+// random_permutation).
+//
+// Preconditions:
+//   m >= 1, m+(k-1) <= 2^32
+//   bound >= m*(m+1)*...*(m+(k-1)), which must not overflow
+//   rng() produces uniformly random 64-bit values
+//   result has length at least k
+//
+// The dice rolls are put in the `result` array:
+//   result[i] is an (m+i) sided die roll
+__attribute__((always_inline)) static inline void
+increasing_dice_32b(uint64_t m, uint64_t k, uint64_t bound,
+                    uint64_t (*rng)(void), uint32_t *result) {
+  __uint128_t x;
+  uint64_t r = rng();
+
+  for (uint64_t i = 0; i < k; i++) {
+    x = (__uint128_t)(m + i) * (__uint128_t)r;
+    r = (uint64_t)x;
+    result[i] = (uint32_t)(x >> 64);
+  }
+
+  if (r < bound) {
+    uint64_t product = m;
+    for (uint64_t i = 1; i < k; i++) {
+      product *= m + i;
+    }
+    uint64_t t = -product % product;
+    while (r < t) {
+      r = rng();
+      for (uint64_t i = 0; i < k; i++) {
+        x = (__uint128_t)(m + i) * (__uint128_t)r;
+        r = (uint64_t)x;
+        result[i] = (uint32_t)(x >> 64);
+      }
+    }
+  }
+}
+
+// A generator with four lanes and its state: rng4(state, out, lanes) draws
+// the next word of every lane j whose bit is set in `lanes` into out[j].
+typedef void (*lanes_rng)(void *state, uint64_t *out, uint64_t lanes);
+
+// Calls a four-lane generator without a context; state points to it.
+static inline void lanes_rng_global(void *state, uint64_t *out,
+                                    uint64_t lanes) {
+  (*(void (**)(uint64_t *, uint64_t))state)(out, lanes);
+}
+
+// Rejection step shared by the interleaved dice kernels below. On input,
+// r[j] holds the leftover of batch j after k multiplications. Batches whose
+// leftover falls below the rejection threshold are rolled again, in order
+// of j, so that every implementation consumes rng() in the same way.
+//
+// When rng4 is not NULL (four lanes), batch j is rolled again from the next
+// word of lane j alone: the other lanes do not advance.
+//
+// The return value is usable as `bound` with the same k and smaller n
+__attribute__((always_inline)) static inline uint64_t
+interleaved_dice_reject_64b(uint64_t n, uint64_t k, uint64_t lanes,
+                            uint64_t bound, uint64_t (*rng)(void),
+                            void *state4, lanes_rng rng4, uint64_t *r,
+                            uint64_t *result) {
+  __uint128_t x;
+  for (uint64_t j = 0; j < lanes; j++) {
+    if (r[j] < bound) {
+      uint64_t m = n - j;
+      bound = m;
+      for (uint64_t i = 1; i < k; i++) {
+        bound *= m - lanes * i;
+      }
+      uint64_t t = -bound % bound;
+      while (r[j] < t) {
+        if (rng4 != NULL) {
+          rng4(state4, r, (uint64_t)1 << j);
+        } else {
+          r[j] = rng();
+        }
+        for (uint64_t i = 0; i < k; i++) {
+          x = (__uint128_t)(m - lanes * i) * (__uint128_t)r[j];
+          r[j] = (uint64_t)x;
+          result[lanes * i + j] = (uint64_t)(x >> 64);
+        }
+      }
+    }
+  }
+  return bound;
+}
+
 // Rolls fair dice with sizes n, n-1, ..., n - (4*k - 1)
 // in four interleaved batches. The first die in batch j
 // has size n-j, and each subsequent die is smaller by 4
@@ -162,10 +340,10 @@ inline uint64_t partial_shuffle_dice_64b(uint64_t n, uint64_t k, uint64_t bound,
 //   result[i] is an (n-i) sided die roll
 //
 // The return value is usable as `bound` with the same k and smaller n
-inline uint64_t partial_shuffle_dice_64b_interleaved_4x(uint64_t n, uint64_t k,
-                                                        uint64_t bound,
-                                                        uint64_t (*rng)(void),
-                                                        uint64_t *result) {
+extern inline __attribute__((always_inline)) uint64_t
+partial_shuffle_dice_64b_interleaved_4x(uint64_t n, uint64_t k, uint64_t bound,
+                                        uint64_t (*rng)(void),
+                                        uint64_t *result) {
   __uint128_t x;
   uint64_t r[4];
 
@@ -181,26 +359,261 @@ inline uint64_t partial_shuffle_dice_64b_interleaved_4x(uint64_t n, uint64_t k,
     }
   }
 
-  for (uint64_t j = 0; j < 4; j++) {
-    if (r[j] < bound) {
-      uint64_t m = n - j;
-      bound = m;
-      for (uint64_t i = 1; i < k; i++) {
-        bound *= m - 4 * i;
-      }
-      uint64_t t = -bound % bound;
-      while (r[j] < t) {
-        r[j] = rng();
-        for (uint64_t i = 0; i < k; i++) {
-          x = (__uint128_t)(m - 4 * i) * (__uint128_t)r[j];
-          r[j] = (uint64_t)x;
-          result[4 * i + j] = (uint64_t)(x >> 64);
-        }
-      }
+  return interleaved_dice_reject_64b(n, k, 4, bound, rng, NULL, NULL, r,
+                                     result);
+}
+
+// Same as partial_shuffle_dice_64b_interleaved_4x, but batch j draws its
+// word from lane j of rng4, which has four independent generators. A single
+// generator is a serial chain of multiplications; with four lanes, four
+// multiplications can be in flight.
+__attribute__((always_inline)) static inline uint64_t
+lanes_dice_64b_4x(uint64_t n, uint64_t k, uint64_t bound, void *state4,
+                  lanes_rng rng4, uint64_t *result) {
+  __uint128_t x;
+  uint64_t r[4];
+
+  rng4(state4, r, 0xF);
+
+  for (uint64_t i = 0; i < k; i++) {
+    for (uint64_t j = 0; j < 4; j++) {
+      x = (__uint128_t)(n - 4 * i - j) * (__uint128_t)r[j];
+      r[j] = (uint64_t)x;
+      result[4 * i + j] = (uint64_t)(x >> 64);
     }
   }
 
-  return bound;
+  return interleaved_dice_reject_64b(n, k, 4, bound, NULL, state4, rng4, r,
+                                     result);
+}
+
+uint64_t partial_shuffle_dice_64b_lanes_4x(uint64_t n, uint64_t k,
+                                           uint64_t bound,
+                                           void (*rng4)(uint64_t *, uint64_t),
+                                           uint64_t *result) {
+  return lanes_dice_64b_4x(n, k, bound, &rng4, lanes_rng_global, result);
+}
+
+// Rolls fair dice with sizes n, n-1, ..., n - (8*k - 1)
+// in eight interleaved batches. The first die in batch j
+// has size n-j, and each subsequent die is smaller by 8
+//
+// Preconditions:
+//   n >= 8*k
+//   bound >= n*(n-8)*...*(n - 8*(k-1)), which must not overflow
+//   rng() produces uniformly random 64-bit values
+//   result has length at least 8*k
+//
+// The dice rolls are put in the `result` array:
+//   result[i] is an (n-i) sided die roll
+//
+// The return value is usable as `bound` with the same k and smaller n
+extern inline __attribute__((always_inline)) uint64_t
+partial_shuffle_dice_64b_interleaved_8x(uint64_t n, uint64_t k, uint64_t bound,
+                                        uint64_t (*rng)(void),
+                                        uint64_t *result) {
+  __uint128_t x;
+  uint64_t r[8];
+
+  for (int j = 0; j < 8; j++) {
+    r[j] = rng();
+  }
+
+  for (uint64_t i = 0; i < k; i++) {
+    for (uint64_t j = 0; j < 8; j++) {
+      x = (__uint128_t)(n - 8 * i - j) * (__uint128_t)r[j];
+      r[j] = (uint64_t)x;
+      result[8 * i + j] = (uint64_t)(x >> 64);
+    }
+  }
+
+  return interleaved_dice_reject_64b(n, k, 8, bound, rng, NULL, NULL, r,
+                                     result);
+}
+
+#ifdef BATCHED_RANDOM_X64
+
+// SIMD versions of the interleaved kernels. There is no 64x64->128-bit
+// vector multiplication, but in the interleaved kernels the die sizes fit
+// in 32 bits, so we can split each 64-bit word r into r_hi * 2^32 + r_lo and
+// compute m * r as m * r_lo + ((m * r_hi) << 32) with two 32x32->64-bit
+// multiplications. The high 64 bits are (m * r_hi) >> 32 plus the carry of
+// the low addition.
+//
+// The results are identical to the scalar kernels. The die sizes must be
+// smaller than 2^32.
+
+// Multiplies the four words of vr by the dice sizes n-j, n-j-4, ... for k
+// rounds, storing the dice in result. Returns the leftovers.
+__attribute__((target("avx2"), always_inline)) static inline __m256i
+interleaved_4x_avx2_rounds(uint64_t n, uint64_t k, __m256i vr,
+                           uint64_t *result) {
+  const __m256i sign = _mm256_set1_epi64x((long long)(UINT64_C(1) << 63));
+  __m256i m = _mm256_set_epi64x((long long)(n - 3), (long long)(n - 2),
+                                (long long)(n - 1), (long long)n);
+  const __m256i four = _mm256_set1_epi64x(4);
+  for (uint64_t i = 0; i < k; i++) {
+    __m256i p0 = _mm256_mul_epu32(m, vr);
+    __m256i p1 = _mm256_mul_epu32(m, _mm256_srli_epi64(vr, 32));
+    __m256i lo = _mm256_add_epi64(p0, _mm256_slli_epi64(p1, 32));
+    // unsigned lo < p0 means that the addition overflowed, the mask is -1
+    __m256i carry = _mm256_cmpgt_epi64(_mm256_xor_si256(p0, sign),
+                                       _mm256_xor_si256(lo, sign));
+    __m256i hi = _mm256_sub_epi64(_mm256_srli_epi64(p1, 32), carry);
+    _mm256_storeu_si256((__m256i *)(result + 4 * i), hi);
+    vr = lo;
+    m = _mm256_sub_epi64(m, four);
+  }
+  return vr;
+}
+
+// Returns true when a leftover in vr is below the bound.
+__attribute__((target("avx2"), always_inline)) static inline int
+interleaved_4x_avx2_below(__m256i vr, uint64_t bound) {
+  const __m256i sign = _mm256_set1_epi64x((long long)(UINT64_C(1) << 63));
+  __m256i below = _mm256_cmpgt_epi64(
+      _mm256_set1_epi64x((long long)(bound ^ (UINT64_C(1) << 63))),
+      _mm256_xor_si256(vr, sign));
+  return !_mm256_testz_si256(below, below);
+}
+
+__attribute__((target("avx2"), always_inline)) static inline uint64_t
+partial_shuffle_dice_64b_interleaved_4x_avx2(uint64_t n, uint64_t k,
+                                             uint64_t bound,
+                                             uint64_t (*rng)(void),
+                                             uint64_t *result) {
+  uint64_t r[4];
+  // building the vector from registers avoids a store-forwarding stall
+  uint64_t r0 = rng(), r1 = rng(), r2 = rng(), r3 = rng();
+  __m256i vr = _mm256_set_epi64x((long long)r3, (long long)r2, (long long)r1,
+                                 (long long)r0);
+  vr = interleaved_4x_avx2_rounds(n, k, vr, result);
+  // Most of the time, no leftover is below the bound.
+  if (!interleaved_4x_avx2_below(vr, bound)) {
+    return bound;
+  }
+  _mm256_storeu_si256((__m256i *)r, vr);
+
+  return interleaved_dice_reject_64b(n, k, 4, bound, rng, NULL, NULL, r,
+                                     result);
+}
+
+__attribute__((target("avx2"), always_inline)) static inline uint64_t
+lanes_dice_64b_4x_avx2(uint64_t n, uint64_t k, uint64_t bound, void *state4,
+                       lanes_rng rng4, uint64_t *result) {
+  uint64_t r[4];
+  rng4(state4, r, 0xF);
+  __m256i vr = _mm256_set_epi64x((long long)r[3], (long long)r[2],
+                                 (long long)r[1], (long long)r[0]);
+  vr = interleaved_4x_avx2_rounds(n, k, vr, result);
+  if (!interleaved_4x_avx2_below(vr, bound)) {
+    return bound;
+  }
+  _mm256_storeu_si256((__m256i *)r, vr);
+
+  return interleaved_dice_reject_64b(n, k, 4, bound, NULL, state4, rng4, r,
+                                     result);
+}
+
+__attribute__((target("avx512f"))) static inline uint64_t
+partial_shuffle_dice_64b_interleaved_8x_avx512(uint64_t n, uint64_t k,
+                                               uint64_t bound,
+                                               uint64_t (*rng)(void),
+                                               uint64_t *result) {
+  uint64_t r[8];
+  uint64_t r0 = rng(), r1 = rng(), r2 = rng(), r3 = rng();
+  uint64_t r4 = rng(), r5 = rng(), r6 = rng(), r7 = rng();
+  __m512i vr = _mm512_set_epi64((long long)r7, (long long)r6, (long long)r5,
+                                (long long)r4, (long long)r3, (long long)r2,
+                                (long long)r1, (long long)r0);
+  __m512i m = _mm512_sub_epi64(_mm512_set1_epi64((long long)n),
+                               _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0));
+  const __m512i eight = _mm512_set1_epi64(8);
+  const __m512i one = _mm512_set1_epi64(1);
+  for (uint64_t i = 0; i < k; i++) {
+    __m512i p0 = _mm512_mul_epu32(m, vr);
+    __m512i p1 = _mm512_mul_epu32(m, _mm512_srli_epi64(vr, 32));
+    __m512i lo = _mm512_add_epi64(p0, _mm512_slli_epi64(p1, 32));
+    __mmask8 carry = _mm512_cmplt_epu64_mask(lo, p0);
+    __m512i hi = _mm512_srli_epi64(p1, 32);
+    hi = _mm512_mask_add_epi64(hi, carry, hi, one);
+    _mm512_storeu_si512((void *)(result + 8 * i), hi);
+    vr = lo;
+    m = _mm512_sub_epi64(m, eight);
+  }
+  // Most of the time, no leftover is below the bound.
+  if (_mm512_cmplt_epu64_mask(vr, _mm512_set1_epi64((long long)bound)) == 0) {
+    return bound;
+  }
+  _mm512_storeu_si512((void *)r, vr);
+
+  return interleaved_dice_reject_64b(n, k, 8, bound, rng, NULL, NULL, r,
+                                     result);
+}
+
+// The kernels above are always inlined into the AVX2 shuffles; the _simd
+// functions, which are not compiled for AVX2, go through these.
+__attribute__((target("avx2"))) static uint64_t
+partial_shuffle_dice_64b_interleaved_4x_avx2_call(uint64_t n, uint64_t k,
+                                                  uint64_t bound,
+                                                  uint64_t (*rng)(void),
+                                                  uint64_t *result) {
+  return partial_shuffle_dice_64b_interleaved_4x_avx2(n, k, bound, rng, result);
+}
+
+__attribute__((target("avx2"))) static uint64_t
+partial_shuffle_dice_64b_lanes_4x_avx2_call(uint64_t n, uint64_t k,
+                                            uint64_t bound,
+                                            void (*rng4)(uint64_t *, uint64_t),
+                                            uint64_t *result) {
+  return lanes_dice_64b_4x_avx2(n, k, bound, &rng4, lanes_rng_global, result);
+}
+#endif // x64
+
+// Same as partial_shuffle_dice_64b_interleaved_4x, but uses AVX2 when the
+// processor supports it. The results are identical.
+uint64_t partial_shuffle_dice_64b_interleaved_4x_simd(uint64_t n, uint64_t k,
+                                                      uint64_t bound,
+                                                      uint64_t (*rng)(void),
+                                                      uint64_t *result) {
+#ifdef BATCHED_RANDOM_X64
+  if ((n >> 32) == 0 && batched_random_has_avx2()) {
+    return partial_shuffle_dice_64b_interleaved_4x_avx2_call(n, k, bound, rng,
+                                                             result);
+  }
+#endif
+  return partial_shuffle_dice_64b_interleaved_4x(n, k, bound, rng, result);
+}
+
+// Same as partial_shuffle_dice_64b_lanes_4x, but uses AVX2 when the processor
+// supports it. The results are identical.
+uint64_t partial_shuffle_dice_64b_lanes_4x_simd(uint64_t n, uint64_t k,
+                                                uint64_t bound,
+                                                void (*rng4)(uint64_t *,
+                                                             uint64_t),
+                                                uint64_t *result) {
+#ifdef BATCHED_RANDOM_X64
+  if ((n >> 32) == 0 && batched_random_has_avx2()) {
+    return partial_shuffle_dice_64b_lanes_4x_avx2_call(n, k, bound, rng4,
+                                                       result);
+  }
+#endif
+  return partial_shuffle_dice_64b_lanes_4x(n, k, bound, rng4, result);
+}
+
+// Same as partial_shuffle_dice_64b_interleaved_8x, but uses AVX-512 when the
+// processor supports it. The results are identical.
+uint64_t partial_shuffle_dice_64b_interleaved_8x_simd(uint64_t n, uint64_t k,
+                                                      uint64_t bound,
+                                                      uint64_t (*rng)(void),
+                                                      uint64_t *result) {
+#ifdef BATCHED_RANDOM_X64
+  if ((n >> 32) == 0 && batched_random_has_avx512()) {
+    return partial_shuffle_dice_64b_interleaved_8x_avx512(n, k, bound, rng,
+                                                          result);
+  }
+#endif
+  return partial_shuffle_dice_64b_interleaved_8x(n, k, bound, rng, result);
 }
 
 // Rolls a batch of fair dice with sizes 2, 3, ..., 17
@@ -279,3 +692,128 @@ inline void shuffle_17_dice_16b_linear(uint64_t (*rng)(void),
     result[i] = (uint16_t)(x >> 16);
   }
 }
+
+// Rolls the five dice of a lane from the 16 random bits r, with the sizes
+// above n replaced by 1. Returns the leftover bits.
+static inline uint16_t small_lane_roll_16b(uint16_t r, uint32_t lane,
+                                           uint16_t n, uint16_t *dice) {
+  for (uint32_t s = 0; s < 5; s++) {
+    uint16_t size = small_lane_sizes[s][lane];
+    size = size > n ? 1 : size;
+    uint32_t x = (uint32_t)size * r;
+    dice[s * 32 + lane] = (uint16_t)(x >> 16);
+    r = (uint16_t)x;
+  }
+  return r;
+}
+
+// Fisher-Yates shuffle of n <= 64 elements with 16-bit dice, following the
+// schedule in small_lane_sizes. We draw one 64-bit word per four lanes and
+// roll the dice of the lanes below the head lane in two passes: the first
+// two dice of every lane, then the others, which only the first
+// SMALL_DEEP_LANES lanes have. The head lane, with its sizes above n replaced
+// by 1, comes last, and the few rejected lanes are then rolled again one at a
+// time.
+//
+// Preconditions:
+//   2 <= n <= 64
+__attribute__((always_inline)) static inline void
+small_shuffle_16b(uint64_t *storage, uint64_t n, uint64_t (*rng)(void)) {
+  const small_dice_head head = small_dice_heads[n];
+  const uint32_t deep = head.lane < SMALL_DEEP_LANES ? head.lane
+                                                     : SMALL_DEEP_LANES;
+  uint16_t r[32];
+  uint16_t dice[5 * 32];
+  for (uint32_t w = 0; w <= head.lane / 4u; w++) {
+    uint64_t bits = rng();
+    for (uint32_t j = 0; j < 4; j++) {
+      r[4 * w + j] = (uint16_t)(bits >> (16 * j));
+    }
+  }
+  for (uint32_t s = 0; s < 5; s++) {
+    uint32_t lanes = s < 2 ? head.lane : deep;
+    for (uint32_t lane = 0; lane < lanes; lane++) {
+      uint32_t x = (uint32_t)small_lane_sizes[s][lane] * r[lane];
+      dice[s * 32 + lane] = (uint16_t)(x >> 16);
+      r[lane] = (uint16_t)x;
+    }
+  }
+  r[head.lane] = small_lane_roll_16b(r[head.lane], head.lane, (uint16_t)n,
+                                     dice);
+  for (uint32_t lane = 0; lane <= head.lane; lane++) {
+    uint16_t t = lane < head.lane ? small_lane_thresholds[lane]
+                                  : head.threshold;
+    while (r[lane] < t) {
+      r[lane] = small_lane_roll_16b((uint16_t)rng(), lane, (uint16_t)n, dice);
+    }
+  }
+  for (uint64_t size = n; size > 1; size--) {
+    uint64_t pos1 = size - 1;
+    uint64_t pos2 = dice[small_dice_slot[size]];
+    uint64_t val1 = storage[pos1];
+    uint64_t val2 = storage[pos2];
+    storage[pos1] = val2;
+    storage[pos2] = val1;
+  }
+}
+
+// Multiplies the 128-bit value *r by m: the upper 64 bits of the 192-bit
+// product are returned and the lower 128 bits are written back to *r.
+static inline uint64_t mul_128b(__uint128_t *r, uint64_t m) {
+  __uint128_t lo = (__uint128_t)(uint64_t)*r * m;
+  __uint128_t hi = (__uint128_t)(uint64_t)(*r >> 64) * m + (lo >> 64);
+  *r = (hi << 64) | (uint64_t)lo;
+  return (uint64_t)(hi >> 64);
+}
+
+// Draws 128 random bits with two calls to rng().
+static inline __uint128_t random_128b(uint64_t (*rng)(void)) {
+  __uint128_t hi = rng();
+  return (hi << 64) | rng();
+}
+
+// Performs k steps of a Fisher-Yates shuffle on n elements, in the array
+// `storage`, rolling the dice from 128 random bits (two calls to rng()).
+//
+// Preconditions:
+//   n >= k >= 1, k <= 4
+//   bound >= n*(n-1)*...*(n-(k-1)), which must fit in 128 bits
+//   rng() produces uniformly random 64-bit values
+//
+// The return value is usable as `bound` for smaller batches of size k.
+static inline __uint128_t partial_shuffle_128b(uint64_t *storage, uint64_t n,
+                                               uint64_t k, __uint128_t bound,
+                                               uint64_t (*rng)(void)) {
+  __uint128_t r = random_128b(rng);
+  uint64_t pos1, pos2;
+  uint64_t val1, val2;
+  uint64_t indexes[4]; // We know that k <= 4
+
+  for (uint64_t i = 0; i < k; i++) {
+    indexes[i] = mul_128b(&r, n - i);
+  }
+
+  if (r < bound) {
+    bound = n;
+    for (uint64_t i = 1; i < k; i++) {
+      bound *= n - i;
+    }
+    __uint128_t t = -bound % bound;
+
+    while (r < t) {
+      r = random_128b(rng);
+      for (uint64_t i = 0; i < k; i++) {
+        indexes[i] = mul_128b(&r, n - i);
+      }
+    }
+  }
+  for (uint64_t i = 0; i < k; i++) {
+    pos1 = n - i - 1;
+    pos2 = indexes[i];
+    val1 = storage[pos1]; // should be in cache
+    val2 = storage[pos2]; // might not be in cache
+    storage[pos1] = val2;
+    storage[pos2] = val1; // will be read later
+  }
+  return bound;
+}
@@ -5,6 +5,9 @@
 #include <stdlib.h>
 
 #include "chacha.h"
+#include "cpu_features.h"
+
+#define CHACHA_BUFFER_WORDS (16 * BR_CHACHA_BLOCKS)
 
 static void chacha_init(ChaCha *rng, size_t rounds, const uint32_t seed[8], uint64_t stream) {
     rng->state[ 0] = 0x61707865;
@@ -28,7 +31,7 @@ static void chacha_init(ChaCha *rng, size_t rounds, const uint32_t seed[8], uint
 
     rng->rounds = rounds;
 
-    rng->word_index = 16;
+    rng->word_index = CHACHA_BUFFER_WORDS;
 }
 
 void chacha8_init(ChaCha *rng, const uint32_t seed[8], uint64_t stream) {
@@ -101,39 +104,226 @@ void chacha_fill_u16(ChaCha *rng, uint16_t *array, size_t count) {
     }
 }
 
-static void double_round(uint32_t state[16]);
+#ifdef BATCHED_RANDOM_X64
+
+// The SIMD versions compute several blocks at once, word i of every block in
+// vector i, and transpose the words back into consecutive blocks. The output
+// is identical to chacha_blocks_scalar below.
+
+#define CHACHA_ROTATED_LEFT_SSE2(v, n) \
+    _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define QUARTER_ROUND_SSE2(a, b, c, d) \
+    x[a] = _mm_add_epi32(x[a], x[b]); \
+    x[d] = CHACHA_ROTATED_LEFT_SSE2(_mm_xor_si128(x[d], x[a]), 16); \
+    x[c] = _mm_add_epi32(x[c], x[d]); \
+    x[b] = CHACHA_ROTATED_LEFT_SSE2(_mm_xor_si128(x[b], x[c]), 12); \
+    x[a] = _mm_add_epi32(x[a], x[b]); \
+    x[d] = CHACHA_ROTATED_LEFT_SSE2(_mm_xor_si128(x[d], x[a]), 8); \
+    x[c] = _mm_add_epi32(x[c], x[d]); \
+    x[b] = CHACHA_ROTATED_LEFT_SSE2(_mm_xor_si128(x[b], x[c]), 7);
+
+// Four blocks with SSE2, which every x64 processor has.
+static void chacha_blocks_4x_sse2(const uint32_t state[16], uint64_t counter,
+                                  size_t rounds, uint32_t *out) {
+    __m128i input[16];
+    __m128i x[16];
+    for (int i = 0; i < 16; i++) {
+        input[i] = _mm_set1_epi32((int)state[i]);
+    }
+    input[12] = _mm_set_epi32((int)(uint32_t)(counter + 3), (int)(uint32_t)(counter + 2),
+                              (int)(uint32_t)(counter + 1), (int)(uint32_t)counter);
+    input[13] = _mm_set_epi32((int)(uint32_t)((counter + 3) >> 32),
+                              (int)(uint32_t)((counter + 2) >> 32),
+                              (int)(uint32_t)((counter + 1) >> 32),
+                              (int)(uint32_t)(counter >> 32));
+    for (int i = 0; i < 16; i++) {
+        x[i] = input[i];
+    }
+
+    for (size_t i = 0; i < rounds; i += 2) {
+        QUARTER_ROUND_SSE2(0, 4,  8, 12)
+        QUARTER_ROUND_SSE2(1, 5,  9, 13)
+        QUARTER_ROUND_SSE2(2, 6, 10, 14)
+        QUARTER_ROUND_SSE2(3, 7, 11, 15)
+
+        QUARTER_ROUND_SSE2(0, 5, 10, 15)
+        QUARTER_ROUND_SSE2(1, 6, 11, 12)
+        QUARTER_ROUND_SSE2(2, 7,  8, 13)
+        QUARTER_ROUND_SSE2(3, 4,  9, 14)
+    }
+
+    for (int i = 0; i < 16; i++) {
+        x[i] = _mm_add_epi32(x[i], input[i]);
+    }
+
+    for (int i = 0; i < 16; i += 4) {
+        __m128i t0 = _mm_unpacklo_epi32(x[i], x[i + 1]);
+        __m128i t1 = _mm_unpackhi_epi32(x[i], x[i + 1]);
+        __m128i t2 = _mm_unpacklo_epi32(x[i + 2], x[i + 3]);
+        __m128i t3 = _mm_unpackhi_epi32(x[i + 2], x[i + 3]);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi64(t0, t2));
+        _mm_storeu_si128((__m128i *)(out + 16 + i), _mm_unpackhi_epi64(t0, t2));
+        _mm_storeu_si128((__m128i *)(out + 32 + i), _mm_unpacklo_epi64(t1, t3));
+        _mm_storeu_si128((__m128i *)(out + 48 + i), _mm_unpackhi_epi64(t1, t3));
+    }
+}
+
+// Rotations by 16 and 8 bits are byte shuffles.
+#define CHACHA_ROTATED_LEFT_AVX2(v, n) \
+    _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+
+#define QUARTER_ROUND_AVX2(a, b, c, d) \
+    x[a] = _mm256_add_epi32(x[a], x[b]); \
+    x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d], x[a]), rotate16); \
+    x[c] = _mm256_add_epi32(x[c], x[d]); \
+    x[b] = CHACHA_ROTATED_LEFT_AVX2(_mm256_xor_si256(x[b], x[c]), 12); \
+    x[a] = _mm256_add_epi32(x[a], x[b]); \
+    x[d] = _mm256_shuffle_epi8(_mm256_xor_si256(x[d], x[a]), rotate8); \
+    x[c] = _mm256_add_epi32(x[c], x[d]); \
+    x[b] = CHACHA_ROTATED_LEFT_AVX2(_mm256_xor_si256(x[b], x[c]), 7);
+
+// Eight blocks with AVX2.
+__attribute__((target("avx2"))) static void
+chacha_blocks_8x_avx2(const uint32_t state[16], uint64_t counter,
+                      size_t rounds, uint32_t *out) {
+    const __m256i rotate16 = _mm256_set_epi8(
+        13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+        13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+    const __m256i rotate8 = _mm256_set_epi8(
+        14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+        14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+    uint32_t counter_lo[8];
+    uint32_t counter_hi[8];
+    for (int j = 0; j < 8; j++) {
+        counter_lo[j] = (uint32_t)(counter + (uint64_t)j);
+        counter_hi[j] = (uint32_t)((counter + (uint64_t)j) >> 32);
+    }
+    __m256i input[16];
+    __m256i x[16];
+    for (int i = 0; i < 16; i++) {
+        input[i] = _mm256_set1_epi32((int)state[i]);
+    }
+    input[12] = _mm256_loadu_si256((const __m256i *)counter_lo);
+    input[13] = _mm256_loadu_si256((const __m256i *)counter_hi);
+    for (int i = 0; i < 16; i++) {
+        x[i] = input[i];
+    }
+
+    for (size_t i = 0; i < rounds; i += 2) {
+        QUARTER_ROUND_AVX2(0, 4,  8, 12)
+        QUARTER_ROUND_AVX2(1, 5,  9, 13)
+        QUARTER_ROUND_AVX2(2, 6, 10, 14)
+        QUARTER_ROUND_AVX2(3, 7, 11, 15)
+
+        QUARTER_ROUND_AVX2(0, 5, 10, 15)
+        QUARTER_ROUND_AVX2(1, 6, 11, 12)
+        QUARTER_ROUND_AVX2(2, 7,  8, 13)
+        QUARTER_ROUND_AVX2(3, 4,  9, 14)
+    }
+
+    for (int i = 0; i < 16; i++) {
+        x[i] = _mm256_add_epi32(x[i], input[i]);
+    }
 
-static inline void increment_counter(ChaCha *rng) {
-    rng->state[12]++;
-    if (rng->state[12] == 0) {
-        rng->state[13]++;
-        if (rng->state[13] == 0) {
-            exit(EXIT_FAILURE);
+    // Within each 128-bit half, as with SSE2, then the halves hold blocks
+    // j (low) and j + 4 (high).
+    for (int i = 0; i < 16; i += 8) {
+        __m256i t0 = _mm256_unpacklo_epi32(x[i], x[i + 1]);
+        __m256i t1 = _mm256_unpackhi_epi32(x[i], x[i + 1]);
+        __m256i t2 = _mm256_unpacklo_epi32(x[i + 2], x[i + 3]);
+        __m256i t3 = _mm256_unpackhi_epi32(x[i + 2], x[i + 3]);
+        __m256i t4 = _mm256_unpacklo_epi32(x[i + 4], x[i + 5]);
+        __m256i t5 = _mm256_unpackhi_epi32(x[i + 4], x[i + 5]);
+        __m256i t6 = _mm256_unpacklo_epi32(x[i + 6], x[i + 7]);
+        __m256i t7 = _mm256_unpackhi_epi32(x[i + 6], x[i + 7]);
+        __m256i u[8];
+        u[0] = _mm256_unpacklo_epi64(t0, t2);
+        u[1] = _mm256_unpackhi_epi64(t0, t2);
+        u[2] = _mm256_unpacklo_epi64(t1, t3);
+        u[3] = _mm256_unpackhi_epi64(t1, t3);
+        u[4] = _mm256_unpacklo_epi64(t4, t6);
+        u[5] = _mm256_unpackhi_epi64(t4, t6);
+        u[6] = _mm256_unpacklo_epi64(t5, t7);
+        u[7] = _mm256_unpackhi_epi64(t5, t7);
+        for (int j = 0; j < 4; j++) {
+            _mm256_storeu_si256((__m256i *)(out + 16 * j + i),
+                                _mm256_permute2x128_si256(u[j], u[j + 4], 0x20));
+            _mm256_storeu_si256((__m256i *)(out + 16 * (j + 4) + i),
+                                _mm256_permute2x128_si256(u[j], u[j + 4], 0x31));
         }
     }
 }
 
-uint32_t chacha_u32(ChaCha *rng) {
-    assert(rng->word_index <= 16);
+#endif // x64
+
+#ifndef BATCHED_RANDOM_X64
+static void double_round(uint32_t state[16]);
+
+// Computes `blocks` blocks into out, one after another, the first one with
+// the block counter `counter`.
+static void chacha_blocks_scalar(const uint32_t state[16], uint64_t counter,
+                                 size_t rounds, uint32_t *out, size_t blocks) {
+    for (size_t b = 0; b < blocks; b++) {
+        uint32_t input[16];
+        for (size_t i = 0; i < 16; i++) {
+            input[i] = state[i];
+        }
+        input[12] = (uint32_t)(counter + b);
+        input[13] = (uint32_t)((counter + b) >> 32);
 
-    if (rng->word_index == 16) {
+        uint32_t *x = out + 16 * b;
         for (size_t i = 0; i < 16; i++) {
-            rng->working_state[i] = rng->state[i];
+            x[i] = input[i];
         }
 
-        for (size_t i = 0; i < rng->rounds; i += 2) {
-            double_round(rng->working_state);
+        for (size_t i = 0; i < rounds; i += 2) {
+            double_round(x);
         }
 
         for (size_t i = 0; i < 16; i++) {
-            rng->working_state[i] += rng->state[i];
+            x[i] += input[i];
         }
+    }
+}
+#endif
 
-        increment_counter(rng);
-        rng->word_index = 0;
+// Fills the buffer with the next BR_CHACHA_BLOCKS blocks.
+static void chacha_refill(ChaCha *rng) {
+    uint64_t counter = ((uint64_t)rng->state[13] << 32) | rng->state[12];
+    if (counter > UINT64_MAX - BR_CHACHA_BLOCKS) {
+        exit(EXIT_FAILURE);
+    }
+#ifdef BATCHED_RANDOM_X64
+    if (batched_random_has_avx2()) {
+        for (size_t b = 0; b < BR_CHACHA_BLOCKS; b += 8) {
+            chacha_blocks_8x_avx2(rng->state, counter + b, rng->rounds,
+                                  rng->buffer + 16 * b);
+        }
+    } else {
+        for (size_t b = 0; b < BR_CHACHA_BLOCKS; b += 4) {
+            chacha_blocks_4x_sse2(rng->state, counter + b, rng->rounds,
+                                  rng->buffer + 16 * b);
+        }
+    }
+#else
+    chacha_blocks_scalar(rng->state, counter, rng->rounds, rng->buffer,
+                         BR_CHACHA_BLOCKS);
+#endif
+    counter += BR_CHACHA_BLOCKS;
+    rng->state[12] = (uint32_t)counter;
+    rng->state[13] = (uint32_t)(counter >> 32);
+    rng->word_index = 0;
+}
+
+uint32_t chacha_u32(ChaCha *rng) {
+    assert(rng->word_index <= CHACHA_BUFFER_WORDS);
+
+    if (rng->word_index == CHACHA_BUFFER_WORDS) {
+        chacha_refill(rng);
     }
 
-    uint32_t result = rng->working_state[rng->word_index];
+    uint32_t result = rng->buffer[rng->word_index];
 
     rng->word_index++;
 
@@ -147,11 +337,45 @@ void chacha_fill_u32(ChaCha *rng, uint32_t *array, size_t count) {
 }
 
 uint64_t chacha_u64(ChaCha *rng) {
+    // Both words are usually in the buffer: one 64-bit load.
+    if (rng->word_index + 2 <= CHACHA_BUFFER_WORDS) {
+        uint64_t lo = rng->buffer[rng->word_index];
+        uint64_t hi = rng->buffer[rng->word_index + 1];
+        rng->word_index += 2;
+        return (hi << 32) | lo;
+    }
     uint64_t lo = chacha_u32(rng);
     uint64_t hi = chacha_u32(rng);
     return (hi << 32) | lo;
 }
 
+// Skips the next delta 32-bit words in constant time: the block counter is
+// set directly, and the blocks holding the next word (if any) are generated.
+void chacha_advance(ChaCha *rng, uint64_t delta) {
+    assert(rng->word_index <= CHACHA_BUFFER_WORDS);
+
+    // the counter is that of the block after the buffer
+    uint64_t counter = ((uint64_t)rng->state[13] << 32) | rng->state[12];
+    // index of the next word in the whole stream
+    __uint128_t position = (__uint128_t)counter * 16 -
+                           (CHACHA_BUFFER_WORDS - rng->word_index);
+    position += delta;
+
+    __uint128_t block = position / 16;
+    if (block > UINT64_MAX) {
+        exit(EXIT_FAILURE);
+    }
+    rng->state[12] = (uint32_t)block;
+    rng->state[13] = (uint32_t)(block >> 32);
+    rng->word_index = CHACHA_BUFFER_WORDS;
+
+    size_t offset = (size_t)(position % 16);
+    if (offset > 0) {
+        chacha_refill(rng);
+        rng->word_index = offset;
+    }
+}
+
 uint64_t chacha_u64_global() {
     return chacha_u64(&chacha_rng);
 }
@@ -182,6 +406,7 @@ void chacha_fill_f64(ChaCha *rng, double *array, size_t count) {
     }
 }
 
+#ifndef BATCHED_RANDOM_X64
 static inline uint32_t rotated_left(uint32_t value, uint32_t count) {
     return (value << count) | (value >> (32 - count));
 }
@@ -203,3 +428,4 @@ static inline void double_round(uint32_t state[16]) {
     QUARTER_ROUND(2, 7,  8, 13)
     QUARTER_ROUND(3, 4,  9, 14)
 }
+#endif
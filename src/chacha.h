@@ -5,13 +5,10 @@
 
 #include <stdint.h>
 
-typedef struct {
-    uint32_t state[16];
-    uint32_t working_state[16];
-    size_t rounds;
-    size_t word_index;
-} ChaCha;
-ChaCha chacha_rng;
+#include "random_bounded.h" // struct br_chacha
+
+typedef struct br_chacha ChaCha;
+BR_DEFAULT_ENGINE ChaCha chacha_rng;
 
 void chacha8_init(ChaCha *rng, const uint32_t seed[8], uint64_t stream);
 
@@ -33,6 +30,8 @@ uint32_t chacha_u32(ChaCha *rng);
 
 uint64_t chacha_u64(ChaCha *rng);
 
+void chacha_advance(ChaCha *rng, uint64_t delta);
+
 float chacha_f32(ChaCha *rng);
 
 double chacha_f64(ChaCha *rng);
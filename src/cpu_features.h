@@ -0,0 +1,25 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// BATCHED_RANDOM_X64 is defined when the x64 SIMD kernels are compiled in.
+// The compiler runtime detects the processor features once, before main, so
+// that __builtin_cpu_supports only reads a global: these checks are cheap and
+// safe to call from any thread.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define BATCHED_RANDOM_X64 1
+
+static inline int batched_random_has_avx2(void) {
+  return __builtin_cpu_supports("avx2");
+}
+
+static inline int batched_random_has_avx512(void) {
+  return __builtin_cpu_supports("avx512f");
+}
+
+static inline int batched_random_has_aesni(void) {
+  return __builtin_cpu_supports("aes");
+}
+#endif // x64
+
+#endif // CPU_FEATURES_H
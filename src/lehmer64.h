@@ -2,9 +2,11 @@
 #define LEHMER64_H
 #include <stdint.h>
 
+#include "random_bounded.h" // BR_DEFAULT_ENGINE, BR_SPLIT_STRIDE
 #include "splitmix64.h"
 
-__uint128_t g_lehmer64_state = UINT64_C(0x853c49e6748fea9b);
+BR_DEFAULT_ENGINE __uint128_t g_lehmer64_state =
+    UINT64_C(0x853c49e6748fea9b);
 
 /**
  * D. H. Lehmer, Mathematical methods in large-scale computing units.
@@ -23,4 +25,82 @@ static inline uint64_t lehmer64() {
   return (uint64_t)(g_lehmer64_state >> 64);
 }
 
+// Moves the state `state` delta steps ahead in O(log delta) time: the
+// multiplier is raised to the power delta (modulo 2^128) by squaring.
+static inline void lehmer64_advance_r(__uint128_t *state, __uint128_t delta) {
+  __uint128_t acc_mult = 1;
+  __uint128_t cur_mult = UINT64_C(0xda942042e4dd58b5);
+  while (delta > 0) {
+    if (delta & 1) {
+      acc_mult *= cur_mult;
+    }
+    cur_mult *= cur_mult;
+    delta >>= 1;
+  }
+  *state *= acc_mult;
+}
+
+static inline void lehmer64_advance(__uint128_t delta) {
+  lehmer64_advance_r(&g_lehmer64_state, delta);
+}
+
+// Four Lehmer generators in lanes: lehmer64x4_r fills four words with four
+// independent multiplications, which can all be in flight at once. Lane j
+// follows the stream of lehmer64_seed(seed) from output
+// (j + 1) * BR_SPLIT_STRIDE, so that the lanes overlap neither each other nor
+// lehmer64().
+typedef struct {
+  __uint128_t state[4];
+} lehmer64x4_t;
+
+// the state of lehmer64x4_seed(0), so that the lanes never start at zero
+BR_DEFAULT_ENGINE lehmer64x4_t g_lehmer64x4 = {
+    {((__uint128_t)UINT64_C(0x71e5f059fd528345) << 64) +
+         UINT64_C(0x12e963e182bef20b),
+     ((__uint128_t)UINT64_C(0x453ed8249deb4691) << 64) +
+         UINT64_C(0x5ec6b441de81fa57),
+     ((__uint128_t)UINT64_C(0xcfce70478bb3ca5c) << 64) +
+         UINT64_C(0x3115348d5604b053),
+     ((__uint128_t)UINT64_C(0x3c90395461cf7734) << 64) +
+         UINT64_C(0x5a52e832ef52acbf)}};
+
+static inline void lehmer64x4_seed_r(lehmer64x4_t *g, uint64_t seed) {
+  __uint128_t state = (((__uint128_t)splitmix64_stateless(seed)) << 64) +
+                      splitmix64_stateless(seed + 1);
+  for (int j = 0; j < 4; j++) {
+    lehmer64_advance_r(&state, BR_SPLIT_STRIDE);
+    g->state[j] = state;
+  }
+}
+
+// Advances the lanes j whose bit is set in `lanes` (0xF for all four) and
+// writes their next word to out[j]; the other words of out are left alone.
+static inline void lehmer64x4_r(lehmer64x4_t *g, uint64_t *out,
+                                uint64_t lanes) {
+  // out could alias the state: update copies so that the stores to out do
+  // not force reloads
+  __uint128_t s[4];
+  for (int j = 0; j < 4; j++) {
+    s[j] = g->state[j] * UINT64_C(0xda942042e4dd58b5);
+  }
+  for (int j = 0; j < 4; j++) {
+    if ((lanes >> j) & 1) {
+      g->state[j] = s[j];
+    }
+  }
+  for (int j = 0; j < 4; j++) {
+    if ((lanes >> j) & 1) {
+      out[j] = (uint64_t)(s[j] >> 64);
+    }
+  }
+}
+
+static inline void lehmer64x4_seed(uint64_t seed) {
+  lehmer64x4_seed_r(&g_lehmer64x4, seed);
+}
+
+static inline void lehmer64x4(uint64_t *out, uint64_t lanes) {
+  lehmer64x4_r(&g_lehmer64x4, out, lanes);
+}
+
 #endif
@@ -2,6 +2,7 @@
 #define PCG64_H
 
 /* Modified by D. Lemire based on original code by M. O'Neill, August 2017 */
+#include "random_bounded.h" // BR_DEFAULT_ENGINE, BR_SPLIT_STRIDE
 #include "splitmix64.h" // we are going to leverage splitmix64 to generate the seed
 #include <stdint.h>
 
@@ -23,6 +24,32 @@ inline void pcg_setseq_128_step_r(struct pcg_state_setseq_128 *rng) {
   rng->state = rng->state * PCG_DEFAULT_MULTIPLIER_128 + rng->inc;
 }
 
+// Multi-step advance functions (jump-ahead, jump-back), from O'Neill's
+// pcg-advance-128.c: the affine map x -> cur_mult * x + cur_plus is composed
+// with itself delta times in O(log delta) steps.
+static inline pcg128_t pcg_advance_lcg_128(pcg128_t state, pcg128_t delta,
+                                           pcg128_t cur_mult,
+                                           pcg128_t cur_plus) {
+  pcg128_t acc_mult = 1u;
+  pcg128_t acc_plus = 0u;
+  while (delta > 0) {
+    if (delta & 1) {
+      acc_mult *= cur_mult;
+      acc_plus = acc_plus * cur_mult + cur_plus;
+    }
+    cur_plus = (cur_mult + 1) * cur_plus;
+    cur_mult *= cur_mult;
+    delta /= 2;
+  }
+  return acc_mult * state + acc_plus;
+}
+
+static inline void pcg_setseq_128_advance_r(struct pcg_state_setseq_128 *rng,
+                                            pcg128_t delta) {
+  rng->state = pcg_advance_lcg_128(rng->state, delta,
+                                   PCG_DEFAULT_MULTIPLIER_128, rng->inc);
+}
+
 inline void pcg_setseq_128_srandom_r(struct pcg_state_setseq_128 *rng,
                                      pcg128_t initstate, pcg128_t initseq) {
   rng->state = 0U;
@@ -49,10 +76,9 @@ pcg_setseq_128_xsl_rr_64_random_r(struct pcg_state_setseq_128 *rng) {
 }
 
 // use use a global state:
-pcg64_random_t pcg64_global; // global state
+BR_DEFAULT_ENGINE pcg64_random_t pcg64_global; // global state
 
-// call this once before calling pcg64_random_r
-inline void pcg64_seed(uint64_t seed) {
+static inline void pcg64_seed_r(pcg64_random_t *rng, uint64_t seed) {
   pcg128_t initstate =
       PCG_128BIT_CONSTANT(splitmix64_stateless_offset(seed, 0),
                           splitmix64_stateless_offset(seed, 1));
@@ -61,11 +87,70 @@ inline void pcg64_seed(uint64_t seed) {
                                          splitmix64_stateless_offset(seed, 3));
   initseq |= 1; // should not be necessary, but let us be careful.
 
-  pcg_setseq_128_srandom_r(&pcg64_global, initstate, initseq);
+  pcg_setseq_128_srandom_r(rng, initstate, initseq);
+}
+
+// call this once before calling pcg64_random_r
+static inline void pcg64_seed(uint64_t seed) {
+  pcg64_seed_r(&pcg64_global, seed);
 }
 
 #define pcg64_random_r pcg_setseq_128_xsl_rr_64_random_r
+#define pcg64_advance_r pcg_setseq_128_advance_r
 
 static inline uint64_t pcg64(void) { return pcg64_random_r(&pcg64_global); }
 
+// Four PCG generators in lanes, see lehmer64x4: lane j follows the stream of
+// pcg64_seed(seed) from output (j + 1) * BR_SPLIT_STRIDE.
+typedef struct {
+  pcg128_t state[4];
+  pcg128_t inc;
+} pcg64x4_random_t;
+
+// the state of pcg64x4_seed(0), so that the lanes never start at zero
+BR_DEFAULT_ENGINE pcg64x4_random_t pcg64x4_global = {
+    {PCG_128BIT_CONSTANT(0x20b910fdc3da7969ULL, 0x2d93c9a310e4cb8dULL),
+     PCG_128BIT_CONSTANT(0xef30725f58d76c1bULL, 0x3ce8628dedea7560ULL),
+     PCG_128BIT_CONSTANT(0x3f70b862e0ee2a25ULL, 0x68bdd8eb47fb480fULL),
+     PCG_128BIT_CONSTANT(0x3282c3f7361befeaULL, 0xd6ee178908da184aULL)},
+    PCG_128BIT_CONSTANT(0x0d88ba3100128a9fULL, 0xf1177150e49903dbULL)};
+
+static inline void pcg64x4_seed_r(pcg64x4_random_t *rng, uint64_t seed) {
+  pcg64_random_t lane;
+  pcg64_seed_r(&lane, seed);
+  for (int j = 0; j < 4; j++) {
+    pcg_setseq_128_advance_r(&lane, BR_SPLIT_STRIDE);
+    rng->state[j] = lane.state;
+  }
+  rng->inc = lane.inc;
+}
+
+// Same as lehmer64x4_r: only the lanes set in `lanes` advance.
+static inline void pcg64x4_random_r(pcg64x4_random_t *rng, uint64_t *out,
+                                    uint64_t lanes) {
+  // same as lehmer64x4_r: out could alias the state
+  pcg128_t s[4];
+  for (int j = 0; j < 4; j++) {
+    s[j] = rng->state[j] * PCG_DEFAULT_MULTIPLIER_128 + rng->inc;
+  }
+  for (int j = 0; j < 4; j++) {
+    if ((lanes >> j) & 1) {
+      rng->state[j] = s[j];
+    }
+  }
+  for (int j = 0; j < 4; j++) {
+    if ((lanes >> j) & 1) {
+      out[j] = pcg_output_xsl_rr_128_64(s[j]);
+    }
+  }
+}
+
+static inline void pcg64x4_seed(uint64_t seed) {
+  pcg64x4_seed_r(&pcg64x4_global, seed);
+}
+
+static inline void pcg64x4(uint64_t *out, uint64_t lanes) {
+  pcg64x4_random_r(&pcg64x4_global, out, lanes);
+}
+
 #endif
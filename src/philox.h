@@ -0,0 +1,66 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+#include <stdint.h>
+
+/**
+ * Philox4x64-10, from J. K. Salmon, M. A. Moraes, R. O. Dror and D. E. Shaw,
+ * Parallel random numbers: as easy as 1, 2, 3, SC '11.
+ * https://github.com/DEShawResearch/random123
+ *
+ * A counter-based generator: a block of four words is a function of a
+ * 256-bit counter and a 128-bit key, so that the blocks can be computed in
+ * any order, by any thread.
+ */
+#define PHILOX_M4x64_0 UINT64_C(0xD2E7470EE14C6C93)
+#define PHILOX_M4x64_1 UINT64_C(0xCA5A826395121157)
+#define PHILOX_W64_0 UINT64_C(0x9E3779B97F4A7C15) // golden ratio
+#define PHILOX_W64_1 UINT64_C(0xBB67AE8584CAA73B) // sqrt(3) - 1
+
+static inline void philox4x64_10(const uint64_t ctr[4], const uint64_t key[2],
+                                 uint64_t out[4]) {
+  uint64_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+  uint64_t k0 = key[0], k1 = key[1];
+  for (int round = 0; round < 10; round++) {
+    if (round > 0) {
+      k0 += PHILOX_W64_0;
+      k1 += PHILOX_W64_1;
+    }
+    __uint128_t p0 = (__uint128_t)PHILOX_M4x64_0 * c0;
+    __uint128_t p1 = (__uint128_t)PHILOX_M4x64_1 * c2;
+    c0 = (uint64_t)(p1 >> 64) ^ c1 ^ k0;
+    c1 = (uint64_t)p1;
+    c2 = (uint64_t)(p0 >> 64) ^ c3 ^ k1;
+    c3 = (uint64_t)p0;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+// Word i of the stream of a key is word i % 4 of the block with the counter
+// (i / 4, 0, 0, 0). Writes the words [counter_start, counter_start + count)
+// to out. The blocks are independent, so that several are in flight at once.
+static inline void philox4x64_fill(const uint64_t key[2],
+                                   uint64_t counter_start, uint64_t *out,
+                                   uint64_t count) {
+  uint64_t ctr[4] = {counter_start / 4, 0, 0, 0};
+  uint64_t skip = counter_start % 4;
+  while (count > 0) {
+    if (skip == 0 && count >= 4) {
+      philox4x64_10(ctr, key, out);
+      out += 4;
+      count -= 4;
+    } else {
+      uint64_t block[4];
+      philox4x64_10(ctr, key, block);
+      for (; skip < 4 && count > 0; skip++, count--) {
+        *out++ = block[skip];
+      }
+      skip = 0;
+    }
+    ctr[0]++;
+  }
+}
+
+#endif
@@ -1,49 +1,661 @@
 
+#define _POSIX_C_SOURCE 200809L // sysconf
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "random_bounded.h"
+#include "random_bounded_inline.h"
 #include "chacha.c"
 #include "batch_shuffle_dice.c"
+#include "aes_ctr.h"
 #include "lehmer64.h"
 #include "pcg64.h"
+#include "philox.h"
+#include "romu.h"
+#include "sfc64.h"
+#include "wyrand.h"
+#include "xoshiro256pp.h"
+
+static BR_DEFAULT_ENGINE br_philox_t philox_global;
+static BR_DEFAULT_ENGINE br_aes_t aes_global;
 
 void seed(uint64_t s) {
   lehmer64_seed(s);
+  lehmer64x4_seed(s);
   pcg64_seed(s);
+  pcg64x4_seed(s);
   chacha8_zero(&chacha_rng, s); 
+  xoshiro256pp_seed(s);
+  wyrand_seed(s);
+  sfc64_seed(s);
+  romu_seed(s);
+  br_philox_seed(&philox_global, s);
+  br_aes_seed(&aes_global, s);
 }
 
 
 
 // Fisher-Yates shuffle, rolling one die at a time
 void shuffle(uint64_t *storage, uint64_t size, uint64_t (*rng)(void)) {
-  uint64_t i;
-  for (i = size; i > 1; i--) {
-    uint64_t nextpos = random_bounded(i, rng);
-    uint64_t tmp = storage[i - 1];   // likely in cache
-    uint64_t val = storage[nextpos]; // could be costly
-    storage[i - 1] = val;
-    storage[nextpos] = tmp; // you might have to read this store later
-  }
+  br_rng_fn_shuffle(rng, storage, size);
 }
 
 // Fisher-Yates shuffle, rolling up to two dice at a time
 void shuffle_batch_2(uint64_t *storage, uint64_t size, uint64_t (*rng)(void)) {
+  br_rng_fn_shuffle_2(rng, storage, size);
+}
+
+// Fisher-Yates shuffle, rolling up to six dice at a time: batches of 2 dice
+// for sizes up to 2^30 elements, then of 3, 4, 5 and 6 dice as the size goes
+// below 2^19, 2^14, 2^11 and 2^9 (br_23456_phase_end)
+void shuffle_batch_23456(uint64_t *storage, uint64_t size,
+                         uint64_t (*rng)(void)) {
+  br_rng_fn_shuffle_23456(rng, storage, size);
+}
+
+int shuffle_plan_init(shuffle_plan *plan, uint64_t size) {
+  plan->size = size;
+  plan->thresholds = NULL;
+  // The sizes above 2^30 are shuffled one die at a time, without a plan.
+  uint64_t i = size > (uint64_t)1 << 30 ? (uint64_t)1 << 30 : size;
+  uint64_t total = 0;
+  for (uint64_t k = 2; k <= 6; k++) {
+    uint64_t end = br_23456_phase_end[k - 2];
+    uint64_t count = i > end ? (i - end + k - 1) / k : 0;
+    plan->batches[k - 2] = count;
+    i -= count * k;
+    total += count;
+  }
+  if (i > 1) {
+    total++;
+  }
+  if (total == 0) {
+    return 0;
+  }
+  plan->thresholds = (uint64_t *)malloc(total * sizeof(uint64_t));
+  if (plan->thresholds == NULL) {
+    return -1;
+  }
+  uint64_t *t = plan->thresholds;
+  i = size > (uint64_t)1 << 30 ? (uint64_t)1 << 30 : size;
+  for (uint64_t k = 2; k <= 6; k++) {
+    for (uint64_t j = 0; j < plan->batches[k - 2]; j++, i -= k) {
+      uint64_t product = i;
+      for (uint64_t d = 1; d < k; d++) {
+        product *= i - d;
+      }
+      *t++ = -product % product;
+    }
+  }
+  if (i > 1) {
+    uint64_t product = i;
+    for (uint64_t d = 1; d < i - 1; d++) {
+      product *= i - d;
+    }
+    *t = -product % product;
+  }
+  return 0;
+}
+
+void shuffle_plan_free(shuffle_plan *plan) {
+  free(plan->thresholds);
+  plan->thresholds = NULL;
+}
+
+// Fisher-Yates shuffle following the schedule of shuffle_batch_23456, with
+// the batch counts and rejection thresholds taken from the plan. It produces
+// the same permutation as shuffle_batch_23456 from the same random words.
+void shuffle_with_plan(uint64_t *storage, const shuffle_plan *plan,
+                       uint64_t (*rng)(void)) {
+  uint64_t i = plan->size;
+  for (; i > 1 << 30; i--) {
+    partial_shuffle_64b(storage, i, 1, i, rng);
+  }
+
+  const uint64_t *t = plan->thresholds;
+  for (uint64_t j = plan->batches[0]; j > 0; j--, i -= 2) {
+    partial_shuffle_64b_exact(storage, i, 2, *t++, rng);
+  }
+  for (uint64_t j = plan->batches[1]; j > 0; j--, i -= 3) {
+    partial_shuffle_64b_exact(storage, i, 3, *t++, rng);
+  }
+  for (uint64_t j = plan->batches[2]; j > 0; j--, i -= 4) {
+    partial_shuffle_64b_exact(storage, i, 4, *t++, rng);
+  }
+  for (uint64_t j = plan->batches[3]; j > 0; j--, i -= 5) {
+    partial_shuffle_64b_exact(storage, i, 5, *t++, rng);
+  }
+  for (uint64_t j = plan->batches[4]; j > 0; j--, i -= 6) {
+    partial_shuffle_64b_exact(storage, i, 6, *t++, rng);
+  }
+
+  if (i > 1) {
+    partial_shuffle_64b_exact(storage, i, i - 1, *t, rng);
+  }
+}
+
+// Rolls the dice of shuffle_batch_23456 for the sizes n, n-1, ..., one whole
+// batch at a time, until at least `count` dice are rolled or the shuffle is
+// complete: dice[j] is an (n-j) sided die roll. Returns the number of dice,
+// which is at most count + 5.
+//
+// Preconditions:
+//   n <= 2^30, count >= 1
+static inline uint64_t roll_dice_23456_32b(uint64_t n, uint64_t count,
+                                           uint64_t (*rng)(void),
+                                           uint32_t *dice) {
+  // Initial bound of the batches of k dice, for k = 1, ..., 6: it is at
+  // least the product of the dice in any batch of size k that we roll.
+  static const uint64_t initial_bound[7] = {
+      0, 720, (uint64_t)1 << 60, (uint64_t)1 << 57, (uint64_t)1 << 56,
+      (uint64_t)1 << 55, (uint64_t)1 << 54};
+  uint64_t rolled = 0;
+  uint64_t k = 0;
+  uint64_t bound = 0;
+  while (rolled < count && n > 1) {
+    uint64_t next_k = n > 1 << 19 ? 2
+                    : n > 1 << 14 ? 3
+                    : n > 1 << 11 ? 4
+                    : n > 1 << 9  ? 5
+                    : n > 6       ? 6
+                                  : n - 1;
+    if (next_k != k) {
+      k = next_k;
+      bound = initial_bound[k];
+    }
+    bound = partial_shuffle_dice_32b(n, k, bound, rng, dice + rolled);
+    rolled += k;
+    n -= k;
+  }
+  return rolled;
+}
+
+// Fisher-Yates shuffle following the schedule of shuffle_batch_23456, in two
+// passes per block of `block` positions: the dice are first rolled into a
+// buffer of 32-bit indexes, and then the swaps are applied. The dice pass
+// does not wait on memory, and the buffer stays in cache. It produces the
+// same permutation as shuffle_batch_23456 from the same random words.
+void shuffle_batch_23456_blocked(uint64_t *storage, uint64_t size,
+                                 uint64_t block, uint64_t (*rng)(void)) {
+  uint32_t dice[SHUFFLE_MAX_BLOCK + 5];
+  if (block == 0) {
+    block = 1;
+  } else if (block > SHUFFLE_MAX_BLOCK) {
+    block = SHUFFLE_MAX_BLOCK;
+  }
   uint64_t i = size;
   for (; i > 1 << 30; i--) {
     partial_shuffle_64b(storage, i, 1, i, rng);
   }
 
-  // Batches of 2 for sizes up to 2^30 elements
-  uint64_t bound = (uint64_t)1 << 60;
-  for (; i > 1; i -= 2) {
-    bound = partial_shuffle_64b(storage, i, 2, bound, rng);
+  while (i > 1) {
+    uint64_t rolled = roll_dice_23456_32b(i, block, rng, dice);
+    for (uint64_t j = 0; j < rolled; j++) {
+      uint64_t pos1 = i - j - 1;
+      uint64_t pos2 = dice[j];
+      uint64_t val1 = storage[pos1]; // should be in cache
+      uint64_t val2 = storage[pos2]; // might not be in cache
+      storage[pos1] = val2;
+      storage[pos2] = val1;
+    }
+    i -= rolled;
   }
 }
 
-// Fisher-Yates shuffle, rolling up to six dice at a time
-void shuffle_batch_23456(uint64_t *storage, uint64_t size,
-                         uint64_t (*rng)(void)) {
+// Picks the lookahead of shuffle_batch_23456_prefetch: arrays of up to
+// 2^19 elements (4 MB) are expected to stay in cache and do not prefetch.
+static inline uint64_t shuffle_prefetch_distance(uint64_t size) {
+  return size <= 1 << 19 ? 0 : SHUFFLE_DEFAULT_PREFETCH;
+}
+
+// Fisher-Yates shuffle following the schedule of shuffle_batch_23456, with
+// the dice rolled `distance` positions ahead of the swaps: as soon as a
+// batch is rolled, the slots it targets are prefetched, and they are swapped
+// once the earlier positions are done. The swaps are applied in the usual
+// order and read the values when they happen, so a slot that was already
+// swapped by an earlier batch is handled correctly: it produces the same
+// permutation as shuffle_batch_23456 from the same random words.
+void shuffle_batch_23456_prefetch(uint64_t *storage, uint64_t size,
+                                  uint64_t distance, uint64_t (*rng)(void)) {
+  // Initial bound of the batches of k dice, for k = 1, ..., 6.
+  static const uint64_t initial_bound[7] = {
+      0, 720, (uint64_t)1 << 60, (uint64_t)1 << 57, (uint64_t)1 << 56,
+      (uint64_t)1 << 55, (uint64_t)1 << 54};
+  uint64_t dice[SHUFFLE_PREFETCH_RING]; // dice[j % SHUFFLE_PREFETCH_RING] is
+                                        // the die of position size - j - 1
+  uint64_t batch[6];
+  if (distance == SHUFFLE_AUTO_PREFETCH) {
+    distance = shuffle_prefetch_distance(size);
+  } else if (distance > SHUFFLE_MAX_PREFETCH) {
+    distance = SHUFFLE_MAX_PREFETCH;
+  }
+  if (distance == 0) {
+    shuffle_batch_23456(storage, size, rng);
+    return;
+  }
+  uint64_t rolled = 0;
+  uint64_t swapped = 0;
+  uint64_t k = 0;
+  uint64_t bound = 0;
+  for (uint64_t n = size; n > 1; n -= k) {
+    if (n > 1 << 30) {
+      k = 1;
+      bound = n;
+    } else {
+      uint64_t next_k = n > 1 << 19 ? 2
+                      : n > 1 << 14 ? 3
+                      : n > 1 << 11 ? 4
+                      : n > 1 << 9  ? 5
+                      : n > 6       ? 6
+                                    : n - 1;
+      if (next_k != k) {
+        k = next_k;
+        bound = initial_bound[k];
+      }
+    }
+    bound = partial_shuffle_dice_64b(n, k, bound, rng, batch);
+    for (uint64_t j = 0; j < k; j++) {
+      __builtin_prefetch(storage + batch[j], 1);
+      dice[(rolled + j) % SHUFFLE_PREFETCH_RING] = batch[j];
+    }
+    rolled += k;
+    for (; rolled - swapped > distance; swapped++) {
+      uint64_t pos1 = size - swapped - 1;
+      uint64_t pos2 = dice[swapped % SHUFFLE_PREFETCH_RING];
+      uint64_t val1 = storage[pos1];
+      uint64_t val2 = storage[pos2]; // should have been prefetched
+      storage[pos1] = val2;
+      storage[pos2] = val1;
+    }
+  }
+  for (; swapped < rolled; swapped++) {
+    uint64_t pos1 = size - swapped - 1;
+    uint64_t pos2 = dice[swapped % SHUFFLE_PREFETCH_RING];
+    uint64_t val1 = storage[pos1];
+    uint64_t val2 = storage[pos2];
+    storage[pos1] = val2;
+    storage[pos2] = val1;
+  }
+}
+
+// Buckets of the bucketed shuffle: the bucket id of an element is 5 random
+// bits (twelve ids per call to rng), and buckets of up to
+// SHUFFLE_BUCKET_LEAF elements (1 MB) are shuffled in cache with
+// shuffle_batch_23456. A larger fan-out makes the scatter much slower (TLB
+// misses), even with write-combining buffers.
+#define SHUFFLE_BUCKET_BITS 5
+#define SHUFFLE_BUCKETS (1 << SHUFFLE_BUCKET_BITS)
+#define SHUFFLE_BUCKET_LEAF ((uint64_t)1 << 17)
+
+// Sends every element of src to a bucket of other picked uniformly at
+// random, and shuffles every bucket recursively, the roles of src and other
+// being swapped at every level. The result is in other if to_other is set,
+// in src otherwise. Since the bucket ids are independent, the bucket sizes
+// have the right (multinomial) distribution and the result is a uniformly
+// random permutation.
+//
+// other has room for size elements and ids for size bytes.
+static void shuffle_bucketed_rec(uint64_t *src, uint64_t *other, uint64_t size,
+                                 int to_other, uint8_t *ids,
+                                 uint64_t (*rng)(void)) {
+  if (size <= SHUFFLE_BUCKET_LEAF) {
+    if (to_other) {
+      memcpy(other, src, size * sizeof(uint64_t));
+      src = other;
+    }
+    shuffle_batch_23456(src, size, rng);
+    return;
+  }
+  const uint64_t per_word = 64 / SHUFFLE_BUCKET_BITS;
+  const uint64_t mask = SHUFFLE_BUCKETS - 1;
+  uint64_t count[SHUFFLE_BUCKETS] = {0};
+  uint64_t i = 0;
+  for (; i + per_word <= size; i += per_word) {
+    uint64_t r = rng();
+    for (uint64_t j = 0; j < per_word; j++, r >>= SHUFFLE_BUCKET_BITS) {
+      ids[i + j] = (uint8_t)(r & mask);
+      count[r & mask]++;
+    }
+  }
+  for (uint64_t r = rng(); i < size; i++, r >>= SHUFFLE_BUCKET_BITS) {
+    ids[i] = (uint8_t)(r & mask);
+    count[r & mask]++;
+  }
+
+  uint64_t offset[SHUFFLE_BUCKETS];
+  uint64_t start = 0;
+  for (uint64_t b = 0; b < SHUFFLE_BUCKETS; b++) {
+    offset[b] = start;
+    start += count[b];
+  }
+  for (i = 0; i < size; i++) {
+    other[offset[ids[i]]++] = src[i];
+  }
+
+  start = 0;
+  for (uint64_t b = 0; b < SHUFFLE_BUCKETS; b++) {
+    shuffle_bucketed_rec(other + start, src + start, count[b], !to_other,
+                         ids + start, rng);
+    start += count[b];
+  }
+}
+
+// Uniform shuffle for arrays that do not fit in cache: the elements are
+// scattered into buckets that do, which are then shuffled one at a time.
+// It needs 9 bytes of temporary memory per element; if they cannot be
+// allocated, it falls back on shuffle_batch_23456_prefetch.
+void shuffle_batch_bucketed(uint64_t *storage, uint64_t size,
+                            uint64_t (*rng)(void)) {
+  if (size <= SHUFFLE_BUCKET_LEAF) {
+    shuffle_batch_23456(storage, size, rng);
+    return;
+  }
+  uint64_t *buffer = (uint64_t *)malloc(size * sizeof(uint64_t));
+  uint8_t *ids = (uint8_t *)malloc(size);
+  if (buffer == NULL || ids == NULL) {
+    free(buffer);
+    free(ids);
+    shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH, rng);
+    return;
+  }
+  shuffle_bucketed_rec(storage, buffer, size, 0, ids, rng);
+  free(buffer);
+  free(ids);
+}
+
+// Every thread of the parallel shuffles has its own lehmer64 generator.
+static _Thread_local __uint128_t parallel_lehmer64_state;
+
+// Seeds the generator of the calling thread with the stream-th substream of
+// seed.
+static void parallel_lehmer64_seed(uint64_t seed, uint64_t stream) {
+  parallel_lehmer64_state =
+      ((((__uint128_t)splitmix64_stateless_offset(seed, 2 * stream)) << 64) +
+       splitmix64_stateless_offset(seed, 2 * stream + 1)) |
+      1; // an odd state has the full period
+}
+
+static uint64_t parallel_lehmer64(void) {
+  parallel_lehmer64_state *= UINT64_C(0xda942042e4dd58b5);
+  return (uint64_t)(parallel_lehmer64_state >> 64);
+}
+
+// State shared by the threads of the parallel shuffles. The array is split
+// into `chunks` chunks, and every chunk rolls its bucket ids from its own
+// substream of seed. The buckets are shuffled with the substream of the
+// thread or, if deterministic is set, with the substream of the bucket, so
+// that the permutation does not depend on the threads.
+typedef struct {
+  uint64_t *storage;
+  uint64_t *buffer;
+  uint8_t *ids;
+  uint64_t size;
+  uint64_t seed;
+  uint64_t nthreads;
+  uint64_t chunks;
+  uint64_t bits; // the bucket id of an element is `bits` random bits
+  int deterministic;
+  // counts[c << bits | b] is the number of elements of chunk c in bucket b,
+  // and then the offset of these elements in buffer
+  uint64_t *counts;
+  uint64_t *bucket_start;
+  atomic_uint_fast64_t next_task;
+} parallel_shuffle_job;
+
+typedef struct {
+  parallel_shuffle_job *job;
+  uint64_t t;
+} parallel_shuffle_task;
+
+// Chunk c has the elements [chunk_start(c), chunk_start(c+1)).
+static inline uint64_t parallel_chunk_start(const parallel_shuffle_job *job,
+                                            uint64_t c) {
+  return (uint64_t)((__uint128_t)job->size * c / job->chunks);
+}
+
+// First pass: rolls the bucket ids of the elements of every chunk and counts
+// the elements of every bucket.
+static void *parallel_shuffle_count(void *arg) {
+  parallel_shuffle_job *job = ((parallel_shuffle_task *)arg)->job;
+  const uint64_t per_word = 64 / job->bits;
+  const uint64_t mask = ((uint64_t)1 << job->bits) - 1;
+  for (;;) {
+    uint64_t c = atomic_fetch_add(&job->next_task, 1);
+    if (c >= job->chunks) {
+      break;
+    }
+    parallel_lehmer64_seed(job->seed, c);
+    uint64_t *count = job->counts + (c << job->bits);
+    uint64_t i = parallel_chunk_start(job, c);
+    uint64_t end = parallel_chunk_start(job, c + 1);
+    for (; i + per_word <= end; i += per_word) {
+      uint64_t r = parallel_lehmer64();
+      for (uint64_t j = 0; j < per_word; j++, r >>= job->bits) {
+        job->ids[i + j] = (uint8_t)(r & mask);
+        count[r & mask]++;
+      }
+    }
+    for (uint64_t r = parallel_lehmer64(); i < end; i++, r >>= job->bits) {
+      job->ids[i] = (uint8_t)(r & mask);
+      count[r & mask]++;
+    }
+  }
+  return NULL;
+}
+
+// Second pass: moves the elements of every chunk to their buckets.
+static void *parallel_shuffle_scatter(void *arg) {
+  parallel_shuffle_job *job = ((parallel_shuffle_task *)arg)->job;
+  for (;;) {
+    uint64_t c = atomic_fetch_add(&job->next_task, 1);
+    if (c >= job->chunks) {
+      break;
+    }
+    uint64_t *offset = job->counts + (c << job->bits);
+    uint64_t end = parallel_chunk_start(job, c + 1);
+    for (uint64_t i = parallel_chunk_start(job, c); i < end; i++) {
+      job->buffer[offset[job->ids[i]]++] = job->storage[i];
+    }
+  }
+  return NULL;
+}
+
+// Last pass: the threads take the buckets one at a time and shuffle them
+// back into storage.
+static void *parallel_shuffle_buckets(void *arg) {
+  parallel_shuffle_task *task = (parallel_shuffle_task *)arg;
+  parallel_shuffle_job *job = task->job;
+  const uint64_t buckets = (uint64_t)1 << job->bits;
+  if (!job->deterministic) {
+    parallel_lehmer64_seed(job->seed, job->chunks + task->t);
+  }
+  for (;;) {
+    uint64_t b = atomic_fetch_add(&job->next_task, 1);
+    if (b >= buckets) {
+      break;
+    }
+    if (job->deterministic) {
+      parallel_lehmer64_seed(job->seed, job->chunks + b);
+    }
+    uint64_t start = job->bucket_start[b];
+    uint64_t count = job->bucket_start[b + 1] - start;
+    shuffle_bucketed_rec(job->buffer + start, job->storage + start, count, 1,
+                         job->ids + start, parallel_lehmer64);
+  }
+  return NULL;
+}
+
+// Runs fn in job->nthreads threads. If a thread cannot be created, its task
+// runs in the calling thread.
+static void parallel_shuffle_run(parallel_shuffle_job *job,
+                                 void *(*fn)(void *)) {
+  pthread_t threads[SHUFFLE_MAX_THREADS];
+  parallel_shuffle_task tasks[SHUFFLE_MAX_THREADS];
+  int started[SHUFFLE_MAX_THREADS];
+  atomic_init(&job->next_task, 0);
+  for (uint64_t t = 0; t < job->nthreads; t++) {
+    tasks[t].job = job;
+    tasks[t].t = t;
+    started[t] =
+        t > 0 && pthread_create(&threads[t], NULL, fn, &tasks[t]) == 0;
+  }
+  for (uint64_t t = 0; t < job->nthreads; t++) {
+    if (!started[t]) {
+      fn(&tasks[t]);
+    }
+  }
+  for (uint64_t t = 1; t < job->nthreads; t++) {
+    if (started[t]) {
+      pthread_join(threads[t], NULL);
+    }
+  }
+}
+
+// 0 stands for one thread per processor.
+static uint64_t parallel_thread_count(uint64_t nthreads) {
+  if (nthreads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = cpus > 0 ? (uint64_t)cpus : 1;
+  }
+  return nthreads > SHUFFLE_MAX_THREADS ? SHUFFLE_MAX_THREADS : nthreads;
+}
+
+// Scatters the elements into 2^bits random buckets, in chunks chunks, and
+// shuffles the buckets, using nthreads threads.
+static void parallel_shuffle(uint64_t *storage, uint64_t size,
+                             uint64_t nthreads, uint64_t seed, uint64_t chunks,
+                             uint64_t bits, int deterministic) {
+  parallel_shuffle_job job;
+  job.storage = storage;
+  job.size = size;
+  job.seed = seed;
+  job.nthreads = nthreads;
+  job.chunks = chunks;
+  job.bits = bits;
+  job.deterministic = deterministic;
+  const uint64_t buckets = (uint64_t)1 << bits;
+  job.buffer = (uint64_t *)malloc(size * sizeof(uint64_t));
+  job.ids = (uint8_t *)malloc(size);
+  job.counts = (uint64_t *)calloc(chunks << bits, sizeof(uint64_t));
+  job.bucket_start = (uint64_t *)malloc((buckets + 1) * sizeof(uint64_t));
+  if (job.buffer == NULL || job.ids == NULL || job.counts == NULL ||
+      job.bucket_start == NULL) {
+    free(job.buffer);
+    free(job.ids);
+    free(job.counts);
+    free(job.bucket_start);
+    parallel_lehmer64_seed(seed, 0);
+    shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH,
+                                 parallel_lehmer64);
+    return;
+  }
+
+  parallel_shuffle_run(&job, parallel_shuffle_count);
+  // The elements of bucket b from chunk c go after those of the chunks
+  // before c.
+  uint64_t offset = 0;
+  for (uint64_t b = 0; b < buckets; b++) {
+    job.bucket_start[b] = offset;
+    for (uint64_t c = 0; c < chunks; c++) {
+      uint64_t count = job.counts[c << bits | b];
+      job.counts[c << bits | b] = offset;
+      offset += count;
+    }
+  }
+  job.bucket_start[buckets] = offset;
+  parallel_shuffle_run(&job, parallel_shuffle_scatter);
+  parallel_shuffle_run(&job, parallel_shuffle_buckets);
+
+  free(job.buffer);
+  free(job.ids);
+  free(job.counts);
+  free(job.bucket_start);
+}
+
+// Uniform shuffle using nthreads threads: the elements are scattered into
+// random buckets in parallel, and the buckets are then shuffled in parallel
+// with shuffle_bucketed_rec. There is one chunk per thread, and at least
+// four buckets per thread.
+void shuffle_parallel(uint64_t *storage, uint64_t size, uint64_t nthreads,
+                      uint64_t seed) {
+  nthreads = parallel_thread_count(nthreads);
+  if (nthreads == 1 || size <= SHUFFLE_PARALLEL_MIN) {
+    parallel_lehmer64_seed(seed, 0);
+    shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH,
+                                 parallel_lehmer64);
+    return;
+  }
+  // at least 32 and at most 256 buckets
+  uint64_t bits = 5;
+  while (bits < 8 && ((uint64_t)1 << bits) < 4 * nthreads) {
+    bits++;
+  }
+  parallel_shuffle(storage, size, nthreads, seed, nthreads, bits, 0);
+}
+
+// Same as shuffle_parallel, but the work is split into a fixed number of
+// chunks and buckets, each with its own substream of seed: the permutation
+// only depends on seed.
+void shuffle_parallel_deterministic(uint64_t *storage, uint64_t size,
+                                    uint64_t nthreads, uint64_t seed) {
+  if (size <= SHUFFLE_PARALLEL_MIN) {
+    parallel_lehmer64_seed(seed, 0);
+    shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH,
+                                 parallel_lehmer64);
+    return;
+  }
+  parallel_shuffle(storage, size, parallel_thread_count(nthreads), seed,
+                   SHUFFLE_DETERMINISTIC_CHUNKS, 8, 1);
+}
+
+// Applies the dice produced by an interleaved kernel: dice[i] is an (n-i)
+// sided die roll.
+__attribute__((always_inline)) static inline void
+swap_dice_64b(uint64_t *storage, uint64_t n, uint64_t count,
+              const uint64_t *dice) {
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t pos1 = n - i - 1;
+    uint64_t pos2 = dice[i];
+    uint64_t val1 = storage[pos1]; // should be in cache
+    uint64_t val2 = storage[pos2]; // might not be in cache
+    storage[pos1] = val2;
+    storage[pos2] = val1;
+  }
+}
+
+typedef uint64_t (*interleaved_dice_kernel)(uint64_t n, uint64_t k,
+                                            uint64_t bound,
+                                            uint64_t (*rng)(void),
+                                            uint64_t *result);
+typedef uint64_t (*lanes_dice_kernel)(uint64_t n, uint64_t k, uint64_t bound,
+                                      void *state4, lanes_rng rng4,
+                                      uint64_t *result);
+
+// Rolls the interleaved batches with `dice` and rng or, when lanes_dice is
+// not NULL, with lanes_dice and the four-lane generator rng4 on state4.
+__attribute__((always_inline)) static inline uint64_t
+roll_interleaved(uint64_t n, uint64_t k, uint64_t bound, uint64_t (*rng)(void),
+                 interleaved_dice_kernel dice, void *state4, lanes_rng rng4,
+                 lanes_dice_kernel lanes_dice, uint64_t *result) {
+  if (lanes_dice != NULL) {
+    return lanes_dice(n, k, bound, state4, rng4, result);
+  }
+  return dice(n, k, bound, rng, result);
+}
+
+// Fisher-Yates shuffle following the same schedule as shuffle_batch_23456,
+// but rolling `lanes` batches at once with an interleaved kernel. rng rolls
+// the dice that are not interleaved.
+__attribute__((always_inline)) static inline void
+shuffle_batch_23456_interleaved(uint64_t *storage, uint64_t size,
+                                uint64_t (*rng)(void), uint64_t lanes,
+                                interleaved_dice_kernel dice, void *state4,
+                                lanes_rng rng4, lanes_dice_kernel lanes_dice) {
+  uint64_t result[8 * 6]; // We know that lanes <= 8 and k <= 6
   uint64_t i = size;
   for (; i > 1 << 30; i--) {
     partial_shuffle_64b(storage, i, 1, i, rng);
@@ -51,30 +663,44 @@ void shuffle_batch_23456(uint64_t *storage, uint64_t size,
 
   // Batches of 2 for sizes up to 2^30 elements
   uint64_t bound = (uint64_t)1 << 60;
-  for (; i > 1 << 19; i -= 2) {
-    bound = partial_shuffle_64b(storage, i, 2, bound, rng);
+  for (; i > 1 << 19; i -= 2 * lanes) {
+    bound = roll_interleaved(i, 2, bound, rng, dice, state4, rng4, lanes_dice,
+                             result);
+    swap_dice_64b(storage, i, 2 * lanes, result);
   }
 
   // Batches of 3 for sizes up to 2^19 elements
   bound = (uint64_t)1 << 57;
-  for (; i > 1 << 14; i -= 3) {
-    bound = partial_shuffle_64b(storage, i, 3, bound, rng);
+  for (; i > 1 << 14; i -= 3 * lanes) {
+    bound = roll_interleaved(i, 3, bound, rng, dice, state4, rng4, lanes_dice,
+                             result);
+    swap_dice_64b(storage, i, 3 * lanes, result);
   }
 
   // Batches of 4 for sizes up to 2^14 elements
   bound = (uint64_t)1 << 56;
-  for (; i > 1 << 11; i -= 4) {
-    bound = partial_shuffle_64b(storage, i, 4, bound, rng);
+  for (; i > 1 << 11; i -= 4 * lanes) {
+    bound = roll_interleaved(i, 4, bound, rng, dice, state4, rng4, lanes_dice,
+                             result);
+    swap_dice_64b(storage, i, 4 * lanes, result);
   }
 
   // Batches of 5 for sizes up to 2^11 elements
   bound = (uint64_t)1 << 55;
-  for (; i > 1 << 9; i -= 5) {
-    bound = partial_shuffle_64b(storage, i, 5, bound, rng);
+  for (; i > 1 << 9; i -= 5 * lanes) {
+    bound = roll_interleaved(i, 5, bound, rng, dice, state4, rng4, lanes_dice,
+                             result);
+    swap_dice_64b(storage, i, 5 * lanes, result);
   }
 
-  // Batches of 6 for sizes up to 2^9 elements
+  // Batches of 6 for sizes up to 2^9 elements, while we have enough
+  // elements for all the lanes
   bound = (uint64_t)1 << 54;
+  for (; i > 6 * lanes; i -= 6 * lanes) {
+    bound = roll_interleaved(i, 6, bound, rng, dice, state4, rng4, lanes_dice,
+                             result);
+    swap_dice_64b(storage, i, 6 * lanes, result);
+  }
   for (; i > 6; i -= 6) {
     bound = partial_shuffle_64b(storage, i, 6, bound, rng);
   }
@@ -84,6 +710,151 @@ void shuffle_batch_23456(uint64_t *storage, uint64_t size,
   }
 }
 
+#ifdef BATCHED_RANDOM_X64
+// The interleaved shuffle compiled for AVX2 (resp. AVX-512) so that the SIMD
+// kernel gets inlined. The kernels are only called for sizes up to 2^30.
+__attribute__((target("avx2"))) static void
+shuffle_batch_23456_4x_avx2(uint64_t *storage, uint64_t size,
+                            uint64_t (*rng)(void)) {
+  shuffle_batch_23456_interleaved(storage, size, rng, 4,
+                                  partial_shuffle_dice_64b_interleaved_4x_avx2,
+                                  NULL, NULL, NULL);
+}
+
+__attribute__((target("avx2"))) static void
+shuffle_batch_23456_lanes_avx2(uint64_t *storage, uint64_t size,
+                               uint64_t (*rng)(void),
+                               void (*rng4)(uint64_t *, uint64_t)) {
+  shuffle_batch_23456_interleaved(storage, size, rng, 4, NULL, &rng4,
+                                  lanes_rng_global, lanes_dice_64b_4x_avx2);
+}
+
+__attribute__((target("avx512f"))) static void
+shuffle_batch_23456_8x_avx512(uint64_t *storage, uint64_t size,
+                              uint64_t (*rng)(void)) {
+  shuffle_batch_23456_interleaved(
+      storage, size, rng, 8, partial_shuffle_dice_64b_interleaved_8x_avx512,
+      NULL, NULL, NULL);
+}
+#endif
+
+// Fisher-Yates shuffle, rolling up to six dice at a time in four interleaved
+// batches (AVX2 when available)
+void shuffle_batch_23456_4x(uint64_t *storage, uint64_t size,
+                            uint64_t (*rng)(void)) {
+#ifdef BATCHED_RANDOM_X64
+  if (batched_random_has_avx2()) {
+    shuffle_batch_23456_4x_avx2(storage, size, rng);
+    return;
+  }
+#endif
+  shuffle_batch_23456_interleaved(storage, size, rng, 4,
+                                  partial_shuffle_dice_64b_interleaved_4x, NULL,
+                                  NULL, NULL);
+}
+
+// Fisher-Yates shuffle, rolling up to six dice at a time in four interleaved
+// batches, batch j drawing from lane j of rng4 (AVX2 when available)
+void shuffle_batch_23456_lanes(uint64_t *storage, uint64_t size,
+                               uint64_t (*rng)(void),
+                               void (*rng4)(uint64_t *, uint64_t)) {
+#ifdef BATCHED_RANDOM_X64
+  if (batched_random_has_avx2()) {
+    shuffle_batch_23456_lanes_avx2(storage, size, rng, rng4);
+    return;
+  }
+#endif
+  shuffle_batch_23456_interleaved(storage, size, rng, 4, NULL, &rng4,
+                                  lanes_rng_global, lanes_dice_64b_4x);
+}
+
+// The engines with lanes, with the generators known so that they get
+// inlined. The shuffles work on a copy of the four states, written back once
+// at the end, so that the states can stay in registers.
+static inline void lehmer64x4_lanes(void *g, uint64_t *out, uint64_t lanes) {
+  lehmer64x4_r((lehmer64x4_t *)g, out, lanes);
+}
+
+static inline void pcg64x4_lanes(void *g, uint64_t *out, uint64_t lanes) {
+  pcg64x4_random_r((pcg64x4_random_t *)g, out, lanes);
+}
+
+__attribute__((always_inline)) static inline void
+shuffle_lehmer_23456_lanes_with(uint64_t *storage, uint64_t size,
+                                lanes_dice_kernel lanes_dice) {
+  lehmer64x4_t g = g_lehmer64x4;
+  shuffle_batch_23456_interleaved(storage, size, lehmer64, 4, NULL, &g,
+                                  lehmer64x4_lanes, lanes_dice);
+  g_lehmer64x4 = g;
+}
+
+__attribute__((always_inline)) static inline void
+shuffle_pcg_23456_lanes_with(uint64_t *storage, uint64_t size,
+                             lanes_dice_kernel lanes_dice) {
+  pcg64x4_random_t g = pcg64x4_global;
+  shuffle_batch_23456_interleaved(storage, size, pcg64, 4, NULL, &g,
+                                  pcg64x4_lanes, lanes_dice);
+  pcg64x4_global = g;
+}
+
+#ifdef BATCHED_RANDOM_X64
+__attribute__((target("avx2"))) static void
+shuffle_lehmer_23456_lanes_avx2(uint64_t *storage, uint64_t size) {
+  shuffle_lehmer_23456_lanes_with(storage, size, lanes_dice_64b_4x_avx2);
+}
+
+__attribute__((target("avx2"))) static void
+shuffle_pcg_23456_lanes_avx2(uint64_t *storage, uint64_t size) {
+  shuffle_pcg_23456_lanes_with(storage, size, lanes_dice_64b_4x_avx2);
+}
+#endif
+
+// Fisher-Yates shuffle, rolling up to six dice at a time in eight interleaved
+// batches (AVX-512 when available)
+void shuffle_batch_23456_8x(uint64_t *storage, uint64_t size,
+                            uint64_t (*rng)(void)) {
+#ifdef BATCHED_RANDOM_X64
+  if (batched_random_has_avx512()) {
+    shuffle_batch_23456_8x_avx512(storage, size, rng);
+    return;
+  }
+#endif
+  shuffle_batch_23456_interleaved(storage, size, rng, 8,
+                                  partial_shuffle_dice_64b_interleaved_8x, NULL,
+                                  NULL, NULL);
+}
+
+// Fisher-Yates shuffle for small arrays: up to 64 elements, all the dice are
+// rolled from 16-bit lanes following a precomputed schedule. Larger arrays
+// are shuffled with shuffle_batch_23456.
+void shuffle_batch_small(uint64_t *storage, uint64_t size,
+                         uint64_t (*rng)(void)) {
+  if (size > 64) {
+    shuffle_batch_23456(storage, size, rng);
+  } else if (size > 1) {
+    small_shuffle_16b(storage, size, rng);
+  }
+}
+
+// Fisher-Yates shuffle for arrays of more than 2^30 elements, where
+// shuffle_batch_23456 rolls one die per 64-bit word: between 2^30 and 2^40
+// elements, we roll batches of three dice from 128 random bits (two calls to
+// rng()). Smaller arrays follow the schedule of shuffle_batch_23456.
+void shuffle_batch_128(uint64_t *storage, uint64_t size,
+                       uint64_t (*rng)(void)) {
+  uint64_t i = size;
+  for (; i > (uint64_t)1 << 40; i--) {
+    partial_shuffle_64b(storage, i, 1, i, rng);
+  }
+
+  // Batches of 3 for sizes up to 2^40 elements
+  __uint128_t bound = (__uint128_t)1 << 120;
+  for (; i > 1 << 30; i -= 3) {
+    bound = partial_shuffle_128b(storage, i, 3, bound, rng);
+  }
+
+  shuffle_batch_23456(storage, i, rng);
+}
 
 // Fisher-Yates shuffle, rolling up to two dice at a time
 void naive_shuffle_batch_2(uint64_t *storage, uint64_t size, uint64_t (*rng)(void)) {
@@ -96,6 +867,591 @@ void naive_shuffle_batch_2(uint64_t *storage, uint64_t size, uint64_t (*rng)(voi
   }
 }
 
+// Swaps the elements a and b of elem_size bytes, which must not overlap: the
+// callers skip the swaps of an element with itself. The copies of a constant
+// size compile to plain (SIMD from 16 bytes) loads and stores.
+typedef void (*swap_bytes_fn)(unsigned char *a, unsigned char *b,
+                              size_t elem_size);
+
+#define BR_DEFINE_SWAP_BYTES(bytes)                                            \
+  static inline void swap_bytes_##bytes(unsigned char *a, unsigned char *b,    \
+                                        size_t elem_size) {                    \
+    (void)elem_size;                                                           \
+    unsigned char tmp[bytes];                                                  \
+    memcpy(tmp, a, bytes);                                                     \
+    memcpy(a, b, bytes);                                                       \
+    memcpy(b, tmp, bytes);                                                     \
+  }
+BR_DEFINE_SWAP_BYTES(1)
+BR_DEFINE_SWAP_BYTES(2)
+BR_DEFINE_SWAP_BYTES(4)
+BR_DEFINE_SWAP_BYTES(8)
+BR_DEFINE_SWAP_BYTES(16)
+BR_DEFINE_SWAP_BYTES(32)
+BR_DEFINE_SWAP_BYTES(64)
+
+// Any size, in pieces of 64, 16, 8 and then 1 bytes.
+static inline void swap_bytes_any(unsigned char *a, unsigned char *b,
+                                  size_t elem_size) {
+  for (; elem_size >= 64; elem_size -= 64, a += 64, b += 64) {
+    swap_bytes_64(a, b, 64);
+  }
+  for (; elem_size >= 16; elem_size -= 16, a += 16, b += 16) {
+    swap_bytes_16(a, b, 16);
+  }
+  for (; elem_size >= 8; elem_size -= 8, a += 8, b += 8) {
+    swap_bytes_8(a, b, 8);
+  }
+  for (; elem_size > 0; elem_size--, a++, b++) {
+    swap_bytes_1(a, b, 1);
+  }
+}
+
+// Applies to the elements of elem_size bytes at base the swaps of a block of
+// dice rolled for the sizes i, i-1, ...: dice[j] is swapped with i - j - 1,
+// unless they are the same position.
+// When prefetch is set, the targets of the swaps PREFETCH_BYTES_DISTANCE
+// positions ahead are prefetched, every cache line of them, since the swaps
+// would otherwise wait on memory one at a time. It is inlined in one function
+// per swap.
+#define PREFETCH_BYTES_DISTANCE 16
+typedef void (*swap_block_fn)(unsigned char *base, uint64_t i,
+                              const uint32_t *dice, uint64_t rolled,
+                              size_t elem_size, int prefetch);
+
+__attribute__((always_inline)) static inline void
+swap_bytes_block(unsigned char *base, uint64_t i, const uint32_t *dice,
+                 uint64_t rolled, size_t elem_size, int prefetch,
+                 swap_bytes_fn swap) {
+  for (uint64_t j = 0; j < rolled; j++) {
+    if (prefetch && j + PREFETCH_BYTES_DISTANCE < rolled) {
+      unsigned char *ahead =
+          base + (size_t)dice[j + PREFETCH_BYTES_DISTANCE] * elem_size;
+      for (size_t line = 0; line < elem_size; line += 64) {
+        __builtin_prefetch(ahead + line, 1);
+      }
+      __builtin_prefetch(ahead + elem_size - 1, 1);
+    }
+    if (dice[j] != i - j - 1) {
+      swap(base + (i - j - 1) * elem_size, base + (size_t)dice[j] * elem_size,
+           elem_size);
+    }
+  }
+}
+
+#define BR_DEFINE_SWAP_BYTES_BLOCK(bytes)                                      \
+  static void swap_bytes_block_##bytes(unsigned char *base, uint64_t i,        \
+                                       const uint32_t *dice, uint64_t rolled,  \
+                                       size_t elem_size, int prefetch) {       \
+    (void)elem_size;                                                           \
+    swap_bytes_block(base, i, dice, rolled, bytes, prefetch,                   \
+                     swap_bytes_##bytes);                                      \
+  }
+BR_DEFINE_SWAP_BYTES_BLOCK(1)
+BR_DEFINE_SWAP_BYTES_BLOCK(2)
+BR_DEFINE_SWAP_BYTES_BLOCK(4)
+BR_DEFINE_SWAP_BYTES_BLOCK(8)
+BR_DEFINE_SWAP_BYTES_BLOCK(16)
+BR_DEFINE_SWAP_BYTES_BLOCK(32)
+BR_DEFINE_SWAP_BYTES_BLOCK(64)
+
+static void swap_bytes_block_any(unsigned char *base, uint64_t i,
+                                 const uint32_t *dice, uint64_t rolled,
+                                 size_t elem_size, int prefetch) {
+  swap_bytes_block(base, i, dice, rolled, elem_size, prefetch, swap_bytes_any);
+}
+
+#if BATCHED_RANDOM_X64
+// With AVX2, a 32-byte element is one load and one store.
+__attribute__((target("avx2"), always_inline)) static inline void
+swap_bytes_32_avx2(unsigned char *a, unsigned char *b, size_t elem_size) {
+  (void)elem_size;
+  __m256i va = _mm256_loadu_si256((const __m256i *)a);
+  __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+  _mm256_storeu_si256((__m256i *)a, vb);
+  _mm256_storeu_si256((__m256i *)b, va);
+}
+__attribute__((target("avx2"), always_inline)) static inline void
+swap_bytes_64_avx2(unsigned char *a, unsigned char *b, size_t elem_size) {
+  (void)elem_size;
+  __m256i va0 = _mm256_loadu_si256((const __m256i *)a);
+  __m256i va1 = _mm256_loadu_si256((const __m256i *)(a + 32));
+  __m256i vb0 = _mm256_loadu_si256((const __m256i *)b);
+  __m256i vb1 = _mm256_loadu_si256((const __m256i *)(b + 32));
+  _mm256_storeu_si256((__m256i *)a, vb0);
+  _mm256_storeu_si256((__m256i *)(a + 32), vb1);
+  _mm256_storeu_si256((__m256i *)b, va0);
+  _mm256_storeu_si256((__m256i *)(b + 32), va1);
+}
+__attribute__((target("avx2"), always_inline)) static inline void
+swap_bytes_any_avx2(unsigned char *a, unsigned char *b, size_t elem_size) {
+  for (; elem_size >= 64; elem_size -= 64, a += 64, b += 64) {
+    swap_bytes_64_avx2(a, b, 64);
+  }
+  if (elem_size >= 32) {
+    swap_bytes_32_avx2(a, b, 32);
+    elem_size -= 32, a += 32, b += 32;
+  }
+  swap_bytes_any(a, b, elem_size);
+}
+
+__attribute__((target("avx2"))) static void
+swap_bytes_block_32_avx2(unsigned char *base, uint64_t i, const uint32_t *dice,
+                         uint64_t rolled, size_t elem_size, int prefetch) {
+  (void)elem_size;
+  swap_bytes_block(base, i, dice, rolled, 32, prefetch, swap_bytes_32_avx2);
+}
+__attribute__((target("avx2"))) static void
+swap_bytes_block_64_avx2(unsigned char *base, uint64_t i, const uint32_t *dice,
+                         uint64_t rolled, size_t elem_size, int prefetch) {
+  (void)elem_size;
+  swap_bytes_block(base, i, dice, rolled, 64, prefetch, swap_bytes_64_avx2);
+}
+__attribute__((target("avx2"))) static void
+swap_bytes_block_any_avx2(unsigned char *base, uint64_t i,
+                          const uint32_t *dice, uint64_t rolled,
+                          size_t elem_size, int prefetch) {
+  swap_bytes_block(base, i, dice, rolled, elem_size, prefetch,
+                   swap_bytes_any_avx2);
+}
+#endif
+
+// The swap kernel for elements of elem_size bytes: a dedicated one for the
+// common sizes, with AVX2 moves from 32 bytes when available.
+static swap_block_fn select_swap_block(size_t elem_size) {
+#if BATCHED_RANDOM_X64
+  if (elem_size >= 32 && batched_random_has_avx2()) {
+    return elem_size == 32   ? swap_bytes_block_32_avx2
+           : elem_size == 64 ? swap_bytes_block_64_avx2
+                             : swap_bytes_block_any_avx2;
+  }
+#endif
+  switch (elem_size) {
+  case 1:
+    return swap_bytes_block_1;
+  case 2:
+    return swap_bytes_block_2;
+  case 4:
+    return swap_bytes_block_4;
+  case 8:
+    return swap_bytes_block_8;
+  case 16:
+    return swap_bytes_block_16;
+  case 32:
+    return swap_bytes_block_32;
+  case 64:
+    return swap_bytes_block_64;
+  default:
+    return swap_bytes_block_any;
+  }
+}
+
+// Fisher-Yates shuffle of ncols arrays of count elements, with the schedule
+// of shuffle_batch_23456: from the same random words, the elements of every
+// array end up in the same order as the words of shuffle_batch_23456. As in
+// shuffle_batch_23456_blocked, the dice are rolled a block at a time, and the
+// swaps of the block are then applied to one array after the other. The
+// arrays are prefetched when their rows (one element of every array) do not
+// fit in 4 MB. The swap kernel of every array is picked once, in a stack
+// table for up to SHUFFLE_SOA_STACK_COLUMNS arrays and an allocated one
+// beyond; if it cannot be allocated, the kernels are picked at every block.
+#define SHUFFLE_SOA_STACK_COLUMNS 16
+void shuffle_soa(void *const *arrays, const size_t *elem_sizes, size_t ncols,
+                 size_t count, uint64_t (*rng)(void)) {
+  uint32_t dice[SHUFFLE_DEFAULT_BLOCK + 5];
+  swap_block_fn stack_swaps[SHUFFLE_SOA_STACK_COLUMNS];
+  swap_block_fn *swaps =
+      ncols <= SHUFFLE_SOA_STACK_COLUMNS
+          ? stack_swaps
+          : (swap_block_fn *)malloc(ncols * sizeof(swap_block_fn));
+  size_t row_size = 0;
+  for (size_t c = 0; c < ncols; c++) {
+    row_size += elem_sizes[c];
+    if (swaps != NULL) {
+      swaps[c] = select_swap_block(elem_sizes[c]);
+    }
+  }
+  uint64_t i = count;
+  for (; i > 1 << 30; i--) {
+    uint64_t die;
+    partial_shuffle_dice_64b(i, 1, i, rng, &die);
+    if (die == i - 1) {
+      continue;
+    }
+    for (size_t c = 0; c < ncols; c++) {
+      unsigned char *base = (unsigned char *)arrays[c];
+      swap_bytes_any(base + (i - 1) * elem_sizes[c], base + die * elem_sizes[c],
+                     elem_sizes[c]);
+    }
+  }
+  int prefetch = i * row_size > (uint64_t)1 << 22;
+  while (i > 1) {
+    uint64_t rolled = roll_dice_23456_32b(i, SHUFFLE_DEFAULT_BLOCK, rng, dice);
+    for (size_t c = 0; c < ncols; c++) {
+      if (elem_sizes[c] != 0) {
+        swap_block_fn swap =
+            swaps != NULL ? swaps[c] : select_swap_block(elem_sizes[c]);
+        swap((unsigned char *)arrays[c], i, dice, rolled, elem_sizes[c],
+             prefetch);
+      }
+    }
+    i -= rolled;
+  }
+  if (swaps != stack_swaps) {
+    free(swaps);
+  }
+}
+
+void shuffle_bytes(void *base, size_t count, size_t elem_size,
+                   uint64_t (*rng)(void)) {
+  shuffle_soa(&base, &elem_size, 1, count, rng);
+}
+
+// Inside-out Fisher-Yates shuffle: out[i] = i is swapped with a position
+// picked by an (i+1) sided die, for i = 0, 1, ..., n-1, so that each step is
+// one read and two writes, and out needs no initialization pass. A batch of
+// dice for the sizes i+1, ..., i+k has as many dice as shuffle_batch_23456
+// rolls for the size i+k, with the same bound; the last batch, with fewer
+// dice, has its exact rejection threshold computed. The steps do not depend
+// on one another, so that the processor overlaps the cache misses of large
+// arrays without prefetching.
+#define BR_DEFINE_RANDOM_PERMUTATION(bits)                                     \
+  __attribute__((always_inline)) static inline void                            \
+      inside_out_batch_u##bits(uint##bits##_t *out, uint64_t i, uint64_t k,    \
+                               uint64_t bound, uint64_t (*rng)(void)) {        \
+    uint32_t dice[6];                                                          \
+    increasing_dice_32b(i + 1, k, bound, rng, dice);                           \
+    for (uint64_t j = 0; j < k; j++) {                                         \
+      out[i + j] = out[dice[j]];                                               \
+      out[dice[j]] = (uint##bits##_t)(i + j);                                  \
+    }                                                                          \
+  }                                                                            \
+  void random_permutation_u##bits(uint##bits##_t *out, uint64_t n,             \
+                                  uint64_t (*rng)(void)) {                     \
+    uint64_t batched = n < 1 << 30 ? n : 1 << 30;                              \
+    uint64_t i = 0;                                                            \
+    for (; i + 6 <= batched && i + 6 <= 1 << 9; i += 6) {                      \
+      inside_out_batch_u##bits(out, i, 6, (uint64_t)1 << 54, rng);             \
+    }                                                                          \
+    for (; i + 5 <= batched && i + 5 <= 1 << 11; i += 5) {                     \
+      inside_out_batch_u##bits(out, i, 5, (uint64_t)1 << 55, rng);             \
+    }                                                                          \
+    for (; i + 4 <= batched && i + 4 <= 1 << 14; i += 4) {                     \
+      inside_out_batch_u##bits(out, i, 4, (uint64_t)1 << 56, rng);             \
+    }                                                                          \
+    for (; i + 3 <= batched && i + 3 <= 1 << 19; i += 3) {                     \
+      inside_out_batch_u##bits(out, i, 3, (uint64_t)1 << 57, rng);             \
+    }                                                                          \
+    for (; i + 2 <= batched; i += 2) {                                         \
+      inside_out_batch_u##bits(out, i, 2, (uint64_t)1 << 60, rng);             \
+    }                                                                          \
+    if (i < batched) {                                                         \
+      inside_out_batch_u##bits(out, i, batched - i, UINT64_MAX, rng);          \
+      i = batched;                                                             \
+    }                                                                          \
+    for (; i < n; i++) {                                                       \
+      uint64_t d = random_bounded(i + 1, rng);                                 \
+      out[i] = out[d];                                                         \
+      out[d] = (uint##bits##_t)i;                                              \
+    }                                                                          \
+  }
+BR_DEFINE_RANDOM_PERMUTATION(32)
+BR_DEFINE_RANDOM_PERMUTATION(64)
+
+// One batch of k Fisher-Yates steps for the sizes i, i-1, ..., i-k+1, as
+// partial_shuffle_64b does on an array: returns the bound for the next batch.
+typedef uint64_t (*partial_step_fn)(void *ctx, uint64_t i, uint64_t k,
+                                    uint64_t bound, uint64_t (*rng)(void));
+
+// Runs the first k steps of shuffle_batch_23456 on n elements (all of them
+// when k >= n - 1), with the same batches: the last one, when it has fewer
+// dice than the batches of its size, has its exact rejection threshold
+// computed. It is inlined in one function per step.
+__attribute__((always_inline)) static inline void
+partial_shuffle_23456(uint64_t n, uint64_t k, uint64_t (*rng)(void),
+                      partial_step_fn step, void *ctx) {
+  uint64_t stop = k < n ? n - k : 1;
+  uint64_t i = n;
+  for (; i > 1 << 30 && i > stop; i--) {
+    step(ctx, i, 1, i, rng);
+  }
+
+  // Batches of 2 for sizes up to 2^30 elements
+  uint64_t bound = (uint64_t)1 << 60;
+  for (; i > 1 << 19 && i >= stop + 2; i -= 2) {
+    bound = step(ctx, i, 2, bound, rng);
+  }
+
+  // Batches of 3 for sizes up to 2^19 elements
+  bound = (uint64_t)1 << 57;
+  for (; i > 1 << 14 && i >= stop + 3; i -= 3) {
+    bound = step(ctx, i, 3, bound, rng);
+  }
+
+  // Batches of 4 for sizes up to 2^14 elements
+  bound = (uint64_t)1 << 56;
+  for (; i > 1 << 11 && i >= stop + 4; i -= 4) {
+    bound = step(ctx, i, 4, bound, rng);
+  }
+
+  // Batches of 5 for sizes up to 2^11 elements
+  bound = (uint64_t)1 << 55;
+  for (; i > 1 << 9 && i >= stop + 5; i -= 5) {
+    bound = step(ctx, i, 5, bound, rng);
+  }
+
+  // Batches of 6 for sizes up to 2^9 elements
+  bound = (uint64_t)1 << 54;
+  for (; i > 6 && i >= stop + 6; i -= 6) {
+    bound = step(ctx, i, 6, bound, rng);
+  }
+
+  if (i > stop) {
+    step(ctx, i, i - stop, UINT64_MAX, rng);
+  }
+}
+
+static uint64_t partial_shuffle_step(void *ctx, uint64_t i, uint64_t k,
+                                     uint64_t bound, uint64_t (*rng)(void)) {
+  return partial_shuffle_64b((uint64_t *)ctx, i, k, bound, rng);
+}
+
+// Partial Fisher-Yates shuffle: k steps of shuffle_batch_23456
+void partial_shuffle(uint64_t *storage, uint64_t n, uint64_t k,
+                     uint64_t (*rng)(void)) {
+  partial_shuffle_23456(n, k, rng, partial_shuffle_step, storage);
+}
+
+// The sparse array of sample_without_replacement: an open-addressing hash
+// table of the positions whose value is not their index.
+#define SAMPLE_EMPTY UINT64_MAX
+#define SAMPLE_STACK_SLOTS 512
+typedef struct {
+  uint64_t key;
+  uint64_t value;
+} sample_slot;
+
+typedef struct {
+  sample_slot *slots;
+  uint64_t mask;
+  int shift;
+  uint64_t *out;
+} sample_table;
+
+static inline sample_slot *sample_find(sample_table *table, uint64_t key) {
+  uint64_t h = (key * UINT64_C(0x9e3779b97f4a7c15)) >> table->shift;
+  while (table->slots[h].key != key && table->slots[h].key != SAMPLE_EMPTY) {
+    h = (h + 1) & table->mask;
+  }
+  return &table->slots[h];
+}
+
+// The steps of the Fisher-Yates shuffle of the virtual array 0, 1, ...,
+// n-1: the value at position i-1 moves to the position picked by the die,
+// whose value is the next element of the sample.
+static uint64_t sample_sparse_step(void *ctx, uint64_t i, uint64_t k,
+                                   uint64_t bound, uint64_t (*rng)(void)) {
+  sample_table *table = (sample_table *)ctx;
+  uint64_t dice[6];
+  bound = partial_shuffle_dice_64b(i, k, bound, rng, dice);
+  for (uint64_t j = 0; j < k; j++) {
+    sample_slot *last = sample_find(table, i - j - 1);
+    uint64_t last_value = last->key == SAMPLE_EMPTY ? i - j - 1 : last->value;
+    sample_slot *picked = sample_find(table, dice[j]);
+    if (picked->key == SAMPLE_EMPTY) {
+      *table->out++ = dice[j];
+      picked->key = dice[j];
+    } else {
+      *table->out++ = picked->value;
+    }
+    picked->value = last_value;
+  }
+  return bound;
+}
+
+// Draws k distinct values out of 0, 1, ..., n-1 with the steps of
+// partial_shuffle on an array holding 0, 1, ..., n-1: dense when the array
+// is not much larger than the hash table would be, sparse otherwise.
+int sample_without_replacement(uint64_t n, uint64_t k, uint64_t *out,
+                               uint64_t (*rng)(void)) {
+  if (k > n) {
+    k = n;
+  }
+  if (k == 0) {
+    return 0;
+  }
+  if (n <= 4 * k) {
+    uint64_t *storage = (uint64_t *)malloc(n * sizeof(uint64_t));
+    if (storage == NULL) {
+      return -1;
+    }
+    for (uint64_t i = 0; i < n; i++) {
+      storage[i] = i;
+    }
+    partial_shuffle(storage, n, k, rng);
+    for (uint64_t j = 0; j < k; j++) {
+      out[j] = storage[n - j - 1];
+    }
+    free(storage);
+    return 0;
+  }
+  // at most k keys, in a table at most half full
+  int bits = 1;
+  while (((uint64_t)1 << bits) < 2 * k) {
+    bits++;
+  }
+  uint64_t slots = (uint64_t)1 << bits;
+  sample_slot stack_slots[SAMPLE_STACK_SLOTS];
+  sample_table table = {stack_slots, slots - 1, 64 - bits, out};
+  if (slots > SAMPLE_STACK_SLOTS) {
+    table.slots = (sample_slot *)malloc(slots * sizeof(sample_slot));
+    if (table.slots == NULL) {
+      return -1;
+    }
+  }
+  for (uint64_t h = 0; h < slots; h++) {
+    table.slots[h].key = SAMPLE_EMPTY;
+  }
+  partial_shuffle_23456(n, k, rng, sample_sparse_step, &table);
+  if (table.slots != stack_slots) {
+    free(table.slots);
+  }
+  return 0;
+}
+
+// The draws of the resampling functions are made RESAMPLE_CHUNK (rounded down
+// to whole batches) at a time: the batch size and the rejection threshold for
+// n are computed once per call, and the draws are those of
+// random_bounded_fill(n, indexes, m, rng). The chunks of gathered elements
+// are prefetched PREFETCH_BYTES_DISTANCE draws ahead when the source does not
+// fit in 4 MB.
+#define RESAMPLE_CHUNK 256
+typedef void (*resample_chunk_fn)(void *ctx, const uint64_t *indexes,
+                                  uint64_t begin, uint64_t count);
+
+__attribute__((always_inline)) static inline void
+resample_indexes(uint64_t n, uint64_t m, uint64_t (*rng)(void),
+                 resample_chunk_fn apply, void *ctx) {
+  uint64_t indexes[RESAMPLE_CHUNK];
+  uint64_t t = 0;
+  uint64_t k = n > 1 ? random_bounded_batch_size(n, 64, &t) : 1;
+  uint64_t chunk = RESAMPLE_CHUNK - RESAMPLE_CHUNK % k;
+  if (n <= 1) {
+    memset(indexes, 0, sizeof(indexes));
+  }
+  for (uint64_t begin = 0; begin < m; begin += chunk) {
+    uint64_t count = m - begin < chunk ? m - begin : chunk;
+    if (n > 1) {
+      random_bounded_fill_batches(n, k, t, indexes, count, rng);
+    }
+    apply(ctx, indexes, begin, count);
+  }
+}
+
+typedef struct {
+  const unsigned char *src;
+  unsigned char *dst;
+  size_t elem_size;
+  int prefetch;
+} resample_gather;
+
+// dst[begin + j] = src[indexes[j]] for elements of elem_size bytes; inlined
+// in one function per size so that the copies have a constant size.
+__attribute__((always_inline)) static inline void
+gather_bytes_block(const resample_gather *g, const uint64_t *indexes,
+                   uint64_t begin, uint64_t count, size_t elem_size) {
+  unsigned char *dst = g->dst + begin * elem_size;
+  for (uint64_t j = 0; j < count; j++) {
+    if (g->prefetch && j + PREFETCH_BYTES_DISTANCE < count) {
+      const unsigned char *ahead =
+          g->src + indexes[j + PREFETCH_BYTES_DISTANCE] * elem_size;
+      for (size_t line = 0; line < elem_size; line += 64) {
+        __builtin_prefetch(ahead + line);
+      }
+      __builtin_prefetch(ahead + elem_size - 1);
+    }
+    memcpy(dst + j * elem_size, g->src + indexes[j] * elem_size, elem_size);
+  }
+}
+
+#define BR_DEFINE_GATHER_BYTES_BLOCK(bytes)                                    \
+  static void gather_bytes_block_##bytes(void *ctx, const uint64_t *indexes,  \
+                                         uint64_t begin, uint64_t count) {     \
+    gather_bytes_block((const resample_gather *)ctx, indexes, begin, count,   \
+                       bytes);                                                 \
+  }
+BR_DEFINE_GATHER_BYTES_BLOCK(1)
+BR_DEFINE_GATHER_BYTES_BLOCK(2)
+BR_DEFINE_GATHER_BYTES_BLOCK(4)
+BR_DEFINE_GATHER_BYTES_BLOCK(8)
+BR_DEFINE_GATHER_BYTES_BLOCK(16)
+BR_DEFINE_GATHER_BYTES_BLOCK(32)
+BR_DEFINE_GATHER_BYTES_BLOCK(64)
+
+static void gather_bytes_block_any(void *ctx, const uint64_t *indexes,
+                                   uint64_t begin, uint64_t count) {
+  const resample_gather *g = (const resample_gather *)ctx;
+  gather_bytes_block(g, indexes, begin, count, g->elem_size);
+}
+
+static void resample_counts_block(void *ctx, const uint64_t *indexes,
+                                  uint64_t begin, uint64_t count) {
+  (void)begin;
+  uint64_t *counts = (uint64_t *)ctx;
+  for (uint64_t j = 0; j < count; j++) {
+    counts[indexes[j]]++;
+  }
+}
+
+void resample_bytes(const void *src, uint64_t n, size_t elem_size, void *dst,
+                    uint64_t m, uint64_t (*rng)(void)) {
+  resample_gather g = {(const unsigned char *)src, (unsigned char *)dst,
+                       elem_size, n * elem_size > (uint64_t)1 << 22};
+  resample_chunk_fn apply;
+  switch (elem_size) {
+  case 0:
+    return;
+  case 1:
+    apply = gather_bytes_block_1;
+    break;
+  case 2:
+    apply = gather_bytes_block_2;
+    break;
+  case 4:
+    apply = gather_bytes_block_4;
+    break;
+  case 8:
+    apply = gather_bytes_block_8;
+    break;
+  case 16:
+    apply = gather_bytes_block_16;
+    break;
+  case 32:
+    apply = gather_bytes_block_32;
+    break;
+  case 64:
+    apply = gather_bytes_block_64;
+    break;
+  default:
+    apply = gather_bytes_block_any;
+    break;
+  }
+  resample_indexes(n, m, rng, apply, &g);
+}
+
+void resample_with_replacement(const uint64_t *src, uint64_t n, uint64_t *dst,
+                               uint64_t m, uint64_t (*rng)(void)) {
+  resample_gather g = {(const unsigned char *)src, (unsigned char *)dst,
+                       sizeof(uint64_t), n * sizeof(uint64_t) > (uint64_t)1
+                                                                    << 22};
+  resample_indexes(n, m, rng, gather_bytes_block_8, &g);
+}
+
+void resample_counts(uint64_t n, uint64_t m, uint64_t *counts,
+                     uint64_t (*rng)(void)) {
+  memset(counts, 0, n * sizeof(uint64_t));
+  resample_indexes(n, m, rng, resample_counts_block, counts);
+}
 
 // Shuffle with Lehmer RNG
 
@@ -115,6 +1471,48 @@ void naive_shuffle_lehmer_2(uint64_t *storage, uint64_t size) {
   naive_shuffle_batch_2(storage, size, lehmer64);
 }
 
+void shuffle_lehmer_23456_4x(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_4x(storage, size, lehmer64);
+}
+
+void shuffle_lehmer_23456_8x(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_8x(storage, size, lehmer64);
+}
+
+void shuffle_lehmer_23456_lanes(uint64_t *storage, uint64_t size) {
+#ifdef BATCHED_RANDOM_X64
+  if (batched_random_has_avx2()) {
+    shuffle_lehmer_23456_lanes_avx2(storage, size);
+    return;
+  }
+#endif
+  shuffle_lehmer_23456_lanes_with(storage, size, lanes_dice_64b_4x);
+}
+
+void shuffle_lehmer_128(uint64_t *storage, uint64_t size) {
+  shuffle_batch_128(storage, size, lehmer64);
+}
+
+void shuffle_lehmer_plan(uint64_t *storage, const shuffle_plan *plan) {
+  shuffle_with_plan(storage, plan, lehmer64);
+}
+
+void shuffle_lehmer_23456_blocked(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_blocked(storage, size, SHUFFLE_DEFAULT_BLOCK, lehmer64);
+}
+
+void shuffle_lehmer_prefetch(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH, lehmer64);
+}
+
+void shuffle_lehmer_bucketed(uint64_t *storage, uint64_t size) {
+  if (size > SHUFFLE_BUCKETED_MIN) {
+    shuffle_batch_bucketed(storage, size, lehmer64);
+  } else {
+    shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH, lehmer64);
+  }
+}
+
 // Shuffle with PCG RNG
 
 void shuffle_pcg(uint64_t *storage, uint64_t size) {
@@ -133,6 +1531,48 @@ void naive_shuffle_pcg_2(uint64_t *storage, uint64_t size) {
   naive_shuffle_batch_2(storage, size, pcg64);
 }
 
+void shuffle_pcg_23456_4x(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_4x(storage, size, pcg64);
+}
+
+void shuffle_pcg_23456_8x(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_8x(storage, size, pcg64);
+}
+
+void shuffle_pcg_23456_lanes(uint64_t *storage, uint64_t size) {
+#ifdef BATCHED_RANDOM_X64
+  if (batched_random_has_avx2()) {
+    shuffle_pcg_23456_lanes_avx2(storage, size);
+    return;
+  }
+#endif
+  shuffle_pcg_23456_lanes_with(storage, size, lanes_dice_64b_4x);
+}
+
+void shuffle_pcg_128(uint64_t *storage, uint64_t size) {
+  shuffle_batch_128(storage, size, pcg64);
+}
+
+void shuffle_pcg_plan(uint64_t *storage, const shuffle_plan *plan) {
+  shuffle_with_plan(storage, plan, pcg64);
+}
+
+void shuffle_pcg_23456_blocked(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_blocked(storage, size, SHUFFLE_DEFAULT_BLOCK, pcg64);
+}
+
+void shuffle_pcg_prefetch(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH, pcg64);
+}
+
+void shuffle_pcg_bucketed(uint64_t *storage, uint64_t size) {
+  if (size > SHUFFLE_BUCKETED_MIN) {
+    shuffle_batch_bucketed(storage, size, pcg64);
+  } else {
+    shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH, pcg64);
+  }
+}
+
 // Shuffle with ChaCha RNG
 void shuffle_chacha(uint64_t *storage, uint64_t size) {
   shuffle(storage, size, chacha_u64_global);
@@ -149,8 +1589,682 @@ void shuffle_chacha_23456(uint64_t *storage, uint64_t size) {
 void naive_shuffle_chacha_2(uint64_t *storage, uint64_t size) {
   naive_shuffle_batch_2(storage, size, chacha_u64_global);
 }
+
+void shuffle_chacha_23456_4x(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_4x(storage, size, chacha_u64_global);
+}
+
+void shuffle_chacha_23456_8x(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_8x(storage, size, chacha_u64_global);
+}
+
+void shuffle_chacha_128(uint64_t *storage, uint64_t size) {
+  shuffle_batch_128(storage, size, chacha_u64_global);
+}
+
+void shuffle_chacha_plan(uint64_t *storage, const shuffle_plan *plan) {
+  shuffle_with_plan(storage, plan, chacha_u64_global);
+}
+
+void shuffle_chacha_23456_blocked(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_blocked(storage, size, SHUFFLE_DEFAULT_BLOCK, chacha_u64_global);
+}
+
+void shuffle_chacha_prefetch(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH, chacha_u64_global);
+}
+
+void shuffle_chacha_bucketed(uint64_t *storage, uint64_t size) {
+  if (size > SHUFFLE_BUCKETED_MIN) {
+    shuffle_batch_bucketed(storage, size, chacha_u64_global);
+  } else {
+    shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH, chacha_u64_global);
+  }
+}
+// Shuffle with xoshiro256++ RNG
+
+void shuffle_xoshiro256pp(uint64_t *storage, uint64_t size) {
+  shuffle(storage, size, xoshiro256pp);
+}
+
+void shuffle_xoshiro256pp_2(uint64_t *storage, uint64_t size) {
+  shuffle_batch_2(storage, size, xoshiro256pp);
+}
+
+void shuffle_xoshiro256pp_23456(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456(storage, size, xoshiro256pp);
+}
+
+// Shuffle with wyrand RNG
+
+void shuffle_wyrand(uint64_t *storage, uint64_t size) {
+  shuffle(storage, size, wyrand);
+}
+
+void shuffle_wyrand_2(uint64_t *storage, uint64_t size) {
+  shuffle_batch_2(storage, size, wyrand);
+}
+
+void shuffle_wyrand_23456(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456(storage, size, wyrand);
+}
+
+// Shuffle with SFC64 RNG
+
+void shuffle_sfc64(uint64_t *storage, uint64_t size) {
+  shuffle(storage, size, sfc64);
+}
+
+void shuffle_sfc64_2(uint64_t *storage, uint64_t size) {
+  shuffle_batch_2(storage, size, sfc64);
+}
+
+void shuffle_sfc64_23456(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456(storage, size, sfc64);
+}
+
+// Shuffle with RomuDuoJr RNG
+
+void shuffle_romu(uint64_t *storage, uint64_t size) {
+  shuffle(storage, size, romu);
+}
+
+void shuffle_romu_2(uint64_t *storage, uint64_t size) {
+  shuffle_batch_2(storage, size, romu);
+}
+
+void shuffle_romu_23456(uint64_t *storage, uint64_t size) {
+  shuffle_batch_23456(storage, size, romu);
+}
+
+// Shuffle with the counter-based engines
+
+void br_philox_seed(br_philox_t *ctx, uint64_t s) {
+  ctx->key[0] = splitmix64_stateless_offset(s, 0);
+  ctx->key[1] = splitmix64_stateless_offset(s, 1);
+}
+
+void br_philox_seed_key(br_philox_t *ctx, const uint64_t key[2]) {
+  ctx->key[0] = key[0];
+  ctx->key[1] = key[1];
+}
+
+void br_aes_seed(br_aes_t *ctx, uint64_t s) {
+  uint8_t key[16];
+  for (int j = 0; j < 8; j++) {
+    key[j] = (uint8_t)(splitmix64_stateless_offset(s, 0) >> (8 * j));
+    key[8 + j] = (uint8_t)(splitmix64_stateless_offset(s, 1) >> (8 * j));
+  }
+  br_aes_seed_key(ctx, key, 0);
+}
+
+void br_aes_seed_key(br_aes_t *ctx, const uint8_t key[16], uint64_t nonce) {
+  aes128_expand_key(key, ctx->round_keys);
+  ctx->nonce = nonce;
+}
+
+void br_philox_fill(const br_philox_t *ctx, uint64_t counter_start,
+                    uint64_t *out, uint64_t count) {
+  philox4x64_fill(ctx->key, counter_start, out, count);
+}
+
+void br_aes_fill(const br_aes_t *ctx, uint64_t counter_start, uint64_t *out,
+                 uint64_t count) {
+  aes_ctr_fill(ctx->round_keys, ctx->nonce, counter_start, out, count);
+}
+
+void br_aes_fill_portable(const br_aes_t *ctx, uint64_t counter_start,
+                          uint64_t *out, uint64_t count) {
+  aes_ctr_fill_portable(ctx->round_keys, ctx->nonce, counter_start, out, count);
+}
+
+typedef void (*counter_fill_fn)(const void *ctx, uint64_t counter_start,
+                                uint64_t *out, uint64_t count);
+
+static void counter_fill_philox(const void *ctx, uint64_t counter_start,
+                                uint64_t *out, uint64_t count) {
+  br_philox_fill((const br_philox_t *)ctx, counter_start, out, count);
+}
+
+static void counter_fill_aes(const void *ctx, uint64_t counter_start,
+                             uint64_t *out, uint64_t count) {
+  br_aes_fill((const br_aes_t *)ctx, counter_start, out, count);
+}
+
+// The word of batch b after `attempt` rejections is word
+// b + attempt * COUNTER_RETRY_STRIDE: there are at most 2^48 batches, and
+// after COUNTER_MAX_ATTEMPTS attempts the words would wrap around to those of
+// the first attempts. As chacha_advance past the end of its stream, we exit
+// rather than reuse words.
+#define COUNTER_RETRY_STRIDE ((uint64_t)1 << 48)
+#define COUNTER_MAX_ATTEMPTS ((uint64_t)1 << 16)
+// Number of words filled at once, and of dice per call in the shuffles.
+#define COUNTER_WORDS 256
+#define COUNTER_DICE_CHUNK 1024
+
+// Rolls the k dice with sizes n, n-1, ..., n-(k-1) of batch b from its word
+// r, drawing the words of the retries from the stream. bound must be at least
+// the product of the dice: the exact threshold is only computed below it.
+static inline void counter_roll_batch(counter_fill_fn fill, const void *ctx,
+                                      uint64_t n, uint64_t k, uint64_t bound,
+                                      uint64_t b, uint64_t r,
+                                      uint64_t *rolled) {
+  __uint128_t x;
+  for (uint64_t i = 0; i < k; i++) {
+    x = (__uint128_t)(n - i) * (__uint128_t)r;
+    r = (uint64_t)x;
+    rolled[i] = (uint64_t)(x >> 64);
+  }
+  if (r < bound) {
+    uint64_t product = n;
+    for (uint64_t i = 1; i < k; i++) {
+      product *= n - i;
+    }
+    uint64_t t = -product % product;
+    for (uint64_t attempt = 1; r < t; attempt++) {
+      if (attempt == COUNTER_MAX_ATTEMPTS) {
+        exit(EXIT_FAILURE);
+      }
+      fill(ctx, b + attempt * COUNTER_RETRY_STRIDE, &r, 1);
+      for (uint64_t i = 0; i < k; i++) {
+        x = (__uint128_t)(n - i) * (__uint128_t)r;
+        r = (uint64_t)x;
+        rolled[i] = (uint64_t)(x >> 64);
+      }
+    }
+  }
+}
+
+// Writes the dice of the steps [first, first + count) of the shuffle of size
+// elements to dice. The schedule is the one of shuffle_batch_23456: phases of
+// batches of k = 1, ..., 6 dice down to the sizes counter_phase_end, and a
+// last batch with the remaining dice. Only the batches that hold the
+// requested steps are rolled.
+static void counter_dice_23456(counter_fill_fn fill, const void *ctx,
+                               uint64_t size, uint64_t first, uint64_t count,
+                               uint64_t *dice) {
+  static const uint64_t counter_phase_end[6] = {1 << 30, 1 << 19, 1 << 14,
+                                                1 << 11, 1 << 9,  6};
+  // up to 2^48 elements, so that there are fewer than 2^48 batches
+  if (size > COUNTER_RETRY_STRIDE) {
+    exit(EXIT_FAILURE);
+  }
+  uint64_t words[COUNTER_WORDS];
+  uint64_t rolled[6];
+  uint64_t end_step = first + count;
+  uint64_t i = size; // size at the start of the phase
+  uint64_t step = 0; // first step of the phase
+  uint64_t batch = 0; // first batch of the phase
+  for (uint64_t phase = 0; phase <= 6 && step < end_step; phase++) {
+    uint64_t k, m; // m batches of k dice
+    if (phase < 6) {
+      k = phase + 1;
+      uint64_t end = counter_phase_end[phase];
+      m = i > end ? (i - end + k - 1) / k : 0;
+    } else {
+      k = i - 1;
+      m = i > 1 ? 1 : 0;
+    }
+    if (first < step + m * k) {
+      uint64_t b = first > step ? (first - step) / k : 0;
+      uint64_t b_end = (end_step - step + k - 1) / k;
+      if (b_end > m) {
+        b_end = m;
+      }
+      // the dice of the later batches are smaller
+      uint64_t bound = size - step - b * k;
+      for (uint64_t d = 1; d < k; d++) {
+        bound *= size - step - b * k - d;
+      }
+      while (b < b_end) {
+        uint64_t filled = b_end - b < COUNTER_WORDS ? b_end - b : COUNTER_WORDS;
+        fill(ctx, batch + b, words, filled);
+        for (uint64_t j = 0; j < filled; j++, b++) {
+          uint64_t s = step + b * k; // first step of the batch
+          if (s >= first && s + k <= end_step) {
+            counter_roll_batch(fill, ctx, size - s, k, bound, batch + b,
+                               words[j], dice + (s - first));
+            continue;
+          }
+          counter_roll_batch(fill, ctx, size - s, k, bound, batch + b,
+                             words[j], rolled);
+          for (uint64_t d = 0; d < k; d++) {
+            if (s + d >= first && s + d < end_step) {
+              dice[s + d - first] = rolled[d];
+            }
+          }
+        }
+      }
+    }
+    step += m * k;
+    batch += m;
+    i -= m * k;
+  }
+}
+
+// Fisher-Yates shuffle with the dice of counter_dice_23456, COUNTER_DICE_CHUNK
+// steps at a time.
+static void counter_shuffle_23456(counter_fill_fn fill, const void *ctx,
+                                  uint64_t *storage, uint64_t size) {
+  uint64_t dice[COUNTER_DICE_CHUNK];
+  uint64_t steps = size > 1 ? size - 1 : 0;
+  for (uint64_t first = 0; first < steps; first += COUNTER_DICE_CHUNK) {
+    uint64_t count =
+        steps - first < COUNTER_DICE_CHUNK ? steps - first : COUNTER_DICE_CHUNK;
+    counter_dice_23456(fill, ctx, size, first, count, dice);
+    for (uint64_t j = 0; j < count; j++) {
+      uint64_t pos1 = size - 1 - (first + j);
+      uint64_t pos2 = dice[j];
+      uint64_t val1 = storage[pos1]; // should be in cache
+      uint64_t val2 = storage[pos2]; // might not be in cache
+      storage[pos1] = val2;
+      storage[pos2] = val1;
+    }
+  }
+}
+
+void dice_philox_23456_r(const br_philox_t *ctx, uint64_t size,
+                         uint64_t first, uint64_t count, uint64_t *dice) {
+  counter_dice_23456(counter_fill_philox, ctx, size, first, count, dice);
+}
+
+void dice_aes_23456_r(const br_aes_t *ctx, uint64_t size, uint64_t first,
+                      uint64_t count, uint64_t *dice) {
+  counter_dice_23456(counter_fill_aes, ctx, size, first, count, dice);
+}
+
+void shuffle_philox_23456_r(br_philox_t *ctx, uint64_t *storage,
+                            uint64_t size) {
+  counter_shuffle_23456(counter_fill_philox, ctx, storage, size);
+  ctx->key[1]++;
+}
+
+void shuffle_aes_23456_r(br_aes_t *ctx, uint64_t *storage, uint64_t size) {
+  counter_shuffle_23456(counter_fill_aes, ctx, storage, size);
+  ctx->nonce++;
+}
+
+void shuffle_philox_23456(uint64_t *storage, uint64_t size) {
+  shuffle_philox_23456_r(&philox_global, storage, size);
+}
+
+void shuffle_aes_23456(uint64_t *storage, uint64_t size) {
+  shuffle_aes_23456_r(&aes_global, storage, size);
+}
+
 // Random bounded Lehmer
 
 uint64_t random_bounded_lehmer(uint64_t range) {
   return random_bounded(range, lehmer64);
 }
+
+// Bulk random bounded
+
+void random_bounded_fill_lehmer(uint64_t range, uint64_t *out, uint64_t count) {
+  random_bounded_fill(range, out, count, lehmer64);
+}
+
+void random_bounded_fill_pcg(uint64_t range, uint64_t *out, uint64_t count) {
+  random_bounded_fill(range, out, count, pcg64);
+}
+
+void random_bounded_fill_chacha(uint64_t range, uint64_t *out, uint64_t count) {
+  random_bounded_fill(range, out, count, chacha_u64_global);
+}
+
+void random_bounded_ranges_lehmer(const uint64_t *ranges, uint64_t *out,
+                                  uint64_t count) {
+  random_bounded_ranges(ranges, out, count, lehmer64);
+}
+
+void random_bounded_ranges_pcg(const uint64_t *ranges, uint64_t *out,
+                               uint64_t count) {
+  random_bounded_ranges(ranges, out, count, pcg64);
+}
+
+void random_bounded_ranges_chacha(const uint64_t *ranges, uint64_t *out,
+                                  uint64_t count) {
+  random_bounded_ranges(ranges, out, count, chacha_u64_global);
+}
+
+// Shuffle records
+
+void shuffle_bytes_lehmer(void *base, size_t count, size_t elem_size) {
+  shuffle_bytes(base, count, elem_size, lehmer64);
+}
+
+void shuffle_bytes_pcg(void *base, size_t count, size_t elem_size) {
+  shuffle_bytes(base, count, elem_size, pcg64);
+}
+
+void shuffle_bytes_chacha(void *base, size_t count, size_t elem_size) {
+  shuffle_bytes(base, count, elem_size, chacha_u64_global);
+}
+
+void shuffle_soa_lehmer(void *const *arrays, const size_t *elem_sizes,
+                        size_t ncols, size_t count) {
+  shuffle_soa(arrays, elem_sizes, ncols, count, lehmer64);
+}
+
+void shuffle_soa_pcg(void *const *arrays, const size_t *elem_sizes,
+                     size_t ncols, size_t count) {
+  shuffle_soa(arrays, elem_sizes, ncols, count, pcg64);
+}
+
+void shuffle_soa_chacha(void *const *arrays, const size_t *elem_sizes,
+                        size_t ncols, size_t count) {
+  shuffle_soa(arrays, elem_sizes, ncols, count, chacha_u64_global);
+}
+
+void random_permutation_u32_lehmer(uint32_t *out, uint64_t n) {
+  random_permutation_u32(out, n, lehmer64);
+}
+
+void random_permutation_u32_pcg(uint32_t *out, uint64_t n) {
+  random_permutation_u32(out, n, pcg64);
+}
+
+void random_permutation_u32_chacha(uint32_t *out, uint64_t n) {
+  random_permutation_u32(out, n, chacha_u64_global);
+}
+
+void random_permutation_u64_lehmer(uint64_t *out, uint64_t n) {
+  random_permutation_u64(out, n, lehmer64);
+}
+
+void random_permutation_u64_pcg(uint64_t *out, uint64_t n) {
+  random_permutation_u64(out, n, pcg64);
+}
+
+void random_permutation_u64_chacha(uint64_t *out, uint64_t n) {
+  random_permutation_u64(out, n, chacha_u64_global);
+}
+
+void partial_shuffle_lehmer(uint64_t *storage, uint64_t n, uint64_t k) {
+  partial_shuffle(storage, n, k, lehmer64);
+}
+
+void partial_shuffle_pcg(uint64_t *storage, uint64_t n, uint64_t k) {
+  partial_shuffle(storage, n, k, pcg64);
+}
+
+void partial_shuffle_chacha(uint64_t *storage, uint64_t n, uint64_t k) {
+  partial_shuffle(storage, n, k, chacha_u64_global);
+}
+
+int sample_without_replacement_lehmer(uint64_t n, uint64_t k, uint64_t *out) {
+  return sample_without_replacement(n, k, out, lehmer64);
+}
+
+int sample_without_replacement_pcg(uint64_t n, uint64_t k, uint64_t *out) {
+  return sample_without_replacement(n, k, out, pcg64);
+}
+
+int sample_without_replacement_chacha(uint64_t n, uint64_t k, uint64_t *out) {
+  return sample_without_replacement(n, k, out, chacha_u64_global);
+}
+
+void resample_with_replacement_lehmer(const uint64_t *src, uint64_t n,
+                                     uint64_t *dst, uint64_t m) {
+  resample_with_replacement(src, n, dst, m, lehmer64);
+}
+
+void resample_with_replacement_pcg(const uint64_t *src, uint64_t n,
+                                     uint64_t *dst, uint64_t m) {
+  resample_with_replacement(src, n, dst, m, pcg64);
+}
+
+void resample_with_replacement_chacha(const uint64_t *src, uint64_t n,
+                                     uint64_t *dst, uint64_t m) {
+  resample_with_replacement(src, n, dst, m, chacha_u64_global);
+}
+
+void resample_bytes_lehmer(const void *src, uint64_t n, size_t elem_size,
+                          void *dst, uint64_t m) {
+  resample_bytes(src, n, elem_size, dst, m, lehmer64);
+}
+
+void resample_bytes_pcg(const void *src, uint64_t n, size_t elem_size,
+                          void *dst, uint64_t m) {
+  resample_bytes(src, n, elem_size, dst, m, pcg64);
+}
+
+void resample_bytes_chacha(const void *src, uint64_t n, size_t elem_size,
+                          void *dst, uint64_t m) {
+  resample_bytes(src, n, elem_size, dst, m, chacha_u64_global);
+}
+
+void resample_counts_lehmer(uint64_t n, uint64_t m, uint64_t *counts) {
+  resample_counts(n, m, counts, lehmer64);
+}
+
+void resample_counts_pcg(uint64_t n, uint64_t m, uint64_t *counts) {
+  resample_counts(n, m, counts, pcg64);
+}
+
+void resample_counts_chacha(uint64_t n, uint64_t m, uint64_t *counts) {
+  resample_counts(n, m, counts, chacha_u64_global);
+}
+
+// Reentrant API
+
+void br_lehmer_seed(br_lehmer_t *ctx, uint64_t s) {
+  ctx->state = (((__uint128_t)splitmix64_stateless(s)) << 64) +
+               splitmix64_stateless(s + 1);
+}
+
+uint64_t br_lehmer_next(br_lehmer_t *ctx) {
+  ctx->state *= UINT64_C(0xda942042e4dd58b5);
+  return (uint64_t)(ctx->state >> 64);
+}
+
+void br_lehmer_advance(br_lehmer_t *ctx, uint64_t delta) {
+  lehmer64_advance_r(&ctx->state, delta);
+}
+
+void br_lehmer_split(br_lehmer_t *ctx, br_lehmer_t *child) {
+  *child = *ctx;
+  lehmer64_advance_r(&ctx->state, BR_SPLIT_STRIDE);
+}
+
+void br_pcg_seed(br_pcg_t *ctx, uint64_t s) {
+  pcg64_random_t rng;
+  pcg64_seed_r(&rng, s);
+  ctx->state = rng.state;
+  ctx->inc = rng.inc;
+}
+
+uint64_t br_pcg_next(br_pcg_t *ctx) {
+  ctx->state = ctx->state * PCG_DEFAULT_MULTIPLIER_128 + ctx->inc;
+  return pcg_output_xsl_rr_128_64(ctx->state);
+}
+
+void br_pcg_advance(br_pcg_t *ctx, uint64_t delta) {
+  ctx->state = pcg_advance_lcg_128(ctx->state, delta,
+                                   PCG_DEFAULT_MULTIPLIER_128, ctx->inc);
+}
+
+void br_pcg_split(br_pcg_t *ctx, br_pcg_t *child) {
+  *child = *ctx;
+  ctx->state = pcg_advance_lcg_128(ctx->state, BR_SPLIT_STRIDE,
+                                   PCG_DEFAULT_MULTIPLIER_128, ctx->inc);
+}
+
+void br_chacha_seed(br_chacha_t *ctx, uint64_t s) { chacha8_zero(ctx, s); }
+
+void br_chacha_seed_rounds(br_chacha_t *ctx, uint64_t s, size_t rounds) {
+  uint32_t key[8] = {0};
+  chacha_init(ctx, rounds, key, s);
+}
+
+void br_chacha_seed_key(br_chacha_t *ctx, const uint32_t key[8],
+                        uint64_t stream, size_t rounds) {
+  chacha_init(ctx, rounds, key, stream);
+}
+
+uint64_t br_chacha_next(br_chacha_t *ctx) { return chacha_u64(ctx); }
+
+// br_chacha_next uses two 32-bit words per output.
+void br_chacha_advance(br_chacha_t *ctx, uint64_t delta) {
+  if (delta > UINT64_MAX / 2) {
+    chacha_advance(ctx, delta);
+    chacha_advance(ctx, delta);
+  } else {
+    chacha_advance(ctx, 2 * delta);
+  }
+}
+
+void br_chacha_split(br_chacha_t *ctx, br_chacha_t *child) {
+  *child = *ctx;
+  br_chacha_advance(ctx, BR_CHACHA_SPLIT_STRIDE);
+}
+
+// The shuffles and bounded functions with a context inline the generator
+// (BR_DEFINE_INLINE). The other functions with a context run the same code
+// as those without, with a generator that reads the context of the calling
+// thread.
+BR_DEFINE_INLINE(br_lehmer, br_lehmer_t, br_lehmer_next)
+BR_DEFINE_INLINE(br_pcg, br_pcg_t, br_pcg_next)
+BR_DEFINE_INLINE(br_chacha, br_chacha_t, br_chacha_next)
+
+static _Thread_local br_lehmer_t *br_lehmer_current;
+static _Thread_local br_pcg_t *br_pcg_current;
+static _Thread_local br_chacha_t *br_chacha_current;
+
+static uint64_t br_lehmer_current_next(void) {
+  return br_lehmer_next(br_lehmer_current);
+}
+
+static uint64_t br_pcg_current_next(void) {
+  return br_pcg_next(br_pcg_current);
+}
+
+static uint64_t br_chacha_current_next(void) {
+  return br_chacha_next(br_chacha_current);
+}
+
+// Defines the functions with a context of the engine `name`.
+#define BR_DEFINE_REENTRANT(name)                                              \
+  void shuffle_##name##_r(br_##name##_t *ctx, uint64_t *storage,               \
+                          uint64_t size) {                                     \
+    br_##name##_shuffle(ctx, storage, size);                                   \
+  }                                                                            \
+  void shuffle_##name##_2_r(br_##name##_t *ctx, uint64_t *storage,             \
+                            uint64_t size) {                                   \
+    br_##name##_shuffle_2(ctx, storage, size);                                 \
+  }                                                                            \
+  void shuffle_##name##_23456_r(br_##name##_t *ctx, uint64_t *storage,         \
+                                uint64_t size) {                               \
+    br_##name##_shuffle_23456(ctx, storage, size);                             \
+  }                                                                            \
+  void naive_shuffle_##name##_2_r(br_##name##_t *ctx, uint64_t *storage,       \
+                                  uint64_t size) {                             \
+    br_##name##_current = ctx;                                                 \
+    naive_shuffle_batch_2(storage, size, br_##name##_current_next);            \
+  }                                                                            \
+  void shuffle_##name##_23456_4x_r(br_##name##_t *ctx, uint64_t *storage,      \
+                                   uint64_t size) {                            \
+    br_##name##_current = ctx;                                                 \
+    shuffle_batch_23456_4x(storage, size, br_##name##_current_next);           \
+  }                                                                            \
+  void shuffle_##name##_23456_8x_r(br_##name##_t *ctx, uint64_t *storage,      \
+                                   uint64_t size) {                            \
+    br_##name##_current = ctx;                                                 \
+    shuffle_batch_23456_8x(storage, size, br_##name##_current_next);           \
+  }                                                                            \
+  void shuffle_##name##_128_r(br_##name##_t *ctx, uint64_t *storage,           \
+                              uint64_t size) {                                 \
+    br_##name##_current = ctx;                                                 \
+    shuffle_batch_128(storage, size, br_##name##_current_next);                \
+  }                                                                            \
+  void shuffle_##name##_plan_r(br_##name##_t *ctx, uint64_t *storage,          \
+                               const shuffle_plan *plan) {                     \
+    br_##name##_current = ctx;                                                 \
+    shuffle_with_plan(storage, plan, br_##name##_current_next);                \
+  }                                                                            \
+  void shuffle_##name##_23456_blocked_r(br_##name##_t *ctx, uint64_t *storage, \
+                                        uint64_t size) {                       \
+    br_##name##_current = ctx;                                                 \
+    shuffle_batch_23456_blocked(storage, size, SHUFFLE_DEFAULT_BLOCK,          \
+                                br_##name##_current_next);                     \
+  }                                                                            \
+  void shuffle_##name##_prefetch_r(br_##name##_t *ctx, uint64_t *storage,      \
+                                   uint64_t size) {                            \
+    br_##name##_current = ctx;                                                 \
+    shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH,         \
+                                 br_##name##_current_next);                    \
+  }                                                                            \
+  void shuffle_##name##_bucketed_r(br_##name##_t *ctx, uint64_t *storage,      \
+                                   uint64_t size) {                            \
+    br_##name##_current = ctx;                                                 \
+    if (size > SHUFFLE_BUCKETED_MIN) {                                         \
+      shuffle_batch_bucketed(storage, size, br_##name##_current_next);         \
+    } else {                                                                   \
+      shuffle_batch_23456_prefetch(storage, size, SHUFFLE_AUTO_PREFETCH,       \
+                                   br_##name##_current_next);                  \
+    }                                                                          \
+  }                                                                            \
+  void shuffle_bytes_##name##_r(br_##name##_t *ctx, void *base, size_t count,  \
+                                size_t elem_size) {                            \
+    br_##name##_current = ctx;                                                 \
+    shuffle_bytes(base, count, elem_size, br_##name##_current_next);           \
+  }                                                                            \
+  void shuffle_soa_##name##_r(br_##name##_t *ctx, void *const *arrays,         \
+                              const size_t *elem_sizes, size_t ncols,          \
+                              size_t count) {                                  \
+    br_##name##_current = ctx;                                                 \
+    shuffle_soa(arrays, elem_sizes, ncols, count, br_##name##_current_next);   \
+  }                                                                            \
+  void random_permutation_u32_##name##_r(br_##name##_t *ctx, uint32_t *out,   \
+                                         uint64_t n) {                         \
+    br_##name##_current = ctx;                                                 \
+    random_permutation_u32(out, n, br_##name##_current_next);                  \
+  }                                                                            \
+  void random_permutation_u64_##name##_r(br_##name##_t *ctx, uint64_t *out,   \
+                                         uint64_t n) {                         \
+    br_##name##_current = ctx;                                                 \
+    random_permutation_u64(out, n, br_##name##_current_next);                  \
+  }                                                                            \
+  void partial_shuffle_##name##_r(br_##name##_t *ctx, uint64_t *storage,     \
+                                  uint64_t n, uint64_t k) {                    \
+    br_##name##_current = ctx;                                                 \
+    partial_shuffle(storage, n, k, br_##name##_current_next);                  \
+  }                                                                            \
+  int sample_without_replacement_##name##_r(br_##name##_t *ctx, uint64_t n,   \
+                                            uint64_t k, uint64_t *out) {       \
+    br_##name##_current = ctx;                                                 \
+    return sample_without_replacement(n, k, out, br_##name##_current_next);    \
+  }                                                                            \
+  void resample_with_replacement_##name##_r(                                   \
+      br_##name##_t *ctx, const uint64_t *src, uint64_t n, uint64_t *dst,      \
+      uint64_t m) {                                                            \
+    br_##name##_current = ctx;                                                 \
+    resample_with_replacement(src, n, dst, m, br_##name##_current_next);       \
+  }                                                                            \
+  void resample_bytes_##name##_r(br_##name##_t *ctx, const void *src,          \
+                                 uint64_t n, size_t elem_size, void *dst,      \
+                                 uint64_t m) {                                 \
+    br_##name##_current = ctx;                                                 \
+    resample_bytes(src, n, elem_size, dst, m, br_##name##_current_next);       \
+  }                                                                            \
+  void resample_counts_##name##_r(br_##name##_t *ctx, uint64_t n, uint64_t m,  \
+                                  uint64_t *counts) {                          \
+    br_##name##_current = ctx;                                                 \
+    resample_counts(n, m, counts, br_##name##_current_next);                   \
+  }                                                                            \
+  uint64_t random_bounded_##name##_r(br_##name##_t *ctx, uint64_t range) {     \
+    return br_##name##_random_bounded(ctx, range);                             \
+  }                                                                            \
+  void random_bounded_fill_##name##_r(br_##name##_t *ctx, uint64_t range,      \
+                                      uint64_t *out, uint64_t count) {         \
+    br_##name##_random_bounded_fill(ctx, range, out, count);                   \
+  }                                                                            \
+  void random_bounded_ranges_##name##_r(br_##name##_t *ctx,                    \
+                                        const uint64_t *ranges, uint64_t *out, \
+                                        uint64_t count) {                      \
+    br_##name##_random_bounded_ranges(ctx, ranges, out, count);                \
+  }
+
+BR_DEFINE_REENTRANT(lehmer)
+BR_DEFINE_REENTRANT(pcg)
+BR_DEFINE_REENTRANT(chacha)
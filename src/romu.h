@@ -0,0 +1,40 @@
+#ifndef ROMU_H
+#define ROMU_H
+#include <stdint.h>
+
+#include "random_bounded.h" // BR_DEFAULT_ENGINE
+#include "splitmix64.h"
+
+/**
+ * RomuDuoJr, the fastest of the Romu generators, from M. Overton, Romu:
+ * Fast Nonlinear Pseudo-Random Number Generators Providing High Quality,
+ * 2020. https://www.romu-random.org (Apache License 2.0)
+ *
+ * Its capacity is about 2^51 bytes: plenty for shuffling.
+ */
+typedef struct {
+  uint64_t x;
+  uint64_t y;
+} romu_t;
+
+BR_DEFAULT_ENGINE romu_t romu_global;
+
+// Two consecutive outputs of splitmix64 cannot both be zero.
+static inline void romu_seed_r(romu_t *rng, uint64_t seed) {
+  rng->x = splitmix64_stateless_offset(seed, 0);
+  rng->y = splitmix64_stateless_offset(seed, 1);
+}
+
+static inline uint64_t romu_r(romu_t *rng) {
+  uint64_t xp = rng->x;
+  rng->x = UINT64_C(15241094284759029579) * rng->y;
+  rng->y = rng->y - xp;
+  rng->y = (rng->y << 27) | (rng->y >> 37);
+  return xp;
+}
+
+static inline void romu_seed(uint64_t seed) { romu_seed_r(&romu_global, seed); }
+
+static inline uint64_t romu(void) { return romu_r(&romu_global); }
+
+#endif
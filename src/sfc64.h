@@ -0,0 +1,46 @@
+#ifndef SFC64_H
+#define SFC64_H
+#include <stdint.h>
+
+#include "random_bounded.h" // BR_DEFAULT_ENGINE
+#include "splitmix64.h"
+
+/**
+ * SFC64 (small fast chaotic), by C. Doty-Humphrey, from PractRand 0.94.
+ * http://pracrand.sourceforge.net (public domain)
+ */
+typedef struct {
+  uint64_t a;
+  uint64_t b;
+  uint64_t c;
+  uint64_t counter;
+} sfc64_t;
+
+BR_DEFAULT_ENGINE sfc64_t sfc64_global;
+
+static inline uint64_t sfc64_r(sfc64_t *rng) {
+  uint64_t tmp = rng->a + rng->b + rng->counter++;
+  rng->a = rng->b ^ (rng->b >> 11);
+  rng->b = rng->c + (rng->c << 3);
+  rng->c = ((rng->c << 24) | (rng->c >> 40)) + tmp;
+  return tmp;
+}
+
+// As in PractRand, the first 12 outputs are discarded.
+static inline void sfc64_seed_r(sfc64_t *rng, uint64_t seed) {
+  rng->a = splitmix64_stateless_offset(seed, 0);
+  rng->b = splitmix64_stateless_offset(seed, 1);
+  rng->c = splitmix64_stateless_offset(seed, 2);
+  rng->counter = 1;
+  for (int i = 0; i < 12; i++) {
+    sfc64_r(rng);
+  }
+}
+
+static inline void sfc64_seed(uint64_t seed) {
+  sfc64_seed_r(&sfc64_global, seed);
+}
+
+static inline uint64_t sfc64(void) { return sfc64_r(&sfc64_global); }
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef WYRAND_H
+#define WYRAND_H
+#include <stdint.h>
+
+#include "random_bounded.h" // BR_DEFAULT_ENGINE
+#include "splitmix64.h"
+
+/**
+ * wyrand, from wyhash final version 3 by Wang Yi (final version 4 changed
+ * the constants).
+ * https://github.com/wangyi-fudan/wyhash (public domain)
+ */
+typedef struct {
+  uint64_t state;
+} wyrand_t;
+
+BR_DEFAULT_ENGINE wyrand_t wyrand_global;
+
+static inline void wyrand_seed_r(wyrand_t *rng, uint64_t seed) {
+  rng->state = splitmix64_stateless_offset(seed, 0);
+}
+
+static inline uint64_t wyrand_r(wyrand_t *rng) {
+  rng->state += UINT64_C(0xa0761d6478bd642f);
+  __uint128_t t =
+      (__uint128_t)rng->state * (rng->state ^ UINT64_C(0xe7037ed1a0b428db));
+  return (uint64_t)(t >> 64) ^ (uint64_t)t;
+}
+
+static inline void wyrand_seed(uint64_t seed) {
+  wyrand_seed_r(&wyrand_global, seed);
+}
+
+static inline uint64_t wyrand(void) { return wyrand_r(&wyrand_global); }
+
+#endif
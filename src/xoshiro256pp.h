@@ -0,0 +1,52 @@
+#ifndef XOSHIRO256PP_H
+#define XOSHIRO256PP_H
+#include <stdint.h>
+
+#include "random_bounded.h" // BR_DEFAULT_ENGINE
+#include "splitmix64.h"
+
+/**
+ * xoshiro256++ 1.0, D. Blackman and S. Vigna, Scrambled Linear Pseudorandom
+ * Number Generators, ACM Transactions on Mathematical Software 47 (4), 2021.
+ * https://prng.di.unimi.it/xoshiro256plusplus.c (public domain)
+ */
+typedef struct {
+  uint64_t s[4];
+} xoshiro256pp_t;
+
+BR_DEFAULT_ENGINE xoshiro256pp_t xoshiro256pp_global;
+
+static inline uint64_t xoshiro256pp_rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+// The state is four consecutive outputs of splitmix64, which cannot all be
+// zero.
+static inline void xoshiro256pp_seed_r(xoshiro256pp_t *rng, uint64_t seed) {
+  for (uint64_t i = 0; i < 4; i++) {
+    rng->s[i] = splitmix64_stateless_offset(seed, i);
+  }
+}
+
+static inline uint64_t xoshiro256pp_r(xoshiro256pp_t *rng) {
+  uint64_t *s = rng->s;
+  const uint64_t result = xoshiro256pp_rotl(s[0] + s[3], 23) + s[0];
+  const uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = xoshiro256pp_rotl(s[3], 45);
+  return result;
+}
+
+static inline void xoshiro256pp_seed(uint64_t seed) {
+  xoshiro256pp_seed_r(&xoshiro256pp_global, seed);
+}
+
+static inline uint64_t xoshiro256pp(void) {
+  return xoshiro256pp_r(&xoshiro256pp_global);
+}
+
+#endif
@@ -1,13 +1,21 @@
+#include <algorithm>
 #include <array>
 #include <bitset>
+#include <execution>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
 #include <limits>
+#include <random>
+#include <span>
+#include <thread>
+#include <vector>
 
 extern "C" {
 #include "random_bounded.h"
 }
+#include "random_bounded_inline.h"
+#include "generators.h"
 #include "template_shuffle.h"
 
 /***
@@ -135,6 +143,38 @@ bool any_possible_pair_at_the_end(const function_type &function) {
   return true;
 }
 
+// Shuffles many small arrays and checks that every permutation of the n
+// elements shows up about equally often.
+template <class function_type>
+bool all_permutations_equally_likely(const function_type &function, size_t n) {
+  size_t factorial = 1;
+  for (size_t i = 2; i <= n; i++) {
+    factorial *= i;
+  }
+  constexpr size_t expected = 2000;
+  std::vector<size_t> counts(factorial);
+  uint64_t input[8];
+  for (size_t trial = 0; trial < expected * factorial; trial++) {
+    std::iota(input, input + n, 0);
+    function(input, n);
+    // Lehmer code of the permutation
+    size_t code = 0;
+    for (size_t i = 0; i < n; i++) {
+      size_t smaller = 0;
+      for (size_t j = i + 1; j < n; j++) {
+        smaller += input[j] < input[i];
+      }
+      code = code * (n - i) + smaller;
+    }
+    counts[code]++;
+  }
+  size_t max_value = *std::max_element(counts.begin(), counts.end());
+  size_t min_value = *std::min_element(counts.begin(), counts.end());
+  double relative_gap = double(max_value - min_value) / expected;
+  printf("relative gap: %f, ", relative_gap);
+  return relative_gap < 0.25;
+}
+
 struct named_function {
   std::string name;
   shuffle_function function;
@@ -144,9 +184,82 @@ named_function func[] = {
     {"shuffle_lehmer", shuffle_lehmer},
     {"shuffle_lehmer_2", shuffle_lehmer_2},
     {"shuffle_lehmer_23456", shuffle_lehmer_23456},
+    {"shuffle_lehmer_23456_4x", shuffle_lehmer_23456_4x},
+    {"shuffle_lehmer_23456_8x", shuffle_lehmer_23456_8x},
+    {"shuffle_lehmer_23456_lanes", shuffle_lehmer_23456_lanes},
+    {"batched_random::shuffle_small",
+     [](uint64_t *storage, uint64_t size) {
+       static lehmer64 g(1234);
+       batched_random::shuffle_small(storage, storage + size, g);
+     }},
+    {"shuffle_lehmer_128", shuffle_lehmer_128},
+    {"batched_random::shuffle_128",
+     [](uint64_t *storage, uint64_t size) {
+       static lehmer64 g(1234);
+       batched_random::shuffle_128(storage, storage + size, g);
+     }},
+    // Fisher-Yates shuffle using only batches of (up to) three dice rolled
+    // from 128 bits, as shuffle_128 does above 2^30 elements
+    {"batched_random::partial_shuffle_128b",
+     [](uint64_t *storage, uint64_t size) {
+       static lehmer64 g(1234);
+       for (uint64_t i = size; i > 1;) {
+         uint64_t k = i > 3 ? 3 : i - 1;
+         batched_random::partial_shuffle_128b(storage, i, k,
+                                              (__uint128_t)1 << 120, g);
+         i -= k;
+       }
+     }},
+    {"shuffle_lehmer_23456_blocked", shuffle_lehmer_23456_blocked},
+    {"batched_random::shuffle_23456_blocked",
+     [](uint64_t *storage, uint64_t size) {
+       static lehmer64 g(1234);
+       batched_random::shuffle_23456_blocked(storage, storage + size, g, 3);
+     }},
+    {"shuffle_lehmer_prefetch", shuffle_lehmer_prefetch},
+    {"batched_random::shuffle_23456_prefetch",
+     [](uint64_t *storage, uint64_t size) {
+       static lehmer64 g(1234);
+       batched_random::shuffle_23456_prefetch(storage, storage + size, g, 2);
+     }},
+    {"shuffle_parallel",
+     [](uint64_t *storage, uint64_t size) {
+       static uint64_t seed = 1234;
+       shuffle_parallel(storage, size, 4, seed++);
+     }},
     {"shuffle_pcg", shuffle_pcg},
     {"shuffle_pcg_2", shuffle_pcg_2},
-    {"shuffle_pcg_23456", shuffle_pcg_23456}
+    {"shuffle_pcg_23456", shuffle_pcg_23456},
+    {"shuffle_pcg_23456_lanes", shuffle_pcg_23456_lanes},
+    {"shuffle_xoshiro256pp_23456", shuffle_xoshiro256pp_23456},
+    {"shuffle_wyrand_23456", shuffle_wyrand_23456},
+    {"shuffle_sfc64_23456", shuffle_sfc64_23456},
+    {"shuffle_romu_23456", shuffle_romu_23456},
+    // generators that do not produce 64-bit words
+    {"batched_random::shuffle_23456 (std::mt19937)",
+     [](uint64_t *storage, uint64_t size) {
+       static std::mt19937 g(1234);
+       batched_random::shuffle_23456(storage, storage + size, g);
+     }},
+    {"batched_random::shuffle_23456 (pcg32)",
+     [](uint64_t *storage, uint64_t size) {
+       static pcg32 g(1234);
+       batched_random::shuffle_23456(storage, storage + size, g);
+     }},
+    {"batched_random::shuffle_2 (std::minstd_rand)",
+     [](uint64_t *storage, uint64_t size) {
+       static std::minstd_rand g(1234);
+       batched_random::shuffle_2(storage, storage + size, g);
+     }},
+    {"shuffle_philox_23456", shuffle_philox_23456},
+    {"shuffle_aes_23456", shuffle_aes_23456},
+    // random permutations, which overwrite the input 0, 1, ..., size-1
+    {"random_permutation_u64_lehmer", random_permutation_u64_lehmer},
+    {"batched_random::random_permutation (lehmer64)",
+     [](uint64_t *storage, uint64_t size) {
+       static lehmer64 g(1234);
+       batched_random::random_permutation(storage, storage + size, g);
+     }}
 };
 
 bool test_everyone_can_move_everywhere() {
@@ -209,6 +322,1574 @@ bool test_any_possible_pair_at_the_end() {
   return true;
 }
 
+// Checks that random_bounded_fill produces values in [0, range) that are
+// roughly uniform, for small ranges (many dice per word) and large ones.
+bool test_random_bounded_fill() {
+  std::cout << __FUNCTION__ << std::endl;
+  const uint64_t ranges[] = {1, 2, 3, 6, 7, 10, 100, 1000, 65537, 1 << 20};
+  std::vector<uint64_t> out;
+  std::vector<size_t> histogram;
+  for (uint64_t range : ranges) {
+    std::cout << std::setw(40) << range << ": ";
+    // odd count so that we exercise the tail
+    size_t count = range <= 1000 ? 1000 * range + 3 : 3 * range + 1;
+    out.assign(count, UINT64_MAX);
+    histogram.assign(range, 0);
+    random_bounded_fill_lehmer(range, out.data(), count);
+    for (uint64_t v : out) {
+      if (v >= range) {
+        std::cerr << "!!!Test failed for range " << range << std::endl;
+        return false;
+      }
+      histogram[v]++;
+    }
+    if (range <= 1000) {
+      size_t max_value = *std::max_element(histogram.begin(), histogram.end());
+      size_t min_value = *std::min_element(histogram.begin(), histogram.end());
+      double relative_gap = double(max_value - min_value) / 1000;
+      printf("relative gap: %f, ", relative_gap);
+      if (relative_gap > 0.35) {
+        std::cerr << "!!!Test failed for range " << range << std::endl;
+        return false;
+      }
+    }
+    std::cout << "passed" << std::endl;
+  }
+  return true;
+}
+
+// Checks that random_bounded_ranges respects each individual range and that
+// every die is roughly uniform, mixing small ranges (grouped many per word)
+// with large ones (one per word).
+bool test_random_bounded_ranges() {
+  std::cout << __FUNCTION__ << std::endl;
+  const uint64_t pattern[] = {1, 2, 3, 5, 7, 64, 1000, 3, 1 << 20, 2, 17};
+  constexpr size_t pattern_size = sizeof(pattern) / sizeof(pattern[0]);
+  constexpr size_t repeat = 100000;
+  std::vector<uint64_t> ranges(pattern_size * repeat);
+  for (size_t i = 0; i < ranges.size(); i++) {
+    ranges[i] = pattern[i % pattern_size];
+  }
+  std::vector<uint64_t> out(ranges.size());
+  random_bounded_ranges_lehmer(ranges.data(), out.data(), out.size());
+  for (size_t j = 0; j < pattern_size; j++) {
+    std::cout << std::setw(40) << pattern[j] << ": ";
+    std::vector<size_t> histogram(pattern[j]);
+    for (size_t i = j; i < out.size(); i += pattern_size) {
+      if (out[i] >= ranges[i]) {
+        std::cerr << "!!!Test failed for range " << pattern[j] << std::endl;
+        return false;
+      }
+      histogram[out[i]]++;
+    }
+    if (pattern[j] <= 64) {
+      size_t max_value = *std::max_element(histogram.begin(), histogram.end());
+      size_t min_value = *std::min_element(histogram.begin(), histogram.end());
+      double relative_gap = double(max_value - min_value) * pattern[j] / repeat;
+      printf("relative gap: %f, ", relative_gap);
+      if (relative_gap > 0.3) {
+        std::cerr << "!!!Test failed for range " << pattern[j] << std::endl;
+        return false;
+      }
+    }
+    std::cout << "passed" << std::endl;
+  }
+  return true;
+}
+
+// A deterministic generator for comparing implementations. Every fifth
+// output is zero so that the rejection paths get exercised.
+static uint64_t test_rng_state;
+static uint64_t test_rng_counter;
+static void test_rng_seed(uint64_t s) {
+  test_rng_state = s;
+  test_rng_counter = 0;
+}
+static uint64_t test_rng() {
+  if (++test_rng_counter % 5 == 0) {
+    return 0;
+  }
+  uint64_t z = (test_rng_state += UINT64_C(0x9E3779B97F4A7C15));
+  z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+  z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+  return z ^ (z >> 31);
+}
+
+// Four lanes of test_rng: the selected lanes take its next words in order.
+static void test_rng4(uint64_t *out, uint64_t lanes) {
+  for (int j = 0; j < 4; j++) {
+    if ((lanes >> j) & 1) {
+      out[j] = test_rng();
+    }
+  }
+}
+
+using interleaved_kernel = uint64_t (*)(uint64_t, uint64_t, uint64_t,
+                                        uint64_t (*)(void), uint64_t *);
+
+// Checks that the SIMD interleaved dice kernels produce exactly the same
+// dice, bounds and random-number consumption as the portable ones.
+bool test_interleaved_simd_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  struct kernel_pair {
+    std::string name;
+    uint64_t lanes;
+    interleaved_kernel scalar;
+    interleaved_kernel simd;
+  } pairs[] = {{"partial_shuffle_dice_64b_interleaved_4x", 4,
+                partial_shuffle_dice_64b_interleaved_4x,
+                partial_shuffle_dice_64b_interleaved_4x_simd},
+               {"partial_shuffle_dice_64b_interleaved_8x", 8,
+                partial_shuffle_dice_64b_interleaved_8x,
+                partial_shuffle_dice_64b_interleaved_8x_simd}};
+  for (const kernel_pair &p : pairs) {
+    std::cout << std::setw(40) << p.name << ": ";
+    for (uint64_t k = 1; k <= 6; k++) {
+      // the product of the dice in a batch must stay below 2^60
+      uint64_t max_n = uint64_t(1) << (60 / k);
+      for (uint64_t n = p.lanes * k; n < max_n; n = n * 3 / 2 + 1) {
+        uint64_t expected[8 * 6], actual[8 * 6];
+        for (uint64_t trial = 0; trial < 20; trial++) {
+          test_rng_seed(trial);
+          uint64_t expected_bound =
+              p.scalar(n, k, (uint64_t)1 << 60, test_rng, expected);
+          uint64_t expected_counter = test_rng_counter;
+          test_rng_seed(trial);
+          uint64_t actual_bound =
+              p.simd(n, k, (uint64_t)1 << 60, test_rng, actual);
+          if (expected_bound != actual_bound ||
+              expected_counter != test_rng_counter ||
+              !std::equal(expected, expected + p.lanes * k, actual)) {
+            std::cerr << "!!!Test failed for " << p.name << " n = " << n
+                      << " k = " << k << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+    std::cout << "passed" << std::endl;
+  }
+  // The four-lane kernels: the scalar and SIMD versions must agree. A
+  // rejected batch draws one word from its own lane, so with test_rng4 they
+  // must roll the same dice as the interleaved kernel, from the same words.
+  std::cout << std::setw(40) << "partial_shuffle_dice_64b_lanes_4x" << ": ";
+  for (uint64_t k = 1; k <= 6; k++) {
+    uint64_t max_n = uint64_t(1) << (60 / k);
+    for (uint64_t n = 4 * k; n < max_n; n = n * 3 / 2 + 1) {
+      uint64_t interleaved[4 * 6], expected[4 * 6], actual[4 * 6];
+      for (uint64_t trial = 0; trial < 20; trial++) {
+        test_rng_seed(trial);
+        uint64_t interleaved_bound = partial_shuffle_dice_64b_interleaved_4x(
+            n, k, (uint64_t)1 << 60, test_rng, interleaved);
+        uint64_t interleaved_counter = test_rng_counter;
+        test_rng_seed(trial);
+        uint64_t expected_bound = partial_shuffle_dice_64b_lanes_4x(
+            n, k, (uint64_t)1 << 60, test_rng4, expected);
+        uint64_t expected_counter = test_rng_counter;
+        test_rng_seed(trial);
+        uint64_t actual_bound = partial_shuffle_dice_64b_lanes_4x_simd(
+            n, k, (uint64_t)1 << 60, test_rng4, actual);
+        if (expected_bound != actual_bound ||
+            expected_counter != test_rng_counter ||
+            !std::equal(expected, expected + 4 * k, actual) ||
+            expected_bound != interleaved_bound ||
+            expected_counter != interleaved_counter ||
+            !std::equal(expected, expected + 4 * k, interleaved)) {
+          std::cerr << "!!!Test failed for partial_shuffle_dice_64b_lanes_4x"
+                    << " n = " << n << " k = " << k << std::endl;
+          return false;
+        }
+      }
+    }
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// URBG wrapper around test_rng, for the C++ templates.
+struct test_urbg {
+  using result_type = uint64_t;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+  result_type operator()() { return test_rng(); }
+};
+
+// The tables of small_dice_schedule.h must follow their rules: groups of die
+// sizes taken greedily from 64 down with products up to 2^12, numbered from
+// the smallest sizes, and their thresholds.
+bool test_small_dice_schedule() {
+  std::cout << __FUNCTION__ << std::endl;
+  uint16_t sizes[5][32];
+  uint16_t thresholds[32] = {};
+  uint8_t slot[65] = {};
+  small_dice_head heads[65] = {};
+  std::fill(&sizes[0][0], &sizes[0][0] + 5 * 32, uint16_t(1));
+  std::vector<std::vector<uint32_t>> groups;
+  for (uint32_t size = 64; size >= 2;) {
+    std::vector<uint32_t> group;
+    for (uint32_t product = 1; size >= 2 && product * size <= 4096; size--) {
+      product *= size;
+      group.push_back(size);
+    }
+    groups.push_back(group);
+  }
+  bool success = groups.size() <= 32;
+  for (size_t g = 0; g < groups.size() && success; g++) {
+    uint32_t lane = uint32_t(groups.size() - 1 - g);
+    uint32_t product = 1;
+    for (size_t s = 0; s < groups[g].size(); s++) {
+      sizes[s][lane] = uint16_t(groups[g][s]);
+      slot[groups[g][s]] = uint8_t(s * 32 + lane);
+      product *= groups[g][s];
+    }
+    thresholds[lane] = uint16_t(65536 % product);
+    success &= groups[g].size() <= (lane < SMALL_DEEP_LANES ? 5u : 2u);
+    product = 1;
+    for (size_t s = groups[g].size(); s-- > 0;) {
+      product *= groups[g][s];
+      heads[groups[g][s]] = {uint8_t(lane), uint16_t(65536 % product)};
+    }
+  }
+  success &= std::equal(&sizes[0][0], &sizes[0][0] + 5 * 32,
+                        &small_lane_sizes[0][0]) &&
+             std::equal(thresholds, thresholds + 32, small_lane_thresholds) &&
+             std::equal(slot, slot + 65, small_dice_slot);
+  for (uint32_t n = 2; n <= 64; n++) {
+    success &= heads[n].lane == small_dice_heads[n].lane &&
+               heads[n].threshold == small_dice_heads[n].threshold;
+  }
+  if (!success) {
+    std::cerr << "!!!The small dice schedule does not match its rules"
+              << std::endl;
+    return false;
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The C and C++ small-array shuffles share their dice schedule: they must
+// produce the same permutations from the same random words, including when
+// lanes are rejected.
+bool test_small_shuffle_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n = 2; n <= 64; n++) {
+    for (uint64_t trial = 0; trial < 100; trial++) {
+      std::vector<uint64_t> expected(n), actual(n);
+      for (uint64_t i = 0; i < n; i++) {
+        expected[i] = actual[i] = i;
+      }
+      test_rng_seed(trial);
+      shuffle_batch_small(expected.data(), n, test_rng);
+      uint64_t expected_counter = test_rng_counter;
+      test_rng_seed(trial);
+      test_urbg g;
+      batched_random::shuffle_small(actual.begin(), actual.end(), g);
+      if (expected != actual || expected_counter != test_rng_counter) {
+        std::cerr << "!!!Test failed for n = " << n << std::endl;
+        return false;
+      }
+    }
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The C and C++ 128-bit shuffles must produce the same permutations from
+// the same random words.
+bool test_shuffle_128_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n : {0, 1, 2, 7, 100, 1025, 32775}) {
+    std::vector<uint64_t> expected(n), actual(n);
+    for (uint64_t i = 0; i < n; i++) {
+      expected[i] = actual[i] = i;
+    }
+    test_rng_seed(n);
+    shuffle_batch_128(expected.data(), n, test_rng);
+    uint64_t expected_counter = test_rng_counter;
+    test_rng_seed(n);
+    test_urbg g;
+    batched_random::shuffle_128(actual.begin(), actual.end(), g);
+    if (expected != actual || expected_counter != test_rng_counter) {
+      std::cerr << "!!!Test failed for n = " << n << std::endl;
+      return false;
+    }
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// Shuffling with a plan must give the same permutations as shuffle_23456,
+// in C and in C++, including when batches are rejected.
+bool test_shuffle_plan_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n : {0, 1, 2, 6, 7, 100, 513, 2049, 16387, (1 << 19) + 5}) {
+    shuffle_plan plan;
+    if (shuffle_plan_init(&plan, n) != 0) {
+      std::cerr << "!!!Could not allocate a plan for n = " << n << std::endl;
+      return false;
+    }
+    batched_random::shuffle_plan cpp_plan(n);
+    std::vector<uint64_t> expected(n), actual(n), cpp_expected(n),
+        cpp_actual(n);
+    for (uint64_t i = 0; i < n; i++) {
+      expected[i] = actual[i] = cpp_expected[i] = cpp_actual[i] = i;
+    }
+    test_rng_seed(n);
+    shuffle_batch_23456(expected.data(), n, test_rng);
+    test_rng_seed(n);
+    shuffle_with_plan(actual.data(), &plan, test_rng);
+    test_urbg g;
+    test_rng_seed(n);
+    batched_random::shuffle_23456(cpp_expected.begin(), cpp_expected.end(), g);
+    test_rng_seed(n);
+    cpp_plan.shuffle(cpp_actual.begin(), cpp_actual.end(), g);
+    shuffle_plan_free(&plan);
+    if (expected != actual || cpp_expected != cpp_actual) {
+      std::cerr << "!!!Test failed for n = " << n << std::endl;
+      return false;
+    }
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The blocked shuffles roll the dice of shuffle_23456 ahead of the swaps:
+// they must give the same permutation from the same random words, whatever
+// the block size.
+bool test_blocked_shuffle_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n : {0, 1, 2, 6, 7, 100, 513, 2049, 16387, (1 << 19) + 5}) {
+    std::vector<uint64_t> expected(n), cpp_expected(n);
+    for (uint64_t i = 0; i < n; i++) {
+      expected[i] = cpp_expected[i] = i;
+    }
+    test_rng_seed(n);
+    shuffle_batch_23456(expected.data(), n, test_rng);
+    test_urbg g;
+    test_rng_seed(n);
+    batched_random::shuffle_23456(cpp_expected.begin(), cpp_expected.end(), g);
+    for (uint64_t block : {0, 1, 5, 64, 1000, 1 << 20}) {
+      std::vector<uint64_t> actual(n), cpp_actual(n);
+      for (uint64_t i = 0; i < n; i++) {
+        actual[i] = cpp_actual[i] = i;
+      }
+      test_rng_seed(n);
+      shuffle_batch_23456_blocked(actual.data(), n, block, test_rng);
+      test_rng_seed(n);
+      batched_random::shuffle_23456_blocked(cpp_actual.begin(),
+                                            cpp_actual.end(), g, block);
+      if (expected != actual || cpp_expected != cpp_actual) {
+        std::cerr << "!!!Test failed for n = " << n << " block = " << block
+                  << std::endl;
+        return false;
+      }
+    }
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The prefetching shuffles roll the dice ahead of the swaps, so that a
+// target is often rolled before an earlier swap moves it: they must still
+// give the same permutation as shuffle_23456 from the same random words.
+bool test_prefetch_shuffle_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n : {0, 1, 2, 6, 7, 100, 513, 2049, 16387, (1 << 20) + 5}) {
+    std::vector<uint64_t> expected(n), cpp_expected(n);
+    for (uint64_t i = 0; i < n; i++) {
+      expected[i] = cpp_expected[i] = i;
+    }
+    test_rng_seed(n);
+    shuffle_batch_23456(expected.data(), n, test_rng);
+    test_urbg g;
+    test_rng_seed(n);
+    batched_random::shuffle_23456(cpp_expected.begin(), cpp_expected.end(), g);
+    for (uint64_t distance :
+         {uint64_t(0), uint64_t(1), uint64_t(7), uint64_t(64), uint64_t(1000),
+          uint64_t(SHUFFLE_AUTO_PREFETCH)}) {
+      std::vector<uint64_t> actual(n), cpp_actual(n);
+      for (uint64_t i = 0; i < n; i++) {
+        actual[i] = cpp_actual[i] = i;
+      }
+      test_rng_seed(n);
+      shuffle_batch_23456_prefetch(actual.data(), n, distance, test_rng);
+      test_rng_seed(n);
+      batched_random::shuffle_23456_prefetch(cpp_actual.begin(),
+                                             cpp_actual.end(), g, distance);
+      if (expected != actual || cpp_expected != cpp_actual) {
+        std::cerr << "!!!Test failed for n = " << n
+                  << " distance = " << distance << std::endl;
+        return false;
+      }
+    }
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// shuffle_bytes must move records of any size the way shuffle_batch_23456
+// moves words, including through the prefetching path of large arrays.
+bool test_shuffle_bytes_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n : {0, 1, 2, 6, 7, 100, 513, 2049, 16387, (1 << 19) + 5}) {
+    std::vector<uint64_t> expected(n);
+    for (uint64_t i = 0; i < n; i++) {
+      expected[i] = i;
+    }
+    test_rng_seed(n);
+    shuffle_batch_23456(expected.data(), n, test_rng);
+    for (size_t elem_size : {1, 2, 3, 4, 8, 12, 16, 32, 64, 100, 256}) {
+      if (n > (1 << 16) && elem_size > 8) {
+        continue;
+      }
+      auto record_byte = [](uint64_t i, size_t b) {
+        return uint8_t((i >> (8 * (b % 8))) + b / 8 * 131);
+      };
+      std::vector<uint8_t> records(n * elem_size);
+      for (uint64_t i = 0; i < n; i++) {
+        for (size_t b = 0; b < elem_size; b++) {
+          records[i * elem_size + b] = record_byte(i, b);
+        }
+      }
+      test_rng_seed(n);
+      shuffle_bytes(records.data(), n, elem_size, test_rng);
+      for (uint64_t i = 0; i < n; i++) {
+        for (size_t b = 0; b < elem_size; b++) {
+          if (records[i * elem_size + b] != record_byte(expected[i], b)) {
+            std::cerr << "!!!Test failed for n = " << n
+                      << " elem_size = " << elem_size << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The columns shuffled together must all follow the permutation that
+// shuffle_batch_23456 (in C) or shuffle_23456_blocked (in C++) gives from the
+// same random words.
+bool test_shuffle_together() {
+  std::cout << __FUNCTION__ << std::endl;
+  struct triple {
+    uint32_t v[3];
+    bool operator==(const triple &) const = default;
+  };
+  for (uint64_t n : {0, 1, 2, 7, 100, 2049, 16387, (1 << 19) + 5}) {
+    std::vector<uint64_t> expected(n);
+    std::iota(expected.begin(), expected.end(), 0);
+    test_rng_seed(n);
+    shuffle_batch_23456(expected.data(), n, test_rng);
+    std::vector<uint8_t> bytes(n);
+    std::vector<uint32_t> ids(n);
+    std::vector<uint64_t> words(n);
+    std::vector<triple> triples(n);
+    std::vector<std::array<uint64_t, 8>> lines(n);
+    auto fill = [&]() {
+      for (uint64_t i = 0; i < n; i++) {
+        bytes[i] = uint8_t(i);
+        ids[i] = uint32_t(i);
+        words[i] = i * 3;
+        triples[i] = {{uint32_t(i), uint32_t(i + 1), uint32_t(i + 2)}};
+        lines[i].fill(i);
+      }
+    };
+    auto check = [&](const char *name) {
+      for (uint64_t i = 0; i < n; i++) {
+        uint64_t e = expected[i];
+        if (bytes[i] != uint8_t(e) || ids[i] != uint32_t(e) ||
+            words[i] != e * 3 ||
+            !(triples[i] ==
+              triple{{uint32_t(e), uint32_t(e + 1), uint32_t(e + 2)}}) ||
+            lines[i][7] != e) {
+          std::cerr << "!!!Test failed for " << name << " n = " << n
+                    << std::endl;
+          return false;
+        }
+      }
+      return true;
+    };
+    fill();
+    void *const arrays[] = {bytes.data(), ids.data(), words.data(),
+                            triples.data(), lines.data()};
+    const size_t elem_sizes[] = {sizeof(uint8_t), sizeof(uint32_t),
+                                 sizeof(uint64_t), sizeof(triple),
+                                 sizeof(lines[0])};
+    test_rng_seed(n);
+    shuffle_soa(arrays, elem_sizes, 5, n, test_rng);
+    if (!check("shuffle_soa")) {
+      return false;
+    }
+    fill();
+    test_urbg g;
+    std::iota(expected.begin(), expected.end(), 0);
+    test_rng_seed(n);
+    batched_random::shuffle_23456_blocked(expected.begin(), expected.end(), g);
+    test_rng_seed(n);
+    batched_random::shuffle_together(g, bytes, ids, words, triples, lines);
+    if (!check("shuffle_together")) {
+      return false;
+    }
+  }
+  // More columns than shuffle_soa picks kernels for on the stack.
+  const uint64_t n = 1000;
+  std::vector<uint64_t> expected(n);
+  std::iota(expected.begin(), expected.end(), 0);
+  test_rng_seed(n);
+  shuffle_batch_23456(expected.data(), n, test_rng);
+  std::vector<std::vector<uint16_t>> columns(20, std::vector<uint16_t>(n));
+  std::vector<void *> arrays;
+  std::vector<size_t> elem_sizes(columns.size(), sizeof(uint16_t));
+  for (auto &column : columns) {
+    std::iota(column.begin(), column.end(), 0);
+    arrays.push_back(column.data());
+  }
+  test_rng_seed(n);
+  shuffle_soa(arrays.data(), elem_sizes.data(), columns.size(), n, test_rng);
+  for (auto &column : columns) {
+    if (!std::equal(column.begin(), column.end(), expected.begin())) {
+      std::cerr << "!!!Test failed for shuffle_soa with " << columns.size()
+                << " arrays" << std::endl;
+      return false;
+    }
+  }
+  // Ranges of different sizes are rejected before any swap.
+  std::vector<uint32_t> longer(n + 1, 0);
+  test_urbg g;
+  try {
+    batched_random::shuffle_together(g, columns[0], longer);
+    std::cerr << "!!!Test failed: shuffle_together accepted ranges of "
+                 "different sizes" << std::endl;
+    return false;
+  } catch (const std::invalid_argument &) {
+  }
+  if (!std::equal(columns[0].begin(), columns[0].end(), expected.begin())) {
+    std::cerr << "!!!Test failed: shuffle_together swapped before throwing"
+              << std::endl;
+    return false;
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The random permutations must be permutations, the same with 32-bit and
+// 64-bit values and in C++, through the batches of every size, and
+// whether the output is initialized or not.
+bool test_random_permutation() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n : {0, 1, 2, 6, 7, 100, 513, 2049, 16387, (1 << 19) + 5}) {
+    std::vector<uint64_t> wide(n, UINT64_MAX), cpp(n);
+    std::vector<uint32_t> narrow(n);
+    test_rng_seed(n);
+    random_permutation_u64(wide.data(), n, test_rng);
+    test_rng_seed(n);
+    random_permutation_u32(narrow.data(), n, test_rng);
+    test_urbg g;
+    test_rng_seed(n);
+    batched_random::random_permutation(cpp.begin(), cpp.end(), g);
+    std::vector<uint64_t> sorted(wide);
+    std::sort(sorted.begin(), sorted.end());
+    bool success = cpp == wide && std::equal(narrow.begin(), narrow.end(),
+                                             wide.begin(), wide.end());
+    for (uint64_t i = 0; i < n; i++) {
+      success &= sorted[i] == i;
+    }
+    if (!success) {
+      std::cerr << "!!!Test failed for n = " << n << std::endl;
+      return false;
+    }
+  }
+  // The C++ version never moves an element onto itself, which a type with
+  // its own move assignment need not support.
+  struct tracked {
+    uint64_t value = 0;
+    bool *self_moved = nullptr;
+    tracked() = default;
+    explicit tracked(uint64_t v) : value(v) {}
+    tracked &operator=(tracked &&other) {
+      if (this == &other && self_moved != nullptr) {
+        *self_moved = true;
+      }
+      value = other.value;
+      return *this;
+    }
+  };
+  bool self_moved = false;
+  std::vector<tracked> items(1000);
+  for (auto &item : items) {
+    item.self_moved = &self_moved;
+  }
+  std::vector<uint64_t> wide(items.size());
+  test_rng_seed(7);
+  random_permutation_u64(wide.data(), wide.size(), test_rng);
+  test_urbg g;
+  test_rng_seed(7);
+  batched_random::random_permutation(items.begin(), items.end(), g);
+  for (uint64_t i = 0; i < items.size(); i++) {
+    if (items[i].value != wide[i]) {
+      self_moved = true;
+    }
+  }
+  if (self_moved) {
+    std::cerr << "!!!Test failed for random_permutation of tracked elements"
+              << std::endl;
+    return false;
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The partial shuffles must run the first steps of shuffle_batch_23456, the
+// same in C and in C++, and the samples must match them whether they come
+// from the dense array or from the hash table.
+bool test_partial_shuffle() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n : {0, 1, 2, 7, 100, 2049, 16387, (1 << 19) + 5}) {
+    for (uint64_t k : {uint64_t(0), uint64_t(1), uint64_t(5), uint64_t(100),
+                       uint64_t(600), n / 3, n - 1, n, n + 3}) {
+      if (k > n + 3) {
+        continue; // n - 1 with n = 0
+      }
+      std::vector<uint64_t> c(n), cpp(n), full(n);
+      for (uint64_t i = 0; i < n; i++) {
+        c[i] = cpp[i] = full[i] = i;
+      }
+      test_rng_seed(n + k);
+      partial_shuffle(c.data(), n, k, test_rng);
+      test_urbg g;
+      test_rng_seed(n + k);
+      auto tail = batched_random::partial_shuffle(cpp.begin(), cpp.end(), k, g);
+      std::vector<uint64_t> sample(std::min(k, n));
+      test_rng_seed(n + k);
+      bool success = sample_without_replacement(n, k, sample.data(),
+                                                test_rng) == 0;
+      success &= c == cpp && tail == cpp.end() - int64_t(sample.size());
+      for (size_t j = 0; j < sample.size(); j++) {
+        success &= sample[j] == c[n - j - 1];
+      }
+      if (k + 1 >= n) {
+        test_rng_seed(n + k);
+        shuffle_batch_23456(full.data(), n, test_rng);
+        success &= c == full;
+      }
+      std::sort(c.begin(), c.end());
+      for (uint64_t i = 0; i < n; i++) {
+        success &= c[i] == i;
+      }
+      if (!success) {
+        std::cerr << "!!!Test failed for n = " << n << ", k = " << k
+                  << std::endl;
+        return false;
+      }
+    }
+  }
+  // Every ordered pair out of 9 must be equally likely from the hash table.
+  std::vector<size_t> counts(81);
+  uint64_t pair[2];
+  for (size_t t = 0; t < 72 * 10000; t++) {
+    sample_without_replacement_lehmer(9, 2, pair);
+    counts[pair[0] * 9 + pair[1]]++;
+  }
+  for (uint64_t a = 0; a < 9; a++) {
+    size_t diagonal = counts[a * 9 + a];
+    counts[a * 9 + a] = 10000;
+    if (diagonal != 0) {
+      std::cerr << "!!!Repeated value " << a << std::endl;
+      return false;
+    }
+  }
+  size_t max_value = *std::max_element(counts.begin(), counts.end());
+  size_t min_value = *std::min_element(counts.begin(), counts.end());
+  if (double(max_value - min_value) / 10000 >= 0.25) {
+    std::cerr << "!!!Biased sample" << std::endl;
+    return false;
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The resampling functions must draw the values of random_bounded_fill, in
+// chunks as in one call, gather the elements of any size at those indexes,
+// and count them.
+bool test_resample() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n : {1, 2, 3, 10, 1000, 65537, (1 << 20) + 3}) {
+    for (uint64_t m : {0, 1, 255, 256, 1000, 10007}) {
+      std::vector<uint64_t> indexes(m), src(n), dst(m), counts(n, 7);
+      for (uint64_t i = 0; i < n; i++) {
+        src[i] = 3 * i + 1;
+      }
+      test_rng_seed(n + m);
+      random_bounded_fill(n, indexes.data(), m, test_rng);
+      test_rng_seed(n + m);
+      resample_with_replacement(src.data(), n, dst.data(), m, test_rng);
+      test_rng_seed(n + m);
+      resample_counts(n, m, counts.data(), test_rng);
+      bool success = true;
+      for (uint64_t j = 0; j < m; j++) {
+        success &= dst[j] == src[indexes[j]];
+        counts[indexes[j]]--;
+      }
+      success &= std::all_of(counts.begin(), counts.end(),
+                             [](uint64_t c) { return c == 0; });
+      for (size_t elem_size : {1, 3, 8, 32, 100}) {
+        if (n * elem_size > (1 << 24)) {
+          continue;
+        }
+        std::vector<unsigned char> bytes(n * elem_size), gathered(m * elem_size);
+        for (size_t b = 0; b < bytes.size(); b++) {
+          bytes[b] = (unsigned char)(b * 7 + b / 251);
+        }
+        test_rng_seed(n + m);
+        resample_bytes(bytes.data(), n, elem_size, gathered.data(), m,
+                       test_rng);
+        for (uint64_t j = 0; j < m; j++) {
+          success &= std::equal(gathered.begin() + j * elem_size,
+                                gathered.begin() + (j + 1) * elem_size,
+                                bytes.begin() + indexes[j] * elem_size);
+        }
+      }
+      if (!success) {
+        std::cerr << "!!!Test failed for n = " << n << ", m = " << m
+                  << std::endl;
+        return false;
+      }
+    }
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The bucketed shuffles must produce permutations, the same in C and in
+// C++, and move the elements across the whole range.
+bool test_bucketed_shuffle() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n : {0, 1, 7, (1 << 17) + 1, (1 << 18) + 3, (1 << 22) + 5}) {
+    std::vector<uint64_t> actual(n), cpp_actual(n);
+    for (uint64_t i = 0; i < n; i++) {
+      actual[i] = cpp_actual[i] = i;
+    }
+    test_rng_seed(n);
+    shuffle_batch_bucketed(actual.data(), n, test_rng);
+    test_urbg g;
+    test_rng_seed(n);
+    batched_random::shuffle_bucketed(cpp_actual.begin(), cpp_actual.end(), g);
+    std::vector<uint64_t> sorted(actual);
+    std::sort(sorted.begin(), sorted.end());
+    for (uint64_t i = 0; i < n; i++) {
+      if (sorted[i] != i) {
+        std::cerr << "!!!Not a permutation for n = " << n << std::endl;
+        return false;
+      }
+    }
+    if (actual != cpp_actual) {
+      std::cerr << "!!!C and C++ differ for n = " << n << std::endl;
+      return false;
+    }
+  }
+  // With one level of buckets, the elements must end up grouped by the
+  // bucket ids that the C++ shuffle rolls from its first words (twelve 5-bit
+  // ids per word), and the ids must be uniform: chi-square test on their
+  // counts over 64 shuffles with lehmer64 (31 degrees of freedom, 70 is
+  // exceeded with probability below 10^-4).
+  struct recording_lehmer64 {
+    using result_type = uint64_t;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+    lehmer64 g;
+    std::vector<uint64_t> words;
+    result_type operator()() {
+      words.push_back(g());
+      return words.back();
+    }
+  };
+  const uint64_t n = (1 << 18) + 3;
+  std::vector<uint64_t> input(n);
+  std::vector<uint8_t> ids(n);
+  std::vector<double> bucket_count(32);
+  for (uint64_t trial = 0; trial < 64; trial++) {
+    std::iota(input.begin(), input.end(), 0);
+    recording_lehmer64 g{lehmer64(UINT64_C(0x9E3779B97F4A7C15) * (trial + 1)),
+                         {}};
+    batched_random::shuffle_bucketed(input.begin(), input.end(), g);
+    std::array<uint64_t, 33> start{};
+    for (uint64_t i = 0; i < n; i++) {
+      ids[i] = uint8_t((g.words[i / 12] >> (5 * (i % 12))) & 31);
+      start[ids[i] + 1]++;
+    }
+    for (size_t b = 0; b < 32; b++) {
+      bucket_count[b] += double(start[b + 1]);
+      start[b + 1] += start[b];
+    }
+    for (uint64_t p = 0; p < n; p++) {
+      uint8_t b = ids[input[p]];
+      if (p < start[b] || p >= start[b + 1]) {
+        std::cerr << "!!!Element out of its bucket at " << p << std::endl;
+        return false;
+      }
+    }
+  }
+  double expected = 64.0 * double(n) / 32;
+  double chi_square = 0;
+  for (double c : bucket_count) {
+    chi_square += (c - expected) * (c - expected) / expected;
+  }
+  printf("chi-square: %f, ", chi_square);
+  if (chi_square > 70) {
+    std::cerr << "!!!Biased bucket ids" << std::endl;
+    return false;
+  }
+  // The first 1024 elements should land in each 1/32 of the range equally
+  // often: 2048 times in 64 shuffles, the standard deviation is about 44.
+  std::vector<uint64_t> chunk_count(32);
+  br_lehmer_t context;
+  br_lehmer_seed(&context, 1234);
+  for (size_t trial = 0; trial < 64; trial++) {
+    std::iota(input.begin(), input.end(), 0);
+    shuffle_lehmer_bucketed_r(&context, input.data(), n);
+    for (uint64_t i = 0; i < n; i++) {
+      if (input[i] < 1024) {
+        chunk_count[i * 32 / n]++;
+      }
+    }
+  }
+  for (uint64_t c : chunk_count) {
+    if (c < 1700 || c > 2400) {
+      std::cerr << "!!!Biased bucketed shuffle: " << c << std::endl;
+      return false;
+    }
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// Checks that values is a permutation of 0, 1, ..., n - 1.
+bool is_permutation_of_iota(std::vector<uint64_t> values) {
+  std::sort(values.begin(), values.end());
+  for (uint64_t i = 0; i < values.size(); i++) {
+    if (values[i] != i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The parallel shuffles must produce permutations, with any number of
+// threads, and move the elements across the whole range.
+bool test_parallel_shuffle() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t nthreads : {0, 1, 2, 3, 4, 7, 64, 1000}) {
+    for (uint64_t n : {0, 1, 7, (1 << 18) + 1, (1 << 20) + 3}) {
+      std::vector<uint64_t> actual(n), cpp_actual(n);
+      for (uint64_t i = 0; i < n; i++) {
+        actual[i] = cpp_actual[i] = i;
+      }
+      shuffle_parallel(actual.data(), n, nthreads, n + nthreads);
+      lehmer64 g(n + nthreads);
+      batched_random::shuffle_parallel(cpp_actual.begin(), cpp_actual.end(), g,
+                                       nthreads);
+      if (!is_permutation_of_iota(actual) ||
+          !is_permutation_of_iota(cpp_actual)) {
+        std::cerr << "!!!Not a permutation for n = " << n
+                  << " nthreads = " << nthreads << std::endl;
+        return false;
+      }
+    }
+  }
+  // The first 1024 elements should land in each 1/32 of the range equally
+  // often: 2048 times in 64 shuffles, the standard deviation is about 44.
+  const uint64_t n = (1 << 19) + 3;
+  std::vector<uint64_t> input(n), cpp_input(n), det_input(n);
+  std::vector<uint64_t> chunk_count(32), cpp_chunk_count(32),
+      det_chunk_count(32);
+  lehmer64 g(1234);
+  for (size_t trial = 0; trial < 64; trial++) {
+    for (uint64_t i = 0; i < n; i++) {
+      input[i] = cpp_input[i] = det_input[i] = i;
+    }
+    shuffle_parallel(input.data(), n, 4, trial);
+    batched_random::shuffle_23456(std::execution::par, cpp_input.begin(),
+                                  cpp_input.end(), g);
+    shuffle_parallel_deterministic(det_input.data(), n, 4, trial);
+    for (uint64_t i = 0; i < n; i++) {
+      if (input[i] < 1024) {
+        chunk_count[i * 32 / n]++;
+      }
+      if (cpp_input[i] < 1024) {
+        cpp_chunk_count[i * 32 / n]++;
+      }
+      if (det_input[i] < 1024) {
+        det_chunk_count[i * 32 / n]++;
+      }
+    }
+  }
+  for (size_t c = 0; c < 32; c++) {
+    for (uint64_t count :
+         {chunk_count[c], cpp_chunk_count[c], det_chunk_count[c]}) {
+      if (count < 1700 || count > 2400) {
+        std::cerr << "!!!Biased parallel shuffle: " << count << std::endl;
+        return false;
+      }
+    }
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The deterministic parallel shuffles must produce the same permutation
+// with any number of threads.
+bool test_parallel_shuffle_deterministic() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (uint64_t n : {0, 1, 7, (1 << 18) + 1, (1 << 20) + 3}) {
+    std::vector<uint64_t> expected, cpp_expected;
+    for (uint64_t nthreads : {1, 2, 3, 8, 64, 0}) {
+      std::vector<uint64_t> actual(n), cpp_actual(n);
+      for (uint64_t i = 0; i < n; i++) {
+        actual[i] = cpp_actual[i] = i;
+      }
+      shuffle_parallel_deterministic(actual.data(), n, nthreads, 1234);
+      lehmer64 g(1234);
+      batched_random::shuffle_parallel_deterministic(
+          cpp_actual.begin(), cpp_actual.end(), g, nthreads);
+      if (!is_permutation_of_iota(actual) ||
+          !is_permutation_of_iota(cpp_actual)) {
+        std::cerr << "!!!Not a permutation for n = " << n << std::endl;
+        return false;
+      }
+      if (expected.empty()) {
+        expected = actual;
+        cpp_expected = cpp_actual;
+      } else if (expected != actual || cpp_expected != cpp_actual) {
+        std::cerr << "!!!Test failed for n = " << n
+                  << " nthreads = " << nthreads << std::endl;
+        return false;
+      }
+    }
+  }
+  // Different seeds give different permutations
+  const uint64_t n = (1 << 20) + 3;
+  std::vector<uint64_t> a(n), b(n);
+  std::iota(a.begin(), a.end(), 0);
+  std::iota(b.begin(), b.end(), 0);
+  shuffle_parallel_deterministic(a.data(), n, 4, 1);
+  shuffle_parallel_deterministic(b.data(), n, 4, 2);
+  if (a == b) {
+    std::cerr << "!!!The seed is ignored" << std::endl;
+    return false;
+  }
+  std::cout << "passed" << std::endl;
+  return true;
+}
+
+// The functions with a context must give the same results as those without,
+// seeded the same way, and contexts must be usable from several threads at
+// once.
+template <class context, class seed_fn, class global_fn, class context_fn>
+bool reentrant_identical(seed_fn seed_context, global_fn global,
+                         context_fn with_context) {
+  static_assert(alignof(context) == 64, "contexts should be cache aligned");
+  for (uint64_t n : {0, 1, 7, 100, 3000}) {
+    std::vector<uint64_t> expected(n), actual(n);
+    std::iota(expected.begin(), expected.end(), 0);
+    std::iota(actual.begin(), actual.end(), 0);
+    seed(n);
+    global(expected.data(), n);
+    context ctx;
+    seed_context(&ctx, n);
+    with_context(&ctx, actual.data(), n);
+    if (expected != actual) {
+      return false;
+    }
+  }
+  // Four threads shuffle with their own context, concurrently, and must get
+  // the permutation that a single thread gets from the same seed.
+  const uint64_t n = 100000;
+  std::vector<std::vector<uint64_t>> results(4, std::vector<uint64_t>(n));
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; t++) {
+    threads.emplace_back([&, t]() {
+      context ctx;
+      seed_context(&ctx, 42);
+      for (int repeat = 0; repeat < 5; repeat++) {
+        std::iota(results[t].begin(), results[t].end(), 0);
+        with_context(&ctx, results[t].data(), n);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  std::vector<uint64_t> expected(n);
+  context ctx;
+  seed_context(&ctx, 42);
+  for (int repeat = 0; repeat < 5; repeat++) {
+    std::iota(expected.begin(), expected.end(), 0);
+    with_context(&ctx, expected.data(), n);
+  }
+  for (const std::vector<uint64_t> &result : results) {
+    if (result != expected) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool test_reentrant_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  bool success =
+      reentrant_identical<br_lehmer_t>(br_lehmer_seed, shuffle_lehmer_23456,
+                                       shuffle_lehmer_23456_r) &&
+      reentrant_identical<br_lehmer_t>(br_lehmer_seed, shuffle_lehmer,
+                                       shuffle_lehmer_r) &&
+      reentrant_identical<br_pcg_t>(br_pcg_seed, shuffle_pcg_23456,
+                                    shuffle_pcg_23456_r) &&
+      reentrant_identical<br_pcg_t>(br_pcg_seed, shuffle_pcg_2,
+                                    shuffle_pcg_2_r) &&
+      reentrant_identical<br_chacha_t>(br_chacha_seed, shuffle_chacha_23456,
+                                       shuffle_chacha_23456_r) &&
+      reentrant_identical<br_chacha_t>(br_chacha_seed, shuffle_chacha_prefetch,
+                                       shuffle_chacha_prefetch_r);
+  // bounded random numbers
+  br_lehmer_t ctx;
+  br_lehmer_seed(&ctx, 7);
+  seed(7);
+  for (uint64_t range : {1, 2, 3, 1000, 1 << 30}) {
+    uint64_t expected[100], actual[100];
+    random_bounded_fill_lehmer(range, expected, 100);
+    random_bounded_fill_lehmer_r(&ctx, range, actual, 100);
+    success &= std::equal(expected, expected + 100, actual);
+    success &= random_bounded_lehmer(range) ==
+               random_bounded_lehmer_r(&ctx, range);
+  }
+  if (success) {
+    std::cout << "passed" << std::endl;
+  } else {
+    std::cerr << "!!!Test failed" << std::endl;
+  }
+  return success;
+}
+
+// Advancing a context by delta must give the same outputs as calling next
+// delta times, and split must hand out the next split_stride outputs.
+template <class context, class seed_fn, class next_fn, class advance_fn,
+          class split_fn>
+bool advance_identical(seed_fn seed_context, next_fn next,
+                       advance_fn advance, split_fn split,
+                       uint64_t split_stride) {
+  for (uint64_t start : {0, 1, 3, 8}) {
+    for (uint64_t delta : {0, 1, 2, 7, 8, 9, 15, 16, 17, 100, 1000, 12345}) {
+      context stepped, jumped;
+      seed_context(&stepped, delta);
+      for (uint64_t i = 0; i < start; i++) {
+        next(&stepped);
+      }
+      jumped = stepped;
+      for (uint64_t i = 0; i < delta; i++) {
+        next(&stepped);
+      }
+      advance(&jumped, delta);
+      for (int i = 0; i < 20; i++) {
+        if (next(&stepped) != next(&jumped)) {
+          return false;
+        }
+      }
+    }
+  }
+  context parent, child, expected;
+  seed_context(&parent, 42);
+  next(&parent);
+  expected = parent;
+  split(&parent, &child);
+  for (int i = 0; i < 20; i++) {
+    if (next(&child) != next(&expected)) {
+      return false;
+    }
+  }
+  // expected has moved 20 outputs ahead
+  advance(&expected, split_stride - 20);
+  for (int i = 0; i < 20; i++) {
+    if (next(&parent) != next(&expected)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool test_advance_split() {
+  std::cout << __FUNCTION__ << std::endl;
+  bool success =
+      advance_identical<br_lehmer_t>(br_lehmer_seed, br_lehmer_next,
+                                     br_lehmer_advance, br_lehmer_split,
+                                     BR_SPLIT_STRIDE) &&
+      advance_identical<br_pcg_t>(br_pcg_seed, br_pcg_next, br_pcg_advance,
+                                  br_pcg_split, BR_SPLIT_STRIDE) &&
+      advance_identical<br_chacha_t>(br_chacha_seed, br_chacha_next,
+                                     br_chacha_advance, br_chacha_split,
+                                     BR_CHACHA_SPLIT_STRIDE);
+  // the C++ generator
+  for (unsigned long long delta : {0, 1, 2, 1000, 12345}) {
+    lehmer64 stepped(delta), jumped(delta);
+    for (unsigned long long i = 0; i < delta; i++) {
+      stepped();
+    }
+    jumped.discard(delta);
+    success &= stepped() == jumped();
+  }
+  lehmer64 parent(42);
+  lehmer64 expected(parent);
+  lehmer64 child = parent.split();
+  success &= child() == expected();
+  expected.discard(lehmer64::split_stride - 1);
+  success &= parent() == expected();
+  if (success) {
+    std::cout << "passed" << std::endl;
+  } else {
+    std::cerr << "!!!Test failed" << std::endl;
+  }
+  return success;
+}
+
+// ChaCha must give the same words with and without SIMD: the block of RFC 7539
+// (section 2.3.2), and words recorded from the scalar implementation (one
+// block at a time) at indexes around the block and buffer boundaries.
+bool test_chacha_known_answer() {
+  std::cout << __FUNCTION__ << std::endl;
+  bool success = true;
+  br_chacha_t ctx;
+  uint32_t key[8];
+  for (uint32_t i = 0; i < 8; i++) {
+    key[i] = (4 * i) | (4 * i + 1) << 8 | (4 * i + 2) << 16 | (4 * i + 3) << 24;
+  }
+  // The RFC puts a 32-bit counter and a 96-bit nonce in the last four words.
+  br_chacha_seed_key(&ctx, key, 0x4a000000, 20);
+  const uint64_t block = (uint64_t)0x09000000 << 32 | 1;
+  br_chacha_advance(&ctx, block * 8);
+  const uint32_t rfc_block[16] = {
+      0xe4e7f110, 0x15593bd1, 0x1fdd0f50, 0xc47120a3, 0xc7f4d1c7, 0x0368c033,
+      0x9aaa2204, 0x4e6cd4c3, 0x466482d2, 0x09aa9f07, 0x05d7c214, 0xa2028bd9,
+      0xd19c12b5, 0xb94e16de, 0xe883d0cb, 0x4e3c50a2};
+  for (int i = 0; i < 16; i += 2) {
+    uint64_t expected = (uint64_t)rfc_block[i + 1] << 32 | rfc_block[i];
+    success &= br_chacha_next(&ctx) == expected;
+  }
+
+  const uint64_t indexes[11] = {0, 1, 7, 8, 63, 64, 65, 127, 128, 1000, 4097};
+  const std::pair<size_t, std::array<uint64_t, 11>> recorded[] = {
+      {8,
+       {UINT64_C(0x80395515ac1910bb), UINT64_C(0xb38fc5b548d08c13),
+        UINT64_C(0x106f4e4e8139e24d), UINT64_C(0x2687bd66de40877d),
+        UINT64_C(0x718980d76bc3ef5e), UINT64_C(0x62a0857fad84abd5),
+        UINT64_C(0xfa9b84aab4f5a817), UINT64_C(0xc9ea90c503b64546),
+        UINT64_C(0x3a28e7e79c39073b), UINT64_C(0x59bb041623c8c4c6),
+        UINT64_C(0xbd4fddd0b3f1ee76)}},
+      {12,
+       {UINT64_C(0xc2bf3d277d730fe3), UINT64_C(0x471afba750be3591),
+        UINT64_C(0x0effd5b1ce852503), UINT64_C(0x53284dd158411104),
+        UINT64_C(0xba713c33699b5389), UINT64_C(0x4aacbf2c24fc0e46),
+        UINT64_C(0x2751b23a37a7feb0), UINT64_C(0x47ea61630adb0445),
+        UINT64_C(0x49c4b9ca5a984b07), UINT64_C(0xa4cd7251c9112ebf),
+        UINT64_C(0x99571e3a3ea92102)}},
+      {20,
+       {UINT64_C(0x31b049a82b467b62), UINT64_C(0xcfce94e6e8c64a9e),
+        UINT64_C(0x20608be83e7ca88e), UINT64_C(0x4bdd3d6aee0566e3),
+        UINT64_C(0x9a186b7453e6849f), UINT64_C(0xf3300950c78a275b),
+        UINT64_C(0x984f54b076012b6a), UINT64_C(0x1075ff6fc2c8f75d),
+        UINT64_C(0xec069d5cd1a2d80f), UINT64_C(0xc11085b6b660e08f),
+        UINT64_C(0x12305c4d67f1ce9f)}}};
+  for (const auto &[rounds, words] : recorded) {
+    br_chacha_seed_rounds(&ctx, 42, rounds);
+    size_t j = 0;
+    for (uint64_t i = 0; i <= indexes[10]; i++) {
+      uint64_t word = br_chacha_next(&ctx);
+      if (i == indexes[j]) {
+        success &= word == words[j];
+        j++;
+      }
+    }
+    // the same words after a jump
+    br_chacha_seed_rounds(&ctx, 42, rounds);
+    br_chacha_advance(&ctx, 1000);
+    success &= br_chacha_next(&ctx) == words[9];
+  }
+  // br_chacha_seed is ChaCha8
+  br_chacha_seed(&ctx, 42);
+  success &= br_chacha_next(&ctx) == recorded[0].second[0];
+  if (success) {
+    std::cout << "passed" << std::endl;
+  } else {
+    std::cerr << "!!!Test failed" << std::endl;
+  }
+  return success;
+}
+
+// The C engines seeded by seed(s) and the C++ generators seeded with s must
+// give the same words: shuffle_X_23456 must match shuffle_batch_23456 fed by
+// the C++ generator.
+template <class URBG> static URBG *engine_under_test;
+template <class URBG> static uint64_t engine_under_test_next() {
+  return (*engine_under_test<URBG>)();
+}
+
+template <class URBG>
+bool engine_identical(void (*c_shuffle)(uint64_t *, uint64_t)) {
+  for (uint64_t n : {10, 1000, 100000}) {
+    std::vector<uint64_t> expected(n), actual(n);
+    std::iota(expected.begin(), expected.end(), 0);
+    std::iota(actual.begin(), actual.end(), 0);
+    seed(n);
+    c_shuffle(expected.data(), n);
+    URBG g(n);
+    engine_under_test<URBG> = &g;
+    shuffle_batch_23456(actual.data(), n, engine_under_test_next<URBG>);
+    if (expected != actual) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool test_engines_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  bool success = engine_identical<xoshiro256pp>(shuffle_xoshiro256pp_23456) &&
+                 engine_identical<wyrand>(shuffle_wyrand_23456) &&
+                 engine_identical<sfc64>(shuffle_sfc64_23456) &&
+                 engine_identical<romu_duo_jr>(shuffle_romu_23456);
+  if (success) {
+    std::cout << "passed" << std::endl;
+  } else {
+    std::cerr << "!!!Test failed" << std::endl;
+  }
+  return success;
+}
+
+// Known answers for the small engines, computed independently of this
+// library from the reference algorithms: xoshiro256plusplus.c, wyrand of
+// wyhash final version 3, sfc64 of PractRand 0.94 and RomuDuoJr of romu.c.
+// The state {1, 2, 3, 4} of xoshiro256++ is the usual reference vector. The
+// other engines are seeded as in this library, from splitmix64, whose first
+// output from 0 is the one of splitmix64.c. Outputs 0, 1, 2 and 999 from seed
+// 42 are checked, and test_engines_identical ties the C engines to these.
+template <class URBG>
+static bool engine_known_answer(URBG g, const std::array<uint64_t, 4> &words) {
+  bool success = true;
+  for (uint64_t i = 0; i < 1000; i++) {
+    uint64_t word = g();
+    if (i < 3) {
+      success &= word == words[i];
+    } else if (i == 999) {
+      success &= word == words[3];
+    }
+  }
+  return success;
+}
+
+bool test_engines_known_answer() {
+  std::cout << __FUNCTION__ << std::endl;
+  bool success = splitmix64_at(0, 0) == UINT64_C(0xe220a8397b1dcdaf);
+  const uint64_t state[4] = {1, 2, 3, 4};
+  xoshiro256pp reference(state);
+  const uint64_t reference_words[5] = {
+      41943041, 58720359, UINT64_C(3588806011781223),
+      UINT64_C(3591011842654386), UINT64_C(9228616714210784205)};
+  for (uint64_t expected : reference_words) {
+    success &= reference() == expected;
+  }
+  success &= engine_known_answer(
+      xoshiro256pp(42),
+      {UINT64_C(0xd0764d4f4476689f), UINT64_C(0x519e4174576f3791),
+       UINT64_C(0xfbe07cfb0c24ed8c), UINT64_C(0xa3ed059c1cc38790)});
+  success &= engine_known_answer(
+      wyrand(42),
+      {UINT64_C(0x57ce9f0fb367a6da), UINT64_C(0xd0896df64775c178),
+       UINT64_C(0xa4568876599a444c), UINT64_C(0x08bae784f0a912d7)});
+  success &= engine_known_answer(
+      sfc64(42),
+      {UINT64_C(0x74445bc8d8c88b03), UINT64_C(0xc2f7e2538f4899c6),
+       UINT64_C(0x05d131045418b46b), UINT64_C(0x861ef3b9b23b24e9)});
+  success &= engine_known_answer(
+      romu_duo_jr(42),
+      {UINT64_C(0xbdd732262feb6e95), UINT64_C(0xdb451835b9f4a0e1),
+       UINT64_C(0x18cc6d35928316d8), UINT64_C(0xa2f430435a83d9e6)});
+  if (success) {
+    std::cout << "passed" << std::endl;
+  } else {
+    std::cerr << "!!!Test failed" << std::endl;
+  }
+  return success;
+}
+
+// A generator of the integers min, min + 1, ..., max, min, ... in turn.
+template <uint64_t Min, uint64_t Max> struct cycling_generator {
+  using result_type = uint64_t;
+  static constexpr result_type min() { return Min; }
+  static constexpr result_type max() { return Max; }
+  result_type operator()() { return next == Max ? (next = Min, Max) : next++; }
+  uint64_t next = Min;
+};
+
+// word64_adapter must concatenate the bits of the generator, rejecting the
+// values above the largest multiple of 2^bits, and the 32-bit shuffle must
+// produce permutations at every size.
+bool test_word64_adapter() {
+  std::cout << __FUNCTION__ << std::endl;
+  bool success = true;
+  cycling_generator<10, 10 + 0xffff> g16;
+  batched_random::word64_adapter w16(g16);
+  success &= w16() == UINT64_C(0x0000000100020003);
+  success &= w16() == UINT64_C(0x0004000500060007);
+  // 6 values: 2 bits from 0, 1, 2 and 3, 4 and 5 are rejected
+  cycling_generator<0, 5> g6;
+  batched_random::word64_adapter w6(g6);
+  success &= w6() == UINT64_C(0x1b1b1b1b1b1b1b1b);
+  success &= batched_random::next_word64(g6) == UINT64_C(0x1b1b1b1b1b1b1b1b);
+  // full-range 64-bit generators are used as they are
+  cycling_generator<0, UINT64_MAX> g64;
+  success &= batched_random::next_word64(g64) == 0;
+  success &= batched_random::next_word64(g64) == 1;
+  std::mt19937 mt(1234);
+  for (uint64_t n : {2, 7, 100, 1000, 20000, 600000}) {
+    std::vector<uint64_t> values(n);
+    std::iota(values.begin(), values.end(), 0);
+    batched_random::shuffle_23456(values.begin(), values.end(), mt);
+    success &= is_permutation_of_iota(values);
+  }
+  if (success) {
+    std::cout << "passed" << std::endl;
+  } else {
+    std::cerr << "!!!Test failed" << std::endl;
+  }
+  return success;
+}
+
+// The counter-based engines: the Philox4x64-10 block of Random123
+// (kat_vectors) and the AES-128 block of FIPS 197 (appendix C.1), at any
+// offset. Their dice must not depend on how the steps are split, and the
+// shuffles must apply them.
+template <class context_type>
+bool counter_engine_consistent(
+    context_type *ctx,
+    void (*fill)(const context_type *, uint64_t, uint64_t *, uint64_t),
+    void (*dice)(const context_type *, uint64_t, uint64_t, uint64_t,
+                 uint64_t *),
+    void (*shuffle)(context_type *, uint64_t *, uint64_t)) {
+  std::vector<uint64_t> words(64), part(64);
+  fill(ctx, 0, words.data(), words.size());
+  for (uint64_t start = 0; start < 8; start++) {
+    for (uint64_t count = 0; start + count <= 40; count++) {
+      fill(ctx, start, part.data(), count);
+      if (!std::equal(part.begin(), part.begin() + count,
+                      words.begin() + start)) {
+        return false;
+      }
+    }
+  }
+  for (uint64_t n : {UINT64_C(7), UINT64_C(1000), UINT64_C(100000),
+                     UINT64_C(1) << 30 | 5}) {
+    // steps around the phase boundaries, for the largest size
+    uint64_t steps = n > 100000 ? 40000 : n - 1;
+    uint64_t first = n > 100000 ? 4 : 0;
+    std::vector<uint64_t> whole(steps), pieces(steps);
+    dice(ctx, n, first, steps, whole.data());
+    for (uint64_t j = 0, len = 1; j < steps; j += len, len = 3 * len + 1) {
+      len = std::min(len, steps - j);
+      dice(ctx, n, first + j, len, pieces.data() + j);
+    }
+    if (whole != pieces) {
+      return false;
+    }
+    for (uint64_t j = 0; j < steps; j++) {
+      if (whole[j] >= n - first - j) {
+        return false;
+      }
+    }
+    if (first != 0) {
+      continue;
+    }
+    std::vector<uint64_t> expected(n), actual(n);
+    std::iota(expected.begin(), expected.end(), 0);
+    std::iota(actual.begin(), actual.end(), 0);
+    for (uint64_t j = 0; j < steps; j++) {
+      std::swap(expected[n - 1 - j], expected[whole[j]]);
+    }
+    context_type copy = *ctx;
+    shuffle(&copy, actual.data(), n);
+    if (expected != actual) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool test_counter_engines() {
+  std::cout << __FUNCTION__ << std::endl;
+  bool success = true;
+  br_philox_t philox;
+  const uint64_t zero_key[2] = {0, 0};
+  br_philox_seed_key(&philox, zero_key);
+  uint64_t words[4];
+  br_philox_fill(&philox, 0, words, 4);
+  success &= words[0] == UINT64_C(0x16554d9eca36314c) &&
+             words[1] == UINT64_C(0xdb20fe9d672d0fdc) &&
+             words[2] == UINT64_C(0xd7e772cee186176b) &&
+             words[3] == UINT64_C(0x7e68b68aec7ba23b);
+  br_aes_t aes;
+  uint8_t key[16];
+  for (int i = 0; i < 16; i++) {
+    key[i] = (uint8_t)i;
+  }
+  // the block 00112233...ff, read as a little-endian counter and nonce
+  br_aes_seed_key(&aes, key, UINT64_C(0xffeeddccbbaa9988));
+  br_aes_fill(&aes, UINT64_C(0x7766554433221100) * 2, words, 2);
+  success &= words[0] == UINT64_C(0x30047b6ad8e0c469) &&
+             words[1] == UINT64_C(0x5ac5b47080b7cdd8);
+  // the same block without AES-NI, which the processors that have it never
+  // run otherwise, and the same words with both from odd starts
+  br_aes_fill_portable(&aes, UINT64_C(0x7766554433221100) * 2, words, 2);
+  success &= words[0] == UINT64_C(0x30047b6ad8e0c469) &&
+             words[1] == UINT64_C(0x5ac5b47080b7cdd8);
+  for (uint64_t start : {0, 1, 7, 1000}) {
+    std::vector<uint64_t> expected(37), actual(37);
+    br_aes_fill(&aes, start, expected.data(), expected.size());
+    br_aes_fill_portable(&aes, start, actual.data(), actual.size());
+    success &= expected == actual;
+  }
+
+  br_philox_seed(&philox, 1234);
+  br_aes_seed(&aes, 1234);
+  success &= counter_engine_consistent(&philox, br_philox_fill,
+                                       dice_philox_23456_r,
+                                       shuffle_philox_23456_r);
+  success &= counter_engine_consistent(&aes, br_aes_fill, dice_aes_23456_r,
+                                       shuffle_aes_23456_r);
+  if (success) {
+    std::cout << "passed" << std::endl;
+  } else {
+    std::cerr << "!!!Test failed" << std::endl;
+  }
+  return success;
+}
+
+// A user generator for the header-only functions: it produces the words of
+// test_rng.
+struct test_inline_context {
+  uint64_t calls;
+};
+static inline uint64_t test_inline_next(test_inline_context *ctx) {
+  ctx->calls++;
+  return test_rng();
+}
+BR_DEFINE_INLINE(test_inline, test_inline_context, test_inline_next)
+
+// The header-only functions must give the same results as the functions
+// taking a function pointer, from the same random words.
+bool test_inline_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  bool success = true;
+  for (uint64_t n : {2, 7, 100, 1000, 20000, 600000}) {
+    std::vector<uint64_t> expected(n), actual(n);
+    using pointer_shuffle = void (*)(uint64_t *, uint64_t, uint64_t (*)(void));
+    using inline_shuffle = void (*)(test_inline_context *, uint64_t *,
+                                    uint64_t);
+    const std::pair<pointer_shuffle, inline_shuffle> shuffles[] = {
+        {shuffle, test_inline_shuffle},
+        {shuffle_batch_2, test_inline_shuffle_2},
+        {shuffle_batch_23456, test_inline_shuffle_23456}};
+    for (auto [pointer, inlined] : shuffles) {
+      std::iota(expected.begin(), expected.end(), 0);
+      std::iota(actual.begin(), actual.end(), 0);
+      test_rng_seed(n);
+      pointer(expected.data(), n, test_rng);
+      uint64_t words = test_rng_counter;
+      test_inline_context ctx{0};
+      test_rng_seed(n);
+      inlined(&ctx, actual.data(), n);
+      success &= expected == actual && ctx.calls == words;
+    }
+  }
+  const uint64_t ranges[] = {1, 2, 3, 1000, 1 << 30, UINT64_MAX};
+  for (uint64_t range : ranges) {
+    uint64_t expected[100], actual[100];
+    test_rng_seed(range);
+    random_bounded_fill(range, expected, 100, test_rng);
+    uint64_t expected_one = random_bounded(range, test_rng);
+    test_inline_context ctx{0};
+    test_rng_seed(range);
+    test_inline_random_bounded_fill(&ctx, range, actual, 100);
+    success &= std::equal(expected, expected + 100, actual) &&
+               test_inline_random_bounded(&ctx, range) == expected_one;
+  }
+  {
+    uint64_t expected[6], actual[6];
+    test_rng_seed(6);
+    random_bounded_ranges(ranges, expected, 6, test_rng);
+    test_inline_context ctx{0};
+    test_rng_seed(6);
+    test_inline_random_bounded_ranges(&ctx, ranges, actual, 6);
+    success &= std::equal(expected, expected + 6, actual);
+  }
+  if (success) {
+    std::cout << "passed" << std::endl;
+  } else {
+    std::cerr << "!!!Test failed" << std::endl;
+  }
+  return success;
+}
+
+// Shuffles a std::array and a std::span of N elements and checks that they
+// give the same permutation as shuffle_23456 from the same random words.
+template <size_t N> bool fixed_shuffle_identical() {
+  static std::array<uint64_t, N> expected, actual, span_actual;
+  for (uint64_t i = 0; i < N; i++) {
+    expected[i] = actual[i] = span_actual[i] = i;
+  }
+  test_urbg g;
+  test_rng_seed(N);
+  batched_random::shuffle_23456(expected.begin(), expected.end(), g);
+  test_rng_seed(N);
+  batched_random::shuffle(actual, g);
+  test_rng_seed(N);
+  batched_random::shuffle(std::span<uint64_t, N>(span_actual), g);
+  if (expected != actual || expected != span_actual) {
+    std::cerr << "!!!Test failed for N = " << N << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool test_fixed_shuffle_identical() {
+  std::cout << __FUNCTION__ << std::endl;
+  bool success = fixed_shuffle_identical<0>() && fixed_shuffle_identical<1>() &&
+                 fixed_shuffle_identical<2>() && fixed_shuffle_identical<7>() &&
+                 fixed_shuffle_identical<52>() &&
+                 fixed_shuffle_identical<192>() &&
+                 fixed_shuffle_identical<193>() &&
+                 fixed_shuffle_identical<3000>() &&
+                 fixed_shuffle_identical<20000>();
+  if (success) {
+    std::cout << "passed" << std::endl;
+  }
+  return success;
+}
+
+bool test_all_permutations_equally_likely() {
+  std::cout << __FUNCTION__ << std::endl;
+  for (const auto &f : func) {
+    for (size_t n : {2, 3, 5, 6}) {
+      std::cout << std::setw(40) << f.name << " n = " << n << ": ";
+      std::cout.flush();
+      if (!all_permutations_equally_likely(f.function, n)) {
+        std::cerr << "!!!Test failed for " << f.name << std::endl;
+        return false;
+      } else {
+        std::cout << "passed" << std::endl;
+      }
+    }
+  }
+  return true;
+}
+
 int main() {
   seed(1234);
   bool success = true;
@@ -216,6 +1897,33 @@ int main() {
   success &= test_any_possible_pair_at_the_end();
   success &= test_any_possible_pair_at_the_start();
   success &= test_everyone_can_move_everywhere();
+  success &= test_all_permutations_equally_likely();
+  success &= test_random_bounded_fill();
+  success &= test_random_bounded_ranges();
+  success &= test_interleaved_simd_identical();
+  success &= test_small_dice_schedule();
+  success &= test_small_shuffle_identical();
+  success &= test_shuffle_128_identical();
+  success &= test_shuffle_plan_identical();
+  success &= test_fixed_shuffle_identical();
+  success &= test_blocked_shuffle_identical();
+  success &= test_prefetch_shuffle_identical();
+  success &= test_shuffle_bytes_identical();
+  success &= test_shuffle_together();
+  success &= test_random_permutation();
+  success &= test_partial_shuffle();
+  success &= test_resample();
+  success &= test_bucketed_shuffle();
+  success &= test_parallel_shuffle();
+  success &= test_parallel_shuffle_deterministic();
+  success &= test_reentrant_identical();
+  success &= test_inline_identical();
+  success &= test_advance_split();
+  success &= test_chacha_known_answer();
+  success &= test_engines_identical();
+  success &= test_engines_known_answer();
+  success &= test_counter_engines();
+  success &= test_word64_adapter();
   if (success) {
     std::cout << "All tests passed" << std::endl;
   } else {